@@ -1,12 +1,20 @@
 // Include standard headers
 #define _CRT_SECURE_NO_WARNINGS
 
+// stb_image allocates from the decoding thread's arena instead of the heap
+#include "decodearena.hpp"
+#define STBI_MALLOC(size) decodeArenaMalloc(size)
+#define STBI_REALLOC_SIZED(pointer, oldSize, newSize) decodeArenaRealloc(pointer, oldSize, newSize)
+#define STBI_FREE(pointer) decodeArenaFree(pointer)
+
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <vector>
+#include <chrono>
+#include <functional>
 
 #include <string>
 #include <iostream>
@@ -17,6 +25,8 @@ using namespace std;
 
 #include <stdlib.h>
 #include <string.h>
+#include <stddef.h>
+#include <random>
 
 
 // Include GLEW
@@ -33,6 +43,39 @@ using namespace glm;
 
 #include "controls.hpp"
 #include "objloader.hpp"
+#include "mesh.hpp"
+#include "sphere.hpp"
+#include "texture.hpp"
+#include "jobs.hpp"
+#include "streammesh.hpp"
+#include "gltfloader.hpp"
+#include "virtualtexture.hpp"
+#include "textureupload.hpp"
+#include "texturemanager.hpp"
+#include "scene.hpp"
+#include "renderqueue.hpp"
+
+// Memory ceilings of a streamed mesh: CPU memory while its OBJ is cooked into chunks, and GPU memory
+// for the chunks resident at once. Chunks coming into view are uploaded a few per frame.
+const size_t streamCookBudget = 256u << 20;
+const size_t streamGPUBudget = 128u << 20;
+const unsigned int streamUploadsPerFrame = 4;
+
+// GPU memory for the tiles of each virtual texture resident at once, and how many come in per frame.
+// The feedback pass that finds the tiles runs at 1/virtualFeedbackDivisor of the window's size.
+const size_t virtualTextureGPUBudget = 32u << 20;
+const unsigned int virtualUploadsPerFrame = 8;
+const int virtualFeedbackDivisor = 8;
+
+// Texture levels go to GL through a ring of staging memory, at most a budget of bytes per frame so
+// that a big texture arriving never makes for a long frame. The ring holds a few frames' worth,
+// since a frame's region is only reused once the GPU is done reading it.
+const size_t textureStagingBytes = 16u << 20;
+const size_t textureUploadBytesPerFrame = 4u << 20;
+
+// GPU memory for every texture of the scene, the virtual textures' tile caches included. A texture
+// that would go over it loses its largest levels when it is loaded.
+const size_t textureGPUBudget = 128u << 20;
 
 GLuint LoadShaders(const char* vertex_file_path, const char* fragment_file_path) {
 
@@ -129,123 +172,494 @@ GLuint LoadShaders(const char* vertex_file_path, const char* fragment_file_path)
 	return ProgramID;
 }
 
+// Pixels one world unit covers around a world-space point, which is what LOD selection needs
+static float pixelsPerWorldUnit(const glm::mat4& ProjectionMatrix, const glm::vec3& world) {
+	float distance = glm::length(world - getPos());
+	// ProjectionMatrix[1][1] is cot(FoV / 2), and the window is 800 pixels high
+	return ProjectionMatrix[1][1] * 400.0f / (distance > 0.1f ? distance : 0.1f);
+}
 
+// Same, per model unit around a model-space point
+static float pixelsPerUnit(const glm::mat4& ProjectionMatrix, const glm::mat4& ModelMatrix, const glm::vec3& point) {
+	return pixelsPerWorldUnit(ProjectionMatrix, glm::vec3(ModelMatrix * glm::vec4(point, 1.0f)));
+}
 
-// Very, VERY simple OBJ loader.
-// Here is a short list of features a real function would provide : 
-// - Binary files. Reading a model should be just a few memcpy's away, not parsing a file at runtime. In short : OBJ is not very great.
-// - Animations & bones (includes bones weights)
-// - Multiple UVs
-// - All attributes should be optional, not "forced"
-// - More stable. Change a line in the OBJ file and it crashes.
-// - More secure. Change another line and you can inject code.
-// - Loading from memory, stream, etc
-
-bool loadOBJ(
-	const char* path,
-	std::vector<glm::vec3>& out_vertices,
-	std::vector<glm::vec2>& out_uvs,
-	std::vector<glm::vec3>& out_normals
-) {
-	printf("Loading OBJ file %s...\n", path);
-
-	std::vector<unsigned int> vertexIndices, uvIndices, normalIndices;
-	std::vector<glm::vec3> temp_vertices;
-	std::vector<glm::vec2> temp_uvs;
-	std::vector<glm::vec3> temp_normals;
-
+// The view frustum of MVP as six planes, normalized so that they give distances. They come
+// straight from the rows of MVP (Gribb & Hartmann), so they are in the space MVP maps from.
+static void getFrustumPlanes(const glm::mat4& MVP, glm::vec4 planes[6]) {
+	for (int axis = 0; axis < 3; axis++) {
+		for (int side = -1; side <= 1; side += 2) {
+			glm::vec4& plane = planes[axis * 2 + (side + 1) / 2];
+			for (int column = 0; column < 4; column++)
+				plane[column] = MVP[column][3] + side * MVP[column][axis];
+			plane /= glm::length(glm::vec3(plane.x, plane.y, plane.z));
+		}
+	}
+}
 
-	FILE* file = fopen(path, "r");
-	if (file == NULL) {
-		printf("Impossible to open the file ! Are you in the right path ? See Tutorial 1 for details\n");
-		getchar();
-		return false;
+// Is a sphere, in the space of the planes, at least partly inside them?
+static bool sphereInPlanes(const glm::vec4 planes[6], const glm::vec3& centre, float radius) {
+	for (int i = 0; i < 6; i++) {
+		if (planes[i].x * centre.x + planes[i].y * centre.y + planes[i].z * centre.z + planes[i].w < -radius)
+			return false;
 	}
+	return true;
+}
 
-	while (1) {
+// GL objects of one mesh, and what drawing it needs once the CPU copy is gone
+struct MeshBuffers {
+	GLuint vertexArray; // captures the attribute layout and the element buffer
+	GLuint vertexbuffer;
+	GLuint elementbuffer;
+	GLenum indexType;
+	unsigned int indexSize;
+	// Vertex layout, for more VAOs over the same buffers
+	VertexFormat format;
+	unsigned int vertexSize, positionSize, uvSize;
+	// Uniforms that undo the vertex quantization in the shader
+	glm::vec3 positionScale, positionOffset;
+	glm::vec2 uvScale, uvOffset;
+	GLint octahedralNormals;
+	// Bounding sphere in model space, for LOD distance, culling and collisions
+	glm::vec3 centre;
+	float radius;
+	// Levels of detail; the level a body is drawn at is the scene's
+	MeshLODs lods;
+};
+
+// position | uv | normal from the bound GL_ARRAY_BUFFER into the bound VAO, as normalized integers when quantized
+static void setVertexLayout(VertexFormat format, unsigned int vertexSize, unsigned int positionSize, unsigned int uvSize) {
+	bool quantized = format == VERTEX_QUANTIZED;
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(
+		0,                  // attribute
+		quantized ? 4 : 3,  // size
+		quantized ? GL_UNSIGNED_SHORT : GL_FLOAT, // type
+		quantized ? GL_TRUE : GL_FALSE, // normalized?
+		vertexSize,         // stride
+		(void*)0            // array buffer offset
+	);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(
+		1,
+		2,
+		quantized ? GL_UNSIGNED_SHORT : GL_FLOAT,
+		quantized ? GL_TRUE : GL_FALSE,
+		vertexSize,
+		(void*)(size_t)positionSize
+	);
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(
+		2,
+		quantized ? 2 : 3,
+		quantized ? GL_SHORT : GL_FLOAT,
+		quantized ? GL_TRUE : GL_FALSE,
+		vertexSize,
+		(void*)(size_t)(positionSize + uvSize)
+	);
+}
 
-		char lineHeader[128];
-		// read the first word of the line
-		int res = fscanf(file, "%s", lineHeader);
-		if (res == EOF)
-			break; // EOF = End Of File. Quit the loop.
+// Loads a mesh into one interleaved VBO, records its layout in a VAO and releases the CPU copy
+static void uploadMesh(Mesh& mesh, MeshBuffers& buffers) {
+	glGenVertexArrays(1, &buffers.vertexArray);
+	glBindVertexArray(buffers.vertexArray);
+
+	glGenBuffers(1, &buffers.vertexbuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, buffers.vertexbuffer);
+	glBufferData(GL_ARRAY_BUFFER, mesh.vertexCount * mesh.vertexSize, mesh.vertices, GL_STATIC_DRAW);
+
+	setVertexLayout(mesh.format, mesh.vertexSize, mesh.positionSize, mesh.uvSize);
+
+	// The element buffer binding is part of the VAO state too
+	glGenBuffers(1, &buffers.elementbuffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers.elementbuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.indexCount * mesh.indexSize, mesh.indices, GL_STATIC_DRAW);
+	buffers.indexType = mesh.indexSize == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	buffers.indexSize = mesh.indexSize;
+	glBindVertexArray(0);
+
+	buffers.format = mesh.format;
+	buffers.vertexSize = mesh.vertexSize;
+	buffers.positionSize = mesh.positionSize;
+	buffers.uvSize = mesh.uvSize;
+
+	getDequantization(mesh, buffers.positionScale, buffers.positionOffset, buffers.uvScale, buffers.uvOffset);
+	buffers.octahedralNormals = mesh.format == VERTEX_QUANTIZED ? 1 : 0;
+
+	buffers.centre = mesh.sphereCentre;
+	buffers.radius = mesh.sphereRadius;
+	buffers.lods = mesh.lods;
+	freeMesh(mesh);
+}
 
-		// else : parse lineHeader
+// GPU side of a streamed mesh: a fixed number of chunk-sized slots in one VBO and one EBO, refilled
+// from the mapped cache as chunks come into view, the one drawn longest ago making room
+struct StreamedBuffers {
+	GLuint vertexArray;
+	GLuint vertexbuffer;
+	GLuint elementbuffer;
+	unsigned int slotCount;
+	size_t slotVertexBytes, slotIndexBytes;
+	std::vector<int> slotChunk; // chunk held by each slot, -1 while empty
+	std::vector<unsigned int> slotLastDrawn; // frame each slot was last drawn in
+	std::vector<int> chunkSlot; // slot of each chunk, -1 while it is not resident, droppedChunk for good
+	unsigned int frame;
+	glm::vec3 positionScale, positionOffset;
+	glm::vec2 uvScale, uvOffset;
+	GLint octahedralNormals;
+};
+
+// A chunk whose indices point past its own vertices would draw from another slot, or past the buffer
+const int droppedChunk = -2;
+
+// Allocates as many slots as fit in memoryBudget bytes of GPU memory, and no more than there are chunks
+static void createStreamedBuffers(const StreamedMesh& mesh, size_t memoryBudget, StreamedBuffers& buffers) {
+	buffers.slotVertexBytes = (size_t)streamChunkVertices * mesh.vertexSize;
+	buffers.slotIndexBytes = (size_t)3 * streamChunkTriangles * sizeof(unsigned short);
+	size_t slotCount = memoryBudget / (buffers.slotVertexBytes + buffers.slotIndexBytes);
+	if (slotCount > mesh.chunkCount)
+		slotCount = mesh.chunkCount;
+	if (slotCount == 0)
+		slotCount = 1;
+	buffers.slotCount = (unsigned int)slotCount;
+	buffers.slotChunk.assign(slotCount, -1);
+	buffers.slotLastDrawn.assign(slotCount, 0);
+	buffers.chunkSlot.assign(mesh.chunkCount, -1);
+	buffers.frame = 0;
+
+	glGenVertexArrays(1, &buffers.vertexArray);
+	glBindVertexArray(buffers.vertexArray);
+
+	glGenBuffers(1, &buffers.vertexbuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, buffers.vertexbuffer);
+	glBufferData(GL_ARRAY_BUFFER, slotCount * buffers.slotVertexBytes, NULL, GL_DYNAMIC_DRAW);
+	setVertexLayout(mesh.format, mesh.vertexSize, mesh.positionSize, mesh.uvSize);
+
+	glGenBuffers(1, &buffers.elementbuffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers.elementbuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, slotCount * buffers.slotIndexBytes, NULL, GL_DYNAMIC_DRAW);
+	glBindVertexArray(0);
+
+	getDequantization(mesh, buffers.positionScale, buffers.positionOffset, buffers.uvScale, buffers.uvOffset);
+	buffers.octahedralNormals = mesh.format == VERTEX_QUANTIZED ? 1 : 0;
+	printf("Streaming %u chunks through %u GPU slots (%.1f MB)\n", mesh.chunkCount, buffers.slotCount,
+		slotCount * (buffers.slotVertexBytes + buffers.slotIndexBytes) / (1024.0 * 1024.0));
+}
 
-		if (strcmp(lineHeader, "v") == 0) {
-			glm::vec3 vertex;
-			fscanf(file, "%f %f %f\n", &vertex.x, &vertex.y, &vertex.z);
-			temp_vertices.push_back(vertex);
-		}
-		else if (strcmp(lineHeader, "vt") == 0) {
-			glm::vec2 uv;
-			fscanf(file, "%f %f\n", &uv.x, &uv.y);
-			uv.y = -uv.y; // Invert V coordinate since we will only use DDS texture, which are inverted. Remove if you want to use TGA or BMP loaders.
-			temp_uvs.push_back(uv);
-		}
-		else if (strcmp(lineHeader, "vn") == 0) {
-			glm::vec3 normal;
-			fscanf(file, "%f %f %f\n", &normal.x, &normal.y, &normal.z);
-			temp_normals.push_back(normal);
-		}
-		else if (strcmp(lineHeader, "f") == 0) {
-			std::string vertex1, vertex2, vertex3;
-			unsigned int vertexIndex[3], uvIndex[3], normalIndex[3];
-			int matches = fscanf(file, "%d/%d/%d %d/%d/%d %d/%d/%d\n", &vertexIndex[0], &uvIndex[0], &normalIndex[0], &vertexIndex[1], &uvIndex[1], &normalIndex[1], &vertexIndex[2], &uvIndex[2], &normalIndex[2]);
-			if (matches != 9) {
-				printf("File can't be read by our simple parser :-( Try exporting with other options\n");
-				fclose(file);
-				return false;
+// Draws the chunks whose spheres are in view, with the buffers' VAO bound. Up to maxUploads chunks
+// that are not resident yet are copied into slots and released from CPU memory; the rest wait.
+// Returns the triangles drawn.
+static unsigned int drawStreamedMesh(const StreamedMesh& mesh, StreamedBuffers& buffers, const glm::mat4& MVP, unsigned int maxUploads) {
+	unsigned int triangles = 0;
+	buffers.frame++;
+	glBindBuffer(GL_ARRAY_BUFFER, buffers.vertexbuffer);
+	// The planes are in model space, and the model matrix scales evenly, so the chunk spheres
+	// are tested as they are stored
+	glm::vec4 planes[6];
+	getFrustumPlanes(MVP, planes);
+	for (unsigned int chunk = 0; chunk < mesh.chunkCount; chunk++) {
+		const StreamChunk& record = mesh.chunks[chunk];
+		glm::vec3 centre(record.sphereCentre[0], record.sphereCentre[1], record.sphereCentre[2]);
+		if (!sphereInPlanes(planes, centre, record.sphereRadius))
+			continue;
+
+		int slot = buffers.chunkSlot[chunk];
+		if (slot == droppedChunk)
+			continue;
+		if (slot < 0) {
+			if (maxUploads == 0)
+				continue;
+			if (!chunkIndicesInRange(mesh, chunk)) {
+				printf("Chunk %u of the streamed mesh has indices past its vertices, dropped\n", chunk);
+				buffers.chunkSlot[chunk] = droppedChunk;
+				releaseChunk(mesh, chunk);
+				continue;
 			}
-			vertexIndices.push_back(vertexIndex[0]);
-			vertexIndices.push_back(vertexIndex[1]);
-			vertexIndices.push_back(vertexIndex[2]);
-			uvIndices.push_back(uvIndex[0]);
-			uvIndices.push_back(uvIndex[1]);
-			uvIndices.push_back(uvIndex[2]);
-			normalIndices.push_back(normalIndex[0]);
-			normalIndices.push_back(normalIndex[1]);
-			normalIndices.push_back(normalIndex[2]);
-		}
-		else {
-			// Probably a comment, eat up the rest of the line
-			char stupidBuffer[1000];
-			fgets(stupidBuffer, 1000, file);
+			// Never take the slot of a chunk already drawn this frame
+			unsigned int oldest = 0;
+			for (unsigned int i = 1; i < buffers.slotCount; i++) {
+				if (buffers.slotLastDrawn[i] < buffers.slotLastDrawn[oldest])
+					oldest = i;
+			}
+			if (buffers.slotLastDrawn[oldest] == buffers.frame)
+				continue;
+			if (buffers.slotChunk[oldest] >= 0)
+				buffers.chunkSlot[buffers.slotChunk[oldest]] = -1;
+			slot = (int)oldest;
+			buffers.slotChunk[slot] = (int)chunk;
+			buffers.chunkSlot[chunk] = slot;
+
+			glBufferSubData(GL_ARRAY_BUFFER, slot * buffers.slotVertexBytes, (size_t)record.vertexCount * mesh.vertexSize, getChunkVertices(mesh, chunk));
+			glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, slot * buffers.slotIndexBytes, (size_t)record.indexCount * sizeof(unsigned short), getChunkIndices(mesh, chunk));
+			releaseChunk(mesh, chunk);
+			maxUploads--;
 		}
 
+		// Every slot indexes its own vertices from 0, so the base vertex moves the indices over
+		buffers.slotLastDrawn[slot] = buffers.frame;
+		glDrawElementsBaseVertex(GL_TRIANGLES, record.indexCount, GL_UNSIGNED_SHORT, (void*)(slot * buffers.slotIndexBytes), slot * streamChunkVertices);
+		triangles += record.indexCount / 3;
 	}
+	return triangles;
+}
 
-	// For each vertex of each triangle
-	for (unsigned int i = 0; i < vertexIndices.size(); i++) {
+// Per-instance attributes of a body drawn instanced. Its model matrix, rotate(angle around y) *
+// translate * scale, comes down to a translation, the scale and scale * (cos, sin) of the angle.
+struct InstanceAttributes {
+	float offset[4]; // translation, scale
+	float rotation[2];
+};
+
+// The bodies drawn instanced with one mesh. Their attributes are streamed into the instance buffer
+// every frame, grouped by level of detail, and each level is one instanced draw.
+struct InstancedBuffers {
+	GLuint vertexArray; // the mesh's buffers and layout, plus the per-instance attributes
+	GLuint instancebuffer;
+	unsigned int capacity; // instances the buffer has room for
+	std::vector<unsigned int> visible; // bodies in view, this frame
+	unsigned int drawCalls; // last frame's
+};
+
+static void createInstancedBuffers(const MeshBuffers& mesh, InstancedBuffers& buffers) {
+	buffers.capacity = 0;
+	buffers.drawCalls = 0;
+
+	glGenVertexArrays(1, &buffers.vertexArray);
+	glBindVertexArray(buffers.vertexArray);
+	glBindBuffer(GL_ARRAY_BUFFER, mesh.vertexbuffer);
+	setVertexLayout(mesh.format, mesh.vertexSize, mesh.positionSize, mesh.uvSize);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.elementbuffer);
+
+	// Attributes 3 and 4 step once per instance; where they start is set before each draw
+	glGenBuffers(1, &buffers.instancebuffer);
+	glEnableVertexAttribArray(3);
+	glVertexAttribDivisor(3, 1);
+	glEnableVertexAttribArray(4);
+	glVertexAttribDivisor(4, 1);
+	glBindVertexArray(0);
+}
 
-		// Get the indices of its attributes
-		unsigned int vertexIndex = vertexIndices[i];
-		unsigned int uvIndex = uvIndices[i];
-		unsigned int normalIndex = normalIndices[i];
+// Draws the bodies flagged BODY_INSTANCED with this mesh and texture that are in view: one
+// glDrawElementsInstanced per level of detail. The program's MVP must be ViewProjection alone,
+// and its instanced flag set. Adds the triangles drawn to `triangles`; returns the instances.
+static unsigned int drawInstancedBodies(Scene& scene, unsigned int mesh, unsigned int texture, const MeshBuffers& meshBuffers, InstancedBuffers& buffers,
+	const glm::mat4& ProjectionMatrix, const glm::mat4& ViewProjection, unsigned int& triangles) {
+	glm::vec4 planes[6];
+	getFrustumPlanes(ViewProjection, planes);
+	buffers.drawCalls = 0;
+
+	// Cull in world space and pick the level of detail of each instance, counting them per level
+	unsigned int lodCount[maxMeshLODs] = { 0 };
+	buffers.visible.clear();
+	for (unsigned int i = 0; i < scene.count; i++) {
+		if ((scene.flags[i] & BODY_INSTANCED) == 0 || scene.mesh[i] != mesh || scene.texture[i] != texture)
+			continue;
+		glm::vec3 centre = glm::vec3(scene.modelMatrix[i] * glm::vec4(meshBuffers.centre, 1.0f));
+		if (!sphereInPlanes(planes, centre, meshBuffers.radius * scene.scale[i]))
+			continue;
+		scene.lod[i] = selectLOD(meshBuffers.lods, scene.lod[i], pixelsPerWorldUnit(ProjectionMatrix, centre) * scene.scale[i]);
+		lodCount[scene.lod[i]]++;
+		buffers.visible.push_back(i);
+	}
+	unsigned int count = (unsigned int)buffers.visible.size();
+	if (count == 0)
+		return 0;
 
-		// Get the attributes thanks to the index
-		glm::vec3 vertex = temp_vertices[vertexIndex - 1];
-		glm::vec2 uv = temp_uvs[uvIndex - 1];
-		glm::vec3 normal = temp_normals[normalIndex - 1];
+	unsigned int lodFirst[maxMeshLODs], lodNext[maxMeshLODs];
+	unsigned int first = 0;
+	for (unsigned int l = 0; l < maxMeshLODs; l++) {
+		lodFirst[l] = lodNext[l] = first;
+		first += lodCount[l];
+	}
+
+	// The buffer is rewritten whole every frame. Invalidating it lets the driver hand out new memory
+	// rather than wait for last frame's draws to be done with the old
+	glBindBuffer(GL_ARRAY_BUFFER, buffers.instancebuffer);
+	if (count > buffers.capacity) {
+		buffers.capacity = count + count / 2;
+		glBufferData(GL_ARRAY_BUFFER, (size_t)buffers.capacity * sizeof(InstanceAttributes), NULL, GL_STREAM_DRAW);
+	}
+	InstanceAttributes* attributes = (InstanceAttributes*)glMapBufferRange(GL_ARRAY_BUFFER, 0, (size_t)count * sizeof(InstanceAttributes), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	if (attributes == NULL)
+		return 0;
+	for (unsigned int v = 0; v < count; v++) {
+		unsigned int i = buffers.visible[v];
+		const glm::mat4& model = scene.modelMatrix[i];
+		InstanceAttributes& instance = attributes[lodNext[scene.lod[i]]++];
+		instance.offset[0] = model[3][0];
+		instance.offset[1] = model[3][1];
+		instance.offset[2] = model[3][2];
+		instance.offset[3] = model[1][1];
+		instance.rotation[0] = model[0][0];
+		instance.rotation[1] = model[2][0];
+	}
+	glUnmapBuffer(GL_ARRAY_BUFFER);
+
+	glBindVertexArray(buffers.vertexArray);
+	for (unsigned int l = 0; l < maxMeshLODs; l++) {
+		if (lodCount[l] == 0)
+			continue;
+		size_t offset = (size_t)lodFirst[l] * sizeof(InstanceAttributes);
+		glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceAttributes), (void*)(offset + offsetof(InstanceAttributes, offset)));
+		glVertexAttribPointer(4, 2, GL_FLOAT, GL_FALSE, sizeof(InstanceAttributes), (void*)(offset + offsetof(InstanceAttributes, rotation)));
+		glDrawElementsInstanced(GL_TRIANGLES, meshBuffers.lods.indexCount[l], meshBuffers.indexType,
+			(void*)((size_t)meshBuffers.lods.indexOffset[l] * meshBuffers.indexSize), lodCount[l]);
+		triangles += meshBuffers.lods.indexCount[l] / 3 * lodCount[l];
+		buffers.drawCalls++;
+	}
+	return count;
+}
 
-		// Put the attributes in buffers
-		out_vertices.push_back(vertex);
-		out_uvs.push_back(uv);
-		out_normals.push_back(normal);
+// Textures of the scene, in the order of their layers in the texture array. Each decodes on a job
+// of its own, the first textureCount asset jobs.
+static const char* const texturePaths[] = { "sun.jpg", "planet.jpg", "meteor.jpg" };
+const unsigned int textureCount = sizeof(texturePaths) / sizeof(texturePaths[0]);
+
+// An array has one size and one format for all its layers, so every texture is resized to this
+// at cook time. BC7 because the sun and planet are smooth gradients that BC1 bands.
+const int textureLayerSize = 1024;
+const TextureFormat textureLayerFormat = TEXTURE_BC7;
+
+// Surface maps too big for the texture array, streamed tile by tile through a virtual texture when
+// they are there. Binary PPM sources can be any size; they are tiled into a cache on the first run.
+static const char* const surfacePaths[] = { "sun_surface.ppm", "planet_surface.ppm" };
+const unsigned int surfaceCount = sizeof(surfacePaths) / sizeof(surfacePaths[0]);
+
+// Everything main() loads, one background job each
+enum AssetJob {
+	SUN_TEXTURE, PLANET_TEXTURE, METEOR_TEXTURE,
+	SUN_MESH = textureCount, PLANET_MESH, METEOR_MESH,
+	ASTEROID_MESH,
+	SUN_SURFACE, PLANET_SURFACE,
+	ASSET_JOB_COUNT
+};
+
+// Meshes the bodies of the scene are drawn with, in the order of their asset jobs
+enum BodyMesh {
+	SUN_SPHERE, PLANET_SPHERE, METEOR_ROCK,
+	BODY_MESH_COUNT
+};
+
+// A body of the given look at rest at the origin, unscaled and not orbiting
+static BodyDesc describeBody(unsigned int mesh, unsigned int texture, unsigned int flags) {
+	BodyDesc desc;
+	desc.position = glm::vec3(0.0f);
+	desc.velocity = glm::vec3(0.0f);
+	desc.orbitAngle = 0.0f;
+	desc.orbitSpeed = 0.0f;
+	desc.scale = 1.0f;
+	desc.mesh = mesh;
+	desc.texture = texture;
+	desc.flags = flags;
+	return desc;
+}
 
+// Adds `count` meteors in a ball around `origin`, as far apart as `spacing` on average, each
+// flying straight at the center at `speed`. They are projectiles, plus whatever `flags` add.
+static void launchMeteorSwarm(Scene& scene, const glm::vec3& origin, unsigned int count, float spacing, float speed, unsigned int flags, std::mt19937& random) {
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	float radius = count > 1 ? spacing * cbrtf((float)count) : 0.0f;
+	for (unsigned int m = 0; m < count; m++) {
+		glm::vec3 scatter;
+		do {
+			scatter = glm::vec3(unit(random), unit(random), unit(random));
+		} while (glm::dot(scatter, scatter) > 1.0f);
+
+		BodyDesc meteor = describeBody(METEOR_ROCK, METEOR_TEXTURE, BODY_PROJECTILE | flags);
+		meteor.position = origin + scatter * radius;
+		meteor.velocity = -meteor.position * (speed / glm::length(meteor.position));
+		meteor.scale = 0.5f + 0.5f * (unit(random) + 1.0f);
+		addBody(scene, meteor);
 	}
-	fclose(file);
-	return true;
 }
 
+// Frame times are kept by how many meteors the frame drew: none, 1 or more, 10 or more, ... 100000 or more
+const unsigned int swarmBuckets = 7;
+
+static unsigned int getSwarmBucket(unsigned int meteors) {
+	unsigned int bucket = 0;
+	for (; meteors > 0 && bucket < swarmBuckets - 1; meteors /= 10)
+		bucket++;
+	return bucket;
+}
 
+// Uniforms of the virtual texture feedback program
+struct FeedbackUniforms {
+	GLint MVP, positionScale, positionOffset, uvScale, uvOffset, octahedralNormals;
+	GLint virtualSize, virtualMaxLevel, virtualTextureIndex;
+};
+
+// Render queue keys. Textures are the layers of the texture array and after them the virtual
+// textures; meshes are the BodyMesh ones and after them these
+enum RenderPass { MAIN_PASS, FEEDBACK_PASS };
+enum RenderProgram { TEXTURED_PROGRAM, FEEDBACK_PROGRAM };
+enum RenderMesh { ASTEROID_CHUNKS = BODY_MESH_COUNT, METEOR_INSTANCES };
+
+// Render queue items besides the bodies of the scene, which are their index
+const unsigned int drawAsteroid = 0xffffffffu;
+const unsigned int drawMeteorSwarm = 0xfffffffeu;
 
 int main( void )
 {
+	std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+	// Start reading, decoding and parsing every asset right away. The window and the GL context
+	// are created meanwhile; the uploads happen further down, on this thread, as jobs finish.
+	Image images[textureCount];
+	double decodeMs[textureCount];
+	Mesh meshes[BODY_MESH_COUNT];
+	StreamedMesh asteroid;
+	bool haveAsteroid = false;
+	VirtualTexture surfaces[surfaceCount];
+	bool haveSurface[surfaceCount] = { false, false };
+	std::vector<std::function<void()> > assetJobs(ASSET_JOB_COUNT);
+	// stb_image keeps no state between calls (its error string is thread-local), so every
+	// texture decodes concurrently on whichever worker is free
+	for (unsigned int t = 0; t < textureCount; t++) {
+		assetJobs[t] = [&images, &decodeMs, t]() {
+			std::chrono::steady_clock::time_point decodeStart = std::chrono::steady_clock::now();
+			loadImage(texturePaths[t], images[t], textureLayerFormat, textureLayerSize, textureLayerSize);
+			decodeMs[t] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - decodeStart).count();
+		};
+	}
+	// *** Sun and planet are generated spheres sized like the collision tests below; the planet
+	// *** sits 25 units out on the x axis, where the orbit rotation expects it
+	assetJobs[SUN_MESH] = [&]() { generateSphereMesh("sun sphere", glm::vec3(0.0f), 15.0f, 128, meshes[SUN_SPHERE], VERTEX_QUANTIZED); };
+	assetJobs[PLANET_MESH] = [&]() { generateSphereMesh("planet sphere", glm::vec3(25.0f, 0.0f, 0.0f), 5.0f, 64, meshes[PLANET_SPHERE], VERTEX_QUANTIZED); };
+	// *** A meteor.glb, when there is one, goes straight from the file to the GPU; otherwise the OBJ through its cache
+	assetJobs[METEOR_MESH] = [&]() {
+		unsigned long long size;
+		long long time;
+		if (!statFile("meteor.glb", size, time) || !loadGLB("meteor.glb", meshes[METEOR_ROCK]))
+			loadMesh("meteor.obj", meshes[METEOR_ROCK], VERTEX_QUANTIZED);
+	};
+	// *** Scanned asteroids can be bigger than memory, so they are streamed chunk by chunk instead.
+	// *** The asteroid is optional: the scene goes on without it when there is neither an OBJ nor a cache
+	assetJobs[ASTEROID_MESH] = [&]() {
+		unsigned long long size;
+		long long time;
+		if (statFile("asteroid.obj", size, time) || statFile("asteroid.obj.streamcache", size, time))
+			haveAsteroid = openStreamedMesh("asteroid.obj", asteroid, VERTEX_QUANTIZED, streamCookBudget);
+	};
+	// *** Same for the surface maps: without one, its body keeps its layer of the texture array.
+	// *** BC1 since a 32K map is a billion texels to encode, and BC7 takes several times longer
+	for (unsigned int v = 0; v < surfaceCount; v++) {
+		assetJobs[SUN_SURFACE + v] = [&surfaces, &haveSurface, v]() {
+			unsigned long long size;
+			long long time;
+			std::string cachePath = std::string(surfacePaths[v]) + ".vtcache";
+			if (statFile(surfacePaths[v], size, time) || statFile(cachePath.c_str(), size, time))
+				haveSurface[v] = openVirtualTexture(surfacePaths[v], surfaces[v], TEXTURE_BC1);
+		};
+	}
+	JobQueue assetQueue;
+	startJobs(assetQueue, assetJobs);
+
 	// Initialise GLFW
 	if( !glfwInit() )
 	{
 		fprintf( stderr, "Failed to initialize GLFW\n" );
+		finishJobs(assetQueue);
 		getchar();
 		return -1;
 	}
@@ -260,6 +674,7 @@ int main( void )
 	window = glfwCreateWindow( 800, 800, "Hliako Systhma", NULL, NULL);
 	if( window == NULL ){
 		fprintf( stderr, "Failed to open GLFW window. If you have an Intel GPU, they are not 3.3 compatible. Try the 2.1 version of the tutorials.\n" );
+		finishJobs(assetQueue);
 		getchar();
 		glfwTerminate();
 		return -1;
@@ -271,6 +686,7 @@ int main( void )
 	glewExperimental = true; // Needed for core profile
 	if (glewInit() != GLEW_OK) {
 		fprintf(stderr, "Failed to initialize GLEW\n");
+		finishJobs(assetQueue);
 		getchar();
 		glfwTerminate();
 		return -1;
@@ -298,264 +714,366 @@ int main( void )
 	// Cull triangles which normal is not towards the camera
 	glEnable(GL_CULL_FACE);
 
-	GLuint VertexArrayID;
-	glGenVertexArrays(1, &VertexArrayID);
-	glBindVertexArray(VertexArrayID);
-
 	// Create and compile our GLSL program from the shaders
 	GLuint programID = LoadShaders( "TransformVertexShader.vertexshader", "TextureFragmentShader.fragmentshader" );
 
 	// Get a handle for our "MVP" uniform
 	GLuint MatrixID = glGetUniformLocation(programID, "MVP");
 
-	// sun: Load the 1st texture
-	
-	int width, height, nrChannels;
-	unsigned char* data = stbi_load("sun.jpg", &width, &height, &nrChannels, 0);
-
-	// *** planet: Load the 2nd texture
-
-	int width2, height2, nrChannels2;
-	unsigned char* data2 = stbi_load("planet.jpg", &width2, &height2, &nrChannels2, 0);
-	
-	// *** meteor: Load the 2nd texture
-
-	int width3, height3, nrChannels3;
-	unsigned char* data3 = stbi_load("meteor.jpg", &width3, &height3, &nrChannels3, 0);
-
-	if (data && data2 && data3)
-	{
-	
-	}
-	else
-	{
-		std::cout << "Failed to load texture" << std::endl;
-	}
-
-	// Sun
-	GLuint textureID;
-	glGenTextures(1, &textureID);
-
-	// "Bind" the newly created texture : all future texture functions will modify this texture
-	glBindTexture(GL_TEXTURE_2D, textureID);
-
-	// Give the image to OpenGL
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-	glGenerateMipmap(GL_TEXTURE_2D);
-
-	// *** Planet
-
-	GLuint textureID2;
-	glGenTextures(1, &textureID2);
-
-	// "Bind" the newly created texture : all future texture functions will modify this texture
-	glBindTexture(GL_TEXTURE_2D, textureID2);
-
-	// Give the image to OpenGL
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width2, height2, 0, GL_RGB, GL_UNSIGNED_BYTE, data2);
-	glGenerateMipmap(GL_TEXTURE_2D);
-
-	// *** Meteor
-
-	GLuint textureID3;
-	glGenTextures(1, &textureID3);
-
-	// "Bind" the newly created texture : all future texture functions will modify this texture
-	glBindTexture(GL_TEXTURE_2D, textureID3);
-
-	// Give the image to OpenGL
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width3, height3, 0, GL_RGB, GL_UNSIGNED_BYTE, data3);
-	glGenerateMipmap(GL_TEXTURE_2D);
-
-
+	// Get handles for the uniforms that dequantize compressed vertex formats
+	GLuint PositionScaleID = glGetUniformLocation(programID, "positionScale");
+	GLuint PositionOffsetID = glGetUniformLocation(programID, "positionOffset");
+	GLuint UVScaleID = glGetUniformLocation(programID, "uvScale");
+	GLuint UVOffsetID = glGetUniformLocation(programID, "uvOffset");
+	GLuint OctahedralNormalsID = glGetUniformLocation(programID, "octahedralNormals");
 
 	// Get a handle for our "myTextureSampler" uniform
 	GLuint TextureID  = glGetUniformLocation(programID, "myTextureSampler");
+	GLuint TextureLayerID = glGetUniformLocation(programID, "textureLayer");
+
+	// Every object samples its texture from Texture Unit 0, so set that up once
+	glUseProgram(programID);
+	glActiveTexture(GL_TEXTURE0);
+	glUniform1i(TextureID, 0);
+
+	// Virtual textures: the indirection in Texture Unit 1, the tiles in Texture Unit 2
+	GLuint VirtualTexturedID = glGetUniformLocation(programID, "virtualTextured");
+	GLuint VirtualSizeID = glGetUniformLocation(programID, "virtualSize");
+	GLuint VirtualMaxLevelID = glGetUniformLocation(programID, "virtualMaxLevel");
+	GLuint PhysicalSlotsID = glGetUniformLocation(programID, "physicalSlots");
+	glUniform1i(glGetUniformLocation(programID, "indirectionSampler"), 1);
+	glUniform1i(glGetUniformLocation(programID, "physicalSampler"), 2);
+	glUniform1i(VirtualTexturedID, 0);
+
+	// Instanced draws take each instance's placement from attributes 3 and 4 instead of the MVP
+	GLuint InstancedID = glGetUniformLocation(programID, "instanced");
+	glUniform1i(InstancedID, 0);
+
+	// The feedback pass draws the virtual textured bodies with the same vertex shader
+	GLuint feedbackProgramID = LoadShaders("TransformVertexShader.vertexshader", "VirtualFeedback.fragmentshader");
+	FeedbackUniforms feedbackUniforms;
+	feedbackUniforms.MVP = glGetUniformLocation(feedbackProgramID, "MVP");
+	feedbackUniforms.positionScale = glGetUniformLocation(feedbackProgramID, "positionScale");
+	feedbackUniforms.positionOffset = glGetUniformLocation(feedbackProgramID, "positionOffset");
+	feedbackUniforms.uvScale = glGetUniformLocation(feedbackProgramID, "uvScale");
+	feedbackUniforms.uvOffset = glGetUniformLocation(feedbackProgramID, "uvOffset");
+	feedbackUniforms.octahedralNormals = glGetUniformLocation(feedbackProgramID, "octahedralNormals");
+	feedbackUniforms.virtualSize = glGetUniformLocation(feedbackProgramID, "virtualSize");
+	feedbackUniforms.virtualMaxLevel = glGetUniformLocation(feedbackProgramID, "virtualMaxLevel");
+	feedbackUniforms.virtualTextureIndex = glGetUniformLocation(feedbackProgramID, "virtualTextureIndex");
+	glUseProgram(feedbackProgramID);
+	glUniform1f(glGetUniformLocation(feedbackProgramID, "levelBias"), log2f((float)virtualFeedbackDivisor));
+	VirtualFeedback feedback;
+	bool haveFeedback = createVirtualFeedback(feedback, 800 / virtualFeedbackDivisor, 800 / virtualFeedbackDivisor);
+	glUseProgram(programID);
+
+	// Texture levels are staged and uploaded a budget per frame from the render loop
+	TextureUploadQueue textureUploads;
+	createTextureUploadQueue(textureUploads, textureStagingBytes);
+
+	// Owns the textures from here on and keeps count of what they take
+	TextureManager textureManager;
+	createTextureManager(textureManager, textureGPUBudget, textureUploads);
+
+	double contextMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+
+	// Upload each asset as soon as its job is done, whichever order they finish in
+	GLuint textureArrayID = 0;
+	unsigned int texturesLeft = textureCount;
+	bool texturesQueued = false;
+	MeshBuffers meshBuffers[BODY_MESH_COUNT];
+	StreamedBuffers asteroidBuffers;
+	glm::mat4 asteroidModelMatrix = glm::mat4(1.0f);
+	unsigned int finishedJob;
+	while (waitForJob(assetQueue, finishedJob)) {
+		// The texture array is queued once its last layer is in. The manager keeps the decoded
+		// layers, only mapped cache files, until the render loop has uploaded every level
+		if (finishedJob < textureCount) {
+			if (--texturesLeft == 0) {
+				textureArrayID = getManagedTexture(textureManager, addTextureArray(textureManager, "texture array", images, textureCount));
+				texturesQueued = true;
+			}
+			continue;
+		}
+		switch (finishedJob) {
+		case SUN_MESH:
+		case PLANET_MESH:
+		case METEOR_MESH:
+			uploadMesh(meshes[finishedJob - SUN_MESH], meshBuffers[finishedJob - SUN_MESH]);
+			break;
+		case ASTEROID_MESH:
+			if (haveAsteroid) {
+				createStreamedBuffers(asteroid, streamGPUBudget, asteroidBuffers);
+				// *** Whatever its scanned size, the asteroid sits 40 units out on the -x axis with a radius of 6
+				asteroidModelMatrix = glm::translate(glm::mat4(1.0f), glm::vec3(-40.0f, 0.0f, 0.0f));
+				asteroidModelMatrix = glm::scale(asteroidModelMatrix, glm::vec3(6.0f / asteroid.sphereRadius));
+				asteroidModelMatrix = glm::translate(asteroidModelMatrix, -asteroid.sphereCentre);
+			}
+			break;
+		case SUN_SURFACE:
+		case PLANET_SURFACE:
+			if (haveSurface[finishedJob - SUN_SURFACE])
+				haveSurface[finishedJob - SUN_SURFACE] = createVirtualTextureCache(surfaces[finishedJob - SUN_SURFACE], virtualTextureGPUBudget);
+			if (haveSurface[finishedJob - SUN_SURFACE]) {
+				const VirtualTexture& surface = surfaces[finishedJob - SUN_SURFACE];
+				addExternalTexture(textureManager, surfacePaths[finishedJob - SUN_SURFACE], surface.physicalTexture, GL_TEXTURE_2D, getVirtualTextureBytes(surface));
+			}
+			break;
+		}
+	}
 
-	// sun: Read our 1st .obj file
-	std::vector<glm::vec3> vertices;
-	std::vector<glm::vec3> normals;
-	std::vector<glm::vec2> uvs;
-	bool res = loadOBJ("sun.obj", vertices, uvs, normals);
-
-	// *** planet: Read our 2nd .obj file
-	std::vector<glm::vec3> vertices2;
-	std::vector<glm::vec3> normals2;
-	std::vector<glm::vec2> uvs2;
-	bool res2 = loadOBJ("planet.obj", vertices2, uvs2, normals2);
-
-	// *** meteor: Read our 3rd .obj file
-	std::vector<glm::vec3> vertices3;
-	std::vector<glm::vec3> normals3;
-	std::vector<glm::vec2> uvs3;
-	bool res3 = loadOBJ("meteor.obj", vertices3, uvs3, normals3);
-	
-
-	// sun: Load it into a VBO
-
-	GLuint vertexbuffer;
-	glGenBuffers(1, &vertexbuffer);
-	glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(glm::vec3), &vertices[0], GL_STATIC_DRAW);
-
-	GLuint uvbuffer;
-	glGenBuffers(1, &uvbuffer);
-	glBindBuffer(GL_ARRAY_BUFFER, uvbuffer);
-	glBufferData(GL_ARRAY_BUFFER, uvs.size() * sizeof(glm::vec2), &uvs[0], GL_STATIC_DRAW);
-
-	// *** planet: Load it into a VBO
-
-	GLuint vertexbuffer2;
-	glGenBuffers(1, &vertexbuffer2);
-	glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer2);
-	glBufferData(GL_ARRAY_BUFFER, vertices2.size() * sizeof(glm::vec3), &vertices2[0], GL_STATIC_DRAW);
-
-	GLuint uvbuffer2;
-	glGenBuffers(1, &uvbuffer2);
-	glBindBuffer(GL_ARRAY_BUFFER, uvbuffer2);
-	glBufferData(GL_ARRAY_BUFFER, uvs2.size() * sizeof(glm::vec2), &uvs2[0], GL_STATIC_DRAW);
-
-	// *** meteor: Load it into a VBO
-
-	GLuint vertexbuffer3;
-	glGenBuffers(1, &vertexbuffer3);
-	glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer3);
-	glBufferData(GL_ARRAY_BUFFER, vertices3.size() * sizeof(glm::vec3), &vertices3[0], GL_STATIC_DRAW);
-
-	GLuint uvbuffer3;
-	glGenBuffers(1, &uvbuffer3);
-	glBindBuffer(GL_ARRAY_BUFFER, uvbuffer3);
-	glBufferData(GL_ARRAY_BUFFER, uvs3.size() * sizeof(glm::vec2), &uvs3[0], GL_STATIC_DRAW);
+	double assetsMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+	printf("GL context ready after %.1f ms, assets uploaded after %.1f ms\n", contextMs, assetsMs);
+
+	// Decoding time summed over the workers, reported with the wall time it took to have every texture in GL
+	double decodeTotalMs = 0.0;
+	for (unsigned int t = 0; t < textureCount; t++)
+		decodeTotalMs += decodeMs[t];
+
+	// *** The bodies of the scene. The sun and planet spheres are generated where they sit, so neither
+	// *** needs a position; the planet orbits the origin. A body with a surface map samples that
+	// *** instead of its layer of the texture array
+	Scene scene;
+	createScene(scene);
+	addBody(scene, describeBody(SUN_SPHERE, haveSurface[0] ? 0 : SUN_TEXTURE, BODY_SOLID | (haveSurface[0] ? BODY_VIRTUAL_TEXTURED : 0)));
+	BodyDesc planet = describeBody(PLANET_SPHERE, haveSurface[1] ? 1 : PLANET_TEXTURE, BODY_SOLID | BODY_DESTRUCTIBLE | (haveSurface[1] ? BODY_VIRTUAL_TEXTURED : 0));
+	planet.orbitSpeed = 1.0f;
+	addBody(scene, planet);
+
+	// *** Meteors come in swarms, all of them drawn with one instanced draw per level of detail
+	InstancedBuffers meteorInstances;
+	createInstancedBuffers(meshBuffers[METEOR_ROCK], meteorInstances);
+	std::mt19937 meteorRandom(1);
+
+	// *** Frame times by how many meteors were drawn
+	unsigned int swarmFrames[swarmBuckets] = { 0 };
+	double swarmFrameMs[swarmBuckets] = { 0.0 };
+	double swarmCPUMs[swarmBuckets] = { 0.0 };
+
+	// *** Every draw of a frame goes through the render queue, which sorts them by state
+	RenderQueue renderQueue;
+	createRenderQueue(renderQueue);
 
 	// *** Used for planet rotation
 
-	float rotation = 0.0f;
 	double change = 1.0f;
 	double prevTime = glfwGetTime();
 	double crntTime;
-	float s, cameraX, cameraY, cameraZ;
-	float vx, vy, vz;
-	float planetX, planetY, planetZ;
-	bool spaceFlag = false;
-	bool meteorCrashFlag = false;
-	bool planetCrashFlag = false;
 	float meteorspeed = 10.0f;
+	unsigned int meteorSwarmSize = 1;
+	bool spaceWasPressed = false;
+	unsigned int meteorsDrawn = 0;
+	unsigned int trianglesDrawn;
+	double lastReportTime = 0.0;
+	unsigned int bodiesDrawn;
+	bool firstFrame = true;
 
 	do{
 
 		// Clear the screen
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-		// Use our shader
-		glUseProgram(programID);
+		trianglesDrawn = 0;
+
+		// The next band of texture levels, before the texture array is bound for the frame. Once a
+		// texture's last level is in, the manager lets go of its decoded layers
+		processTextureUploads(textureUploads, textureUploadBytesPerFrame);
+		updateTextureManager(textureManager);
+		if (texturesQueued && textureUploadsIdle(textureUploads)) {
+			texturesQueued = false;
+			double texturesMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+			printf("Decoded %u textures in %.1f ms of work on %u workers, all uploaded after %.1f ms\n", textureCount, decodeTotalMs, getWorkerCount(), texturesMs);
+			printTextureFootprint(textureManager);
+		}
+
+		// Every body samples the same texture array in Texture Unit 0; draws only pick their layer
+		glBindTexture(GL_TEXTURE_2D_ARRAY, textureArrayID);
 
 		// *** Used for planet rotation
 		crntTime = glfwGetTime();
+		float frameSeconds = (float)(crntTime - prevTime);
+
+		// *** The time since the last frame goes to the number of meteors that frame drew
+		if (!firstFrame) {
+			unsigned int bucket = getSwarmBucket(meteorsDrawn);
+			swarmFrames[bucket]++;
+			swarmFrameMs[bucket] += frameSeconds * 1000.0;
+		}
+		float orbitStep = 0.0f;
 		if (crntTime - prevTime >= 1 / 60) {
-			rotation += 0.5f*change;
+			orbitStep = 0.5f*change;
 			prevTime = crntTime;
 		}
 
+		// *** Move and turn every body, then draw them from their model matrices
+		updateScene(scene, orbitStep, frameSeconds);
+
 		// Compute the MVP matrix from keyboard and mouse input
 		computeMatricesFromInputs();
 		glm::mat4 ProjectionMatrix = getProjectionMatrix();
 		glm::mat4 ViewMatrix = getViewMatrix();
-		glm::mat4 ModelMatrix = glm::mat4(1.0);
-		
-		glm::mat4 MVP = ProjectionMatrix * ViewMatrix * ModelMatrix;
-		
-		// Send our transformation to the currently bound shader, 
-		// in the "MVP" uniform
-		
-		glUniformMatrix4fv(MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-		// *** Sun
-
-		// Bind our texture in Texture Unit 0
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		// Set our "myTextureSampler" sampler to use Texture Unit 0
-		glUniform1i(TextureID, 0);
-
-		// 1rst attribute buffer : vertices
-		glEnableVertexAttribArray(0);
-		glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer);
-		glVertexAttribPointer(
-			0,                  // attribute
-			3,                  // size
-			GL_FLOAT,           // type
-			GL_FALSE,           // normalized?
-			0,                  // stride
-			(void*)0            // array buffer offset
-		);
-
-		// 2nd attribute buffer : UVs
-		glEnableVertexAttribArray(1);
-		glBindBuffer(GL_ARRAY_BUFFER, uvbuffer);
-		glVertexAttribPointer(
-			1,                                // attribute
-			2,                                // size
-			GL_FLOAT,                         // type
-			GL_FALSE,                         // normalized?
-			0,                                // stride
-			(void*)0                          // array buffer offset
-		);
-		
-		// Draw the triangle !
-		glDrawArrays(GL_TRIANGLES, 0, vertices.size());
-
-
-		// *** Planet
-		if (!planetCrashFlag) {
-			// *** Bind our texture in Texture Unit 0
-			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_2D, textureID2);
-			// *** Set our "myTextureSampler" sampler to use Texture Unit 0
-			glUniform1i(TextureID, 0);
-
-
-			// *** 1rst attribute buffer : vertices
-			glEnableVertexAttribArray(0);
-			glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer2);
-			glVertexAttribPointer(
-				0,                  // attribute
-				3,                  // size
-				GL_FLOAT,           // type
-				GL_FALSE,           // normalized?
-				0,                  // stride
-				(void*)0            // array buffer offset
-			);
-
-			// *** 2nd attribute buffer : UVs
-			glEnableVertexAttribArray(1);
-			glBindBuffer(GL_ARRAY_BUFFER, uvbuffer2);
-			glVertexAttribPointer(
-				1,                                // attribute
-				2,                                // size
-				GL_FLOAT,                         // type
-				GL_FALSE,                         // normalized?
-				0,                                // stride
-				(void*)0                          // array buffer offset
-			);
-
-			// *** Rotate the Model Matrix for the planet object
-			// *** Since the model itself is offset in the x axis, rotating around (0,1,0) will make it orbit around the origin
-			ModelMatrix = glm::rotate(ModelMatrix, glm::radians(rotation), glm::vec3(0.0f, 1.0f, 0.0f));
-
-			//printf("x: %f  y: %f  z: %f\n", 25*ModelMatrix[0][0], 25*ModelMatrix[0][1], 25*ModelMatrix[0][2]);
-			// *** Because radius of rotation around the sun is 25
-			planetX = 25 * ModelMatrix[0][0];
-			planetY = 25 * ModelMatrix[0][1];
-			planetZ = 25 * ModelMatrix[0][2];
-
-			MVP = ProjectionMatrix * ViewMatrix * ModelMatrix;
-
-			// Send our transformation to the currently bound shader, 
-			// in the "MVP" uniform
-			glUniformMatrix4fv(MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-			// *** Draw the triangle !
-			glDrawArrays(GL_TRIANGLES, 0, vertices2.size());
+		glm::mat4 MVP;
+
+		// *** Submit this frame's draws. A body in view goes in with the level of detail that fits its
+		// *** size on screen, and a second time for the feedback pass when it has a surface map
+		glm::mat4 ViewProjection = ProjectionMatrix * ViewMatrix;
+		glm::vec4 planes[6];
+		getFrustumPlanes(ViewProjection, planes);
+		glm::vec3 cameraPosition = getPos();
+		beginRenderQueue(renderQueue);
+		bodiesDrawn = 0;
+		for (unsigned int i = 0; i < scene.count; i++) {
+			if (scene.flags[i] & BODY_INSTANCED)
+				continue;
+			const MeshBuffers& body = meshBuffers[scene.mesh[i]];
+
+			// Skip the body when its bounding sphere is outside the view
+			glm::vec3 centre = glm::vec3(scene.modelMatrix[i] * glm::vec4(body.centre, 1.0f));
+			if (!sphereInPlanes(planes, centre, body.radius * scene.scale[i]))
+				continue;
+			scene.lod[i] = selectLOD(body.lods, scene.lod[i], pixelsPerWorldUnit(ProjectionMatrix, centre) * scene.scale[i]);
+			bodiesDrawn++;
+
+			float depth = glm::length(centre - cameraPosition);
+			if (scene.flags[i] & BODY_VIRTUAL_TEXTURED) {
+				submitRenderCommand(renderQueue, makeRenderKey(MAIN_PASS, TEXTURED_PROGRAM, textureCount + scene.texture[i], scene.mesh[i], depth), i);
+				if (haveFeedback)
+					submitRenderCommand(renderQueue, makeRenderKey(FEEDBACK_PASS, FEEDBACK_PROGRAM, textureCount + scene.texture[i], scene.mesh[i], depth), i);
+			}
+			else
+				submitRenderCommand(renderQueue, makeRenderKey(MAIN_PASS, TEXTURED_PROGRAM, scene.texture[i], scene.mesh[i], depth), i);
+		}
+		// *** The streamed asteroid and the meteor swarm cull themselves
+		if (haveAsteroid)
+			submitRenderCommand(renderQueue, makeRenderKey(MAIN_PASS, TEXTURED_PROGRAM, METEOR_TEXTURE, ASTEROID_CHUNKS, 0.0f), drawAsteroid);
+		submitRenderCommand(renderQueue, makeRenderKey(MAIN_PASS, TEXTURED_PROGRAM, METEOR_TEXTURE, METEOR_INSTANCES, 0.0f), drawMeteorSwarm);
+
+		// *** Run them in key order, binding only what differs from the draw before
+		bool feedbackBegun = false;
+		meteorsDrawn = 0;
+		double swarmMs = 0.0;
+		executeRenderQueue(renderQueue, [&](const RenderCommand& command, unsigned int changes) {
+			unsigned int texture = getRenderKeyTexture(command.key);
+			unsigned int mesh = getRenderKeyMesh(command.key);
+
+			if (getRenderKeyPass(command.key) == FEEDBACK_PASS) {
+				// *** Virtual texture feedback: the bodies with surface maps once more, into a small framebuffer
+				// *** that records the tile every pixel needs
+				if (changes & RENDER_CHANGE_PASS) {
+					beginVirtualFeedback(feedback);
+					feedbackBegun = true;
+				}
+				if (changes & RENDER_CHANGE_PROGRAM)
+					glUseProgram(feedbackProgramID);
+				if (changes & RENDER_CHANGE_TEXTURE) {
+					const VirtualTexture& surface = surfaces[texture - textureCount];
+					glUniform2f(feedbackUniforms.virtualSize, (float)surface.width, (float)surface.height);
+					glUniform1i(feedbackUniforms.virtualMaxLevel, (GLint)surface.levelCount - 1);
+					glUniform1i(feedbackUniforms.virtualTextureIndex, (GLint)(texture - textureCount));
+				}
+				const MeshBuffers& body = meshBuffers[mesh];
+				if (changes & RENDER_CHANGE_MESH) {
+					glUniform3fv(feedbackUniforms.positionScale, 1, &body.positionScale[0]);
+					glUniform3fv(feedbackUniforms.positionOffset, 1, &body.positionOffset[0]);
+					glUniform2fv(feedbackUniforms.uvScale, 1, &body.uvScale[0]);
+					glUniform2fv(feedbackUniforms.uvOffset, 1, &body.uvOffset[0]);
+					glUniform1i(feedbackUniforms.octahedralNormals, body.octahedralNormals);
+					glBindVertexArray(body.vertexArray);
+				}
+				// At the level of detail the frame drew it at
+				MVP = ViewProjection * scene.modelMatrix[command.item];
+				glUniformMatrix4fv(feedbackUniforms.MVP, 1, GL_FALSE, &MVP[0][0]);
+				unsigned int lod = scene.lod[command.item];
+				glDrawElements(GL_TRIANGLES, body.lods.indexCount[lod], body.indexType, (void*)((size_t)body.lods.indexOffset[lod] * body.indexSize));
+				return;
+			}
+
+			if (changes & RENDER_CHANGE_PROGRAM)
+				glUseProgram(programID);
+
+			// Sample a layer of the texture array, or a surface map
+			if (changes & RENDER_CHANGE_TEXTURE) {
+				bool virtualTextured = texture >= textureCount;
+				glUniform1i(VirtualTexturedID, virtualTextured ? 1 : 0);
+				if (virtualTextured) {
+					const VirtualTexture& surface = surfaces[texture - textureCount];
+					glUniform2f(VirtualSizeID, (float)surface.width, (float)surface.height);
+					glUniform1i(VirtualMaxLevelID, (GLint)surface.levelCount - 1);
+					glUniform1f(PhysicalSlotsID, (float)surface.slotsPerSide);
+					glActiveTexture(GL_TEXTURE1);
+					glBindTexture(GL_TEXTURE_2D, surface.indirectionTexture);
+					glActiveTexture(GL_TEXTURE2);
+					glBindTexture(GL_TEXTURE_2D, surface.physicalTexture);
+					glActiveTexture(GL_TEXTURE0);
+				}
+				else
+					glUniform1i(TextureLayerID, (GLint)texture);
+			}
+
+			// Undo the vertex quantization, and bind the vertex buffer, attribute layout and index
+			// buffer in one go. The instanced meteors have a vertex array of their own, bound by the draw
+			if (changes & RENDER_CHANGE_MESH) {
+				if (mesh == ASTEROID_CHUNKS) {
+					glUniform3fv(PositionScaleID, 1, &asteroidBuffers.positionScale[0]);
+					glUniform3fv(PositionOffsetID, 1, &asteroidBuffers.positionOffset[0]);
+					glUniform2fv(UVScaleID, 1, &asteroidBuffers.uvScale[0]);
+					glUniform2fv(UVOffsetID, 1, &asteroidBuffers.uvOffset[0]);
+					glUniform1i(OctahedralNormalsID, asteroidBuffers.octahedralNormals);
+					glBindVertexArray(asteroidBuffers.vertexArray);
+				}
+				else {
+					const MeshBuffers& body = meshBuffers[mesh == METEOR_INSTANCES ? (unsigned int)METEOR_ROCK : mesh];
+					glUniform3fv(PositionScaleID, 1, &body.positionScale[0]);
+					glUniform3fv(PositionOffsetID, 1, &body.positionOffset[0]);
+					glUniform2fv(UVScaleID, 1, &body.uvScale[0]);
+					glUniform2fv(UVOffsetID, 1, &body.uvOffset[0]);
+					glUniform1i(OctahedralNormalsID, body.octahedralNormals);
+					if (mesh != METEOR_INSTANCES)
+						glBindVertexArray(body.vertexArray);
+				}
+			}
+
+			if (command.item == drawAsteroid) {
+				// *** Streamed asteroid: only the chunks in view are drawn, and the missing ones come in a few per frame
+				MVP = ViewProjection * asteroidModelMatrix;
+				glUniformMatrix4fv(MatrixID, 1, GL_FALSE, &MVP[0][0]);
+				trianglesDrawn += drawStreamedMesh(asteroid, asteroidBuffers, MVP, streamUploadsPerFrame);
+			}
+			else if (command.item == drawMeteorSwarm) {
+				// *** The meteor swarm, its instances culled, sorted by level of detail and streamed out on the CPU
+				std::chrono::steady_clock::time_point swarmStart = std::chrono::steady_clock::now();
+				glUniformMatrix4fv(MatrixID, 1, GL_FALSE, &ViewProjection[0][0]);
+				glUniform1i(InstancedID, 1);
+				meteorsDrawn = drawInstancedBodies(scene, METEOR_ROCK, METEOR_TEXTURE, meshBuffers[METEOR_ROCK], meteorInstances, ProjectionMatrix, ViewProjection, trianglesDrawn);
+				glUniform1i(InstancedID, 0);
+				swarmMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - swarmStart).count();
+			}
+			else {
+				// Draw the triangles of the level of detail the body was submitted at
+				const MeshBuffers& body = meshBuffers[mesh];
+				MVP = ViewProjection * scene.modelMatrix[command.item];
+				glUniformMatrix4fv(MatrixID, 1, GL_FALSE, &MVP[0][0]);
+				unsigned int lod = scene.lod[command.item];
+				glDrawElements(GL_TRIANGLES, body.lods.indexCount[lod], body.indexType, (void*)((size_t)body.lods.indexOffset[lod] * body.indexSize));
+				trianglesDrawn += body.lods.indexCount[lod] / 3;
+			}
+		});
+		if (meteorsDrawn > 0)
+			swarmCPUMs[getSwarmBucket(meteorsDrawn)] += swarmMs;
+
+		// *** The feedback is read a frame late, and the tiles asked for come in a few per frame, coarsest
+		// *** first, the ones not asked for longest making room
+		if (haveFeedback && (haveSurface[0] || haveSurface[1])) {
+			if (!feedbackBegun)
+				beginVirtualFeedback(feedback);
+			VirtualTexture* feedbackTextures[surfaceCount];
+			for (unsigned int v = 0; v < surfaceCount; v++)
+				feedbackTextures[v] = haveSurface[v] ? &surfaces[v] : NULL;
+			endVirtualFeedback(feedback, feedbackTextures, surfaceCount);
+			for (unsigned int v = 0; v < surfaceCount; v++) {
+				if (haveSurface[v])
+					updateVirtualTexture(surfaces[v], virtualUploadsPerFrame);
+			}
 		}
 
 		if (glfwGetKey(window, GLFW_KEY_U) == GLFW_PRESS) {
@@ -565,108 +1083,127 @@ int main( void )
 			change += 0.01;
 		}
 
-		if (!spaceFlag) {
-			// *** Check if space is pressed
-			if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS && !meteorCrashFlag) {
-				spaceFlag = true;
-				// *** Capture camera's coordinates when space was pressed
-				cameraX = getPos().x;
-				cameraY = getPos().y;
-				cameraZ = getPos().z;
-				s = (meteorspeed / sqrt(pow(cameraX, 2) + pow(cameraY, 2) + pow(cameraZ, 2)));
-				vx = -s * cameraX;
-				vy = -s * cameraY;
-				vz = -s * cameraZ;
-				printf("Space pressed! flags: spaceFlag=%d, planetCrashFlag=%d, meteorCrashFlag=%d\n",spaceFlag,planetCrashFlag,meteorCrashFlag);
-			}
-		}else{
-			// *** Meteor
-			// *** Vector that moves towards the center 
-			
-			glm::vec3 center = glm::vec3((cameraX + getDeltaTime() * vx), (cameraY + getDeltaTime() * vy), (cameraZ + getDeltaTime() * vz));
-
-			ModelMatrix = glm::translate(glm::mat4(1.0f), center);
-			
-			MVP = ProjectionMatrix * ViewMatrix * ModelMatrix;
-			
-			// Send our transformation to the currently bound shader, 
-			// in the "MVP" uniform
-			glUniformMatrix4fv(MatrixID, 1, GL_FALSE, &MVP[0][0]);
-
-			// Use our shader
-			glUseProgram(programID);
-			// *** Bind our texture in Texture Unit 0
-			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_2D, textureID3);
-			// *** Set our "myTextureSampler" sampler to use Texture Unit 0
-			glUniform1i(TextureID, 0);
-
-			// *** 1rst attribute buffer : vertices
-			glEnableVertexAttribArray(0);
-			glBindBuffer(GL_ARRAY_BUFFER, vertexbuffer3);
-			glVertexAttribPointer(
-				0,                  // attribute
-				3,                  // size
-				GL_FLOAT,           // type
-				GL_FALSE,           // normalized?
-				0,                  // stride
-				(void*)0            // array buffer offset
-			);
-			// *** 2nd attribute buffer : UVs
-			glEnableVertexAttribArray(1);
-			glBindBuffer(GL_ARRAY_BUFFER, uvbuffer3);
-			glVertexAttribPointer(
-				1,                                // attribute
-				2,                                // size
-				GL_FLOAT,                         // type
-				GL_FALSE,                         // normalized?
-				0,                                // stride
-				(void*)0                          // array buffer offset
-			);
-			// *** Draw the triangle !
-			glDrawArrays(GL_TRIANGLES, 0, vertices3.size());
-
-			// *** Testing: Print meteor's position
-			//printf("x: %f  y: %f  z: %f\n", ModelMatrix[3][0], ModelMatrix[3][1], ModelMatrix[3][2]);
-			
-			// *** Check if the meteor collides with the sun
-			if(pow(ModelMatrix[3][0]-2.0,2)+pow(ModelMatrix[3][1]-2.0,2)+pow(ModelMatrix[3][2]-2.0,2)<=pow(15.0,2)) {
-				spaceFlag = false;
-				meteorCrashFlag = true;
+		// *** Keys 1 to 6 pick the swarm size, 1 to 100000 meteors
+		for (int key = GLFW_KEY_1; key <= GLFW_KEY_6; key++) {
+			if (glfwGetKey(window, key) == GLFW_PRESS) {
+				meteorSwarmSize = 1;
+				for (int k = GLFW_KEY_1; k < key; k++)
+					meteorSwarmSize *= 10;
 			}
+		}
 
-			// *** Check if the meteor collides with the orbiting planet
-			if (((pow((ModelMatrix[3][0]-planetX+2) - 2.0,2)) + (pow((ModelMatrix[3][1] - planetY + 2) - 2.0, 2))+ (pow((ModelMatrix[3][2] - planetZ + 2) - 2.0, 2)))<=pow(5,2)){
-				spaceFlag = false;
-				meteorCrashFlag = true;
-				planetCrashFlag = true;
+		// *** Check if space is pressed, and launch a swarm from around the camera's position towards the center.
+		// *** With shift held its meteors are drawn one by one, each a command of the render queue
+		bool spacePressed = glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS;
+		if (spacePressed && !spaceWasPressed) {
+			bool oneByOne = glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS;
+			launchMeteorSwarm(scene, getPos(), meteorSwarmSize, 3.0f * meshBuffers[METEOR_ROCK].radius, meteorspeed, oneByOne ? 0 : BODY_INSTANCED, meteorRandom);
+			printf("Space pressed! %u meteors launched%s, %u bodies in the scene\n", meteorSwarmSize, oneByOne ? " to be drawn one by one" : "", scene.count);
+		}
+		spaceWasPressed = spacePressed;
+
+		// *** Check which meteors collide with a solid body, by their bounding spheres. Whatever they
+		// *** hit is gone as well when it is destructible, like the planet. The removals wait until
+		// *** the pass is over, since each one moves another body into the removed one's place
+		std::vector<glm::vec4> solids;
+		std::vector<unsigned int> solidBodies;
+		for (unsigned int i = 0; i < scene.count; i++) {
+			if (scene.flags[i] & BODY_SOLID) {
+				const MeshBuffers& body = meshBuffers[scene.mesh[i]];
+				solids.push_back(glm::vec4(glm::vec3(scene.modelMatrix[i] * glm::vec4(body.centre, 1.0f)), body.radius * scene.scale[i]));
+				solidBodies.push_back(i);
 			}
 		}
-		
-		glDisableVertexAttribArray(0);
-		glDisableVertexAttribArray(1);
+		std::vector<BodyHandle> crashed;
+		for (unsigned int i = 0; i < scene.count && !solids.empty(); i++) {
+			if ((scene.flags[i] & BODY_PROJECTILE) == 0)
+				continue;
+			const MeshBuffers& projectile = meshBuffers[scene.mesh[i]];
+			glm::vec3 centre = glm::vec3(scene.modelMatrix[i] * glm::vec4(projectile.centre, 1.0f));
+			float radius = projectile.radius * scene.scale[i];
+			for (size_t solid = 0; solid < solids.size(); solid++) {
+				glm::vec3 apart = centre - glm::vec3(solids[solid]);
+				float reach = radius + solids[solid].w;
+				if (glm::dot(apart, apart) <= reach * reach) {
+					crashed.push_back(getBodyHandle(scene, i));
+					if (scene.flags[solidBodies[solid]] & BODY_DESTRUCTIBLE)
+						crashed.push_back(getBodyHandle(scene, solidBodies[solid]));
+					break;
+				}
+			}
+		}
+		// A body hit twice is removed once; its handle is stale the second time
+		for (size_t c = 0; c < crashed.size(); c++)
+			removeBody(scene, crashed[c]);
+
+		// *** Report the triangle count once a second
+		if (crntTime - lastReportTime >= 1.0) {
+			printf("Drawing %u triangles per frame, %u of %u bodies and %u meteors in view, the meteors in %u instanced draws\n",
+				trianglesDrawn, bodiesDrawn, scene.count, meteorsDrawn, meteorInstances.drawCalls);
+			printf("Render queue: %u commands, %u state changes, sorted in %.3f ms and submitted in %.3f ms\n",
+				renderQueue.lastCommands, renderQueue.lastStateChanges, renderQueue.lastSortMs, renderQueue.lastSubmitMs);
+			lastReportTime = crntTime;
+		}
 
 		// Swap buffers
 		glfwSwapBuffers(window);
 		glfwPollEvents();
 
+		// *** Time to first frame, from the start of main()
+		if (firstFrame) {
+			printf("First frame after %.1f ms\n", std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count());
+			firstFrame = false;
+		}
+
 	} // Check if the ESC key was pressed or the window was closed
 	while (glfwGetKey(window, GLFW_KEY_Q ) != GLFW_PRESS &&
 		   glfwWindowShouldClose(window) == 0 );
 	
 	
 	// Cleanup VBOs and shaders
-	glDeleteBuffers(1, &vertexbuffer);
-	glDeleteBuffers(1, &vertexbuffer2);
-	glDeleteBuffers(1, &vertexbuffer3);
-	glDeleteBuffers(1, &uvbuffer);
-	glDeleteBuffers(1, &uvbuffer2);
-	glDeleteBuffers(1, &uvbuffer3);
+	for (unsigned int m = 0; m < BODY_MESH_COUNT; m++) {
+		glDeleteBuffers(1, &meshBuffers[m].vertexbuffer);
+		glDeleteBuffers(1, &meshBuffers[m].elementbuffer);
+		glDeleteVertexArrays(1, &meshBuffers[m].vertexArray);
+	}
+	glDeleteBuffers(1, &meteorInstances.instancebuffer);
+	glDeleteVertexArrays(1, &meteorInstances.vertexArray);
 	glDeleteProgram(programID);
-	glDeleteTextures(1, &textureID);
-	glDeleteTextures(1, &textureID2);
-	glDeleteTextures(1, &textureID3);
-	glDeleteVertexArrays(1, &VertexArrayID);
+	if (haveAsteroid) {
+		glDeleteBuffers(1, &asteroidBuffers.vertexbuffer);
+		glDeleteBuffers(1, &asteroidBuffers.elementbuffer);
+		glDeleteVertexArrays(1, &asteroidBuffers.vertexArray);
+		closeStreamedMesh(asteroid);
+	}
+	for (unsigned int v = 0; v < surfaceCount; v++) {
+		if (haveSurface[v]) {
+			printf("Virtual texture %s: %llu tiles uploaded, %llu evicted\n", surfacePaths[v], surfaces[v].tilesUploaded, surfaces[v].tilesEvicted);
+			closeVirtualTexture(surfaces[v]);
+		}
+	}
+	if (haveFeedback)
+		deleteVirtualFeedback(feedback);
+	glDeleteProgram(feedbackProgramID);
+	printf("Texture uploads: %.1f MB in %u bands over %u frames, at most %.1f MB and %.2f ms of CPU in a frame\n", textureUploads.bytesUploaded / (1024.0 * 1024.0),
+		textureUploads.bandsUploaded, textureUploads.uploadFrames, textureUploads.largestFrameBytes / (1024.0 * 1024.0), textureUploads.longestFrameMs);
+	deleteTextureUploadQueue(textureUploads);
+	printf("Scene: %u bodies, transforms updated in %.3f ms per frame on average, %.3f ms at most\n", scene.count,
+		scene.updates > 0 ? scene.updateMs / scene.updates : 0.0, scene.longestUpdateMs);
+	if (renderQueue.frames > 0) {
+		printf("Render queue: %.1f commands and %.1f state changes per frame, sorted in %.3f ms and submitted in %.3f ms on average\n",
+			(double)renderQueue.commandCount / renderQueue.frames, (double)renderQueue.stateChanges / renderQueue.frames,
+			renderQueue.sortMs / renderQueue.frames, renderQueue.submitMs / renderQueue.frames);
+	}
+	for (unsigned int b = 0; b < swarmBuckets; b++) {
+		if (swarmFrames[b] == 0)
+			continue;
+		unsigned int fewest = 0;
+		for (unsigned int k = 0; k < b; k++)
+			fewest = fewest == 0 ? 1 : fewest * 10;
+		printf("Meteors drawn %6u and up: %u frames, %.2f ms per frame, %.3f ms of it culling and streaming instances\n", fewest, swarmFrames[b],
+			swarmFrameMs[b] / swarmFrames[b], swarmCPUMs[b] / swarmFrames[b]);
+	}
+	deleteTextureManager(textureManager);
 
 	// Close OpenGL window and terminate GLFW
 	glfwTerminate();
@@ -0,0 +1,127 @@
+// Include standard headers
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "decodearena.hpp"
+
+// A 1024 x 1024 RGB JPEG needs about 7 MB: its component planes, the pixels and the converted
+// copy. Bigger decodes grow the arena, and it keeps up to decodeArenaKeepBytes of that for the
+// next one; past that, e.g. after a huge surface map, the memory goes back to the heap.
+static const size_t decodeArenaBlockBytes = 8u << 20;
+static const size_t decodeArenaKeepBytes = 64u << 20;
+
+static inline size_t alignArena(size_t bytes) {
+	return (bytes + 15) & ~(size_t)15;
+}
+
+struct ArenaBlock {
+	unsigned char* memory;
+	size_t size;
+};
+
+struct DecodeArena {
+	std::vector<ArenaBlock> blocks; // the last one is being filled
+	size_t used; // of the last block
+	size_t held; // allocated since the last rewind, over all blocks
+	size_t live; // allocations not freed yet
+	void* last; // the latest allocation, which can grow in place
+	DecodeArenaStats stats;
+
+	DecodeArena() : used(0), held(0), live(0), last(NULL) {
+		memset(&stats, 0, sizeof(stats));
+	}
+	~DecodeArena() {
+		for (size_t i = 0; i < blocks.size(); i++)
+			free(blocks[i].memory);
+	}
+};
+
+static thread_local DecodeArena arena;
+
+static bool addBlock(size_t size) {
+	ArenaBlock block;
+	block.size = size > decodeArenaBlockBytes ? size : decodeArenaBlockBytes;
+	block.memory = (unsigned char*)malloc(block.size);
+	if (block.memory == NULL)
+		return false;
+	arena.blocks.push_back(block);
+	arena.used = 0;
+	arena.stats.heapAllocations++;
+	return true;
+}
+
+// Everything is free again: start over at the beginning of the first block. When the decode took
+// more than one block, they become one block of the size it needed, so the next decode of that
+// size fits in one piece.
+static void rewind() {
+	if (arena.blocks.size() > 1) {
+		size_t size = alignArena(arena.held);
+		for (size_t i = 0; i < arena.blocks.size(); i++)
+			free(arena.blocks[i].memory);
+		arena.blocks.clear();
+		if (size <= decodeArenaKeepBytes)
+			addBlock(size);
+	}
+	else if (arena.blocks.size() == 1 && arena.blocks[0].size > decodeArenaKeepBytes) {
+		free(arena.blocks[0].memory);
+		arena.blocks.clear();
+	}
+	arena.used = 0;
+	arena.held = 0;
+	arena.last = NULL;
+}
+
+void* decodeArenaMalloc(size_t size) {
+	arena.stats.allocations++;
+	size = alignArena(size > 0 ? size : 1);
+	if (arena.blocks.empty() || arena.used + size > arena.blocks.back().size) {
+		if (!addBlock(size))
+			return NULL;
+	}
+	void* pointer = arena.blocks.back().memory + arena.used;
+	arena.used += size;
+	arena.held += size;
+	if (arena.held > arena.stats.peakBytes)
+		arena.stats.peakBytes = arena.held;
+	arena.live++;
+	arena.last = pointer;
+	return pointer;
+}
+
+void* decodeArenaRealloc(void* pointer, size_t oldSize, size_t newSize) {
+	if (pointer == NULL)
+		return decodeArenaMalloc(newSize);
+
+	// The latest allocation grows or shrinks where it is when its block has the room
+	if (pointer == arena.last) {
+		size_t offset = (unsigned char*)pointer - arena.blocks.back().memory;
+		size_t size = alignArena(newSize > 0 ? newSize : 1);
+		if (offset + size <= arena.blocks.back().size) {
+			arena.stats.allocations++;
+			arena.held = arena.held - (arena.used - offset) + size;
+			arena.used = offset + size;
+			if (arena.held > arena.stats.peakBytes)
+				arena.stats.peakBytes = arena.held;
+			return pointer;
+		}
+	}
+
+	void* moved = decodeArenaMalloc(newSize);
+	if (moved == NULL)
+		return NULL;
+	memcpy(moved, pointer, oldSize < newSize ? oldSize : newSize);
+	decodeArenaFree(pointer);
+	return moved;
+}
+
+void decodeArenaFree(void* pointer) {
+	if (pointer == NULL || arena.live == 0)
+		return;
+	if (--arena.live == 0)
+		rewind();
+}
+
+DecodeArenaStats getDecodeArenaStats() {
+	return arena.stats;
+}
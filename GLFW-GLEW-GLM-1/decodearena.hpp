@@ -0,0 +1,25 @@
+#ifndef DECODEARENA_HPP
+#define DECODEARENA_HPP
+
+#include <stddef.h>
+
+// stb_image allocates through these instead of malloc (see the STBI_MALLOC hooks in Main.cpp).
+// Every thread that decodes gets an arena: allocations bump a pointer through one block, frees
+// only count down, and once everything a decode allocated is freed again (stb_image frees its
+// own buffers before returning, the caller frees the pixels with stbi_image_free) the arena
+// rewinds. The next decode on that thread, pixels included, reuses the same memory, so a warm
+// worker decodes without touching the heap.
+void* decodeArenaMalloc(size_t size);
+void* decodeArenaRealloc(void* pointer, size_t oldSize, size_t newSize);
+void decodeArenaFree(void* pointer);
+
+// Counters of the calling thread's arena; take them before and after a decode for its share.
+struct DecodeArenaStats {
+	unsigned long long allocations; // malloc and realloc calls stb_image made
+	unsigned long long heapAllocations; // blocks the arena had to get from the heap for them
+	size_t peakBytes; // most the arena held at once
+};
+
+DecodeArenaStats getDecodeArenaStats();
+
+#endif
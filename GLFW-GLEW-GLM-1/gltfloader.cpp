@@ -0,0 +1,610 @@
+// Include standard headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+#include <vector>
+#include <chrono>
+
+// Include GLM
+#include <glm/glm.hpp>
+
+#include "mappedfile.hpp"
+#include "mesh.hpp"
+#include "meshopt.hpp"
+#include "gltfloader.hpp"
+
+// GLB container: 12-byte header, then chunks of { length, type, data } padded to 4 bytes.
+// The first chunk is the JSON document, the second (optional) one the binary buffer.
+static const uint32_t glbMagic = 0x46546C67; // "glTF"
+static const uint32_t glbChunkJSON = 0x4E4F534A; // "JSON"
+static const uint32_t glbChunkBIN = 0x004E4942; // "BIN\0"
+
+// glTF componentType values
+enum {
+	GLTF_BYTE = 5120,
+	GLTF_UNSIGNED_BYTE = 5121,
+	GLTF_SHORT = 5122,
+	GLTF_UNSIGNED_SHORT = 5123,
+	GLTF_UNSIGNED_INT = 5125,
+	GLTF_FLOAT = 5126
+};
+
+// Just enough JSON for a glTF header. The document becomes one flat array of values, objects and
+// arrays listing their children by index; strings point into the file with escapes left as is.
+enum JsonType { JSON_NULL, JSON_BOOL, JSON_NUMBER, JSON_STRING, JSON_ARRAY, JSON_OBJECT };
+
+struct JsonValue {
+	JsonType type;
+	double number;
+	const char* text;
+	size_t length;
+	const char* key; // member name when the value is inside an object
+	size_t keyLength;
+	std::vector<unsigned int> children;
+};
+
+struct JsonParser {
+	const char* p;
+	const char* end;
+	int depth;
+	std::vector<JsonValue> values;
+};
+
+static const int maxJsonDepth = 64;
+
+static void skipSpace(JsonParser& parser) {
+	while (parser.p < parser.end && (*parser.p == ' ' || *parser.p == '\t' || *parser.p == '\n' || *parser.p == '\r'))
+		parser.p++;
+}
+
+static bool parseString(JsonParser& parser, const char*& text, size_t& length) {
+	if (parser.p >= parser.end || *parser.p != '"')
+		return false;
+	text = ++parser.p;
+	while (parser.p < parser.end && *parser.p != '"') {
+		if (*parser.p == '\\')
+			parser.p++;
+		parser.p++;
+	}
+	if (parser.p >= parser.end)
+		return false;
+	length = parser.p - text;
+	parser.p++;
+	return true;
+}
+
+static bool parseLiteral(JsonParser& parser, const char* literal) {
+	size_t length = strlen(literal);
+	if ((size_t)(parser.end - parser.p) < length || memcmp(parser.p, literal, length) != 0)
+		return false;
+	parser.p += length;
+	return true;
+}
+
+static bool parseValue(JsonParser& parser, unsigned int& index) {
+	skipSpace(parser);
+	if (parser.p >= parser.end || parser.depth > maxJsonDepth)
+		return false;
+
+	index = (unsigned int)parser.values.size();
+	parser.values.push_back(JsonValue());
+	JsonValue& value = parser.values.back();
+	value.type = JSON_NULL;
+	value.number = 0.0;
+	value.text = value.key = NULL;
+	value.length = value.keyLength = 0;
+
+	char c = *parser.p;
+	if (c == '{' || c == '[') {
+		bool object = c == '{';
+		char close = object ? '}' : ']';
+		parser.values[index].type = object ? JSON_OBJECT : JSON_ARRAY;
+		parser.p++;
+		parser.depth++;
+		skipSpace(parser);
+		if (parser.p < parser.end && *parser.p == close) {
+			parser.p++;
+			parser.depth--;
+			return true;
+		}
+		for (;;) {
+			const char* key = NULL;
+			size_t keyLength = 0;
+			if (object) {
+				skipSpace(parser);
+				if (!parseString(parser, key, keyLength))
+					return false;
+				skipSpace(parser);
+				if (parser.p >= parser.end || *parser.p++ != ':')
+					return false;
+			}
+			unsigned int child;
+			if (!parseValue(parser, child))
+				return false;
+			// push_back may have moved the values, so only hold on to indices
+			parser.values[child].key = key;
+			parser.values[child].keyLength = keyLength;
+			parser.values[index].children.push_back(child);
+
+			skipSpace(parser);
+			if (parser.p >= parser.end)
+				return false;
+			char separator = *parser.p++;
+			if (separator == close)
+				break;
+			if (separator != ',')
+				return false;
+		}
+		parser.depth--;
+		return true;
+	}
+	if (c == '"') {
+		value.type = JSON_STRING;
+		return parseString(parser, value.text, value.length);
+	}
+	if (c == 't' || c == 'f') {
+		value.type = JSON_BOOL;
+		value.number = c == 't' ? 1.0 : 0.0;
+		return parseLiteral(parser, c == 't' ? "true" : "false");
+	}
+	if (c == 'n')
+		return parseLiteral(parser, "null");
+
+	// A number; strtod needs it NUL-terminated, which the mapping is not
+	char token[64];
+	size_t length = 0;
+	while (parser.p + length < parser.end && length < sizeof(token) - 1 && strchr("+-0123456789.eE", parser.p[length]) != NULL) {
+		token[length] = parser.p[length];
+		length++;
+	}
+	token[length] = '\0';
+	char* tokenEnd;
+	value.type = JSON_NUMBER;
+	value.number = strtod(token, &tokenEnd);
+	if (tokenEnd == token)
+		return false;
+	parser.p += tokenEnd - token;
+	return true;
+}
+
+static const JsonValue* findMember(const std::vector<JsonValue>& values, const JsonValue* object, const char* key) {
+	if (object == NULL || object->type != JSON_OBJECT)
+		return NULL;
+	size_t keyLength = strlen(key);
+	for (size_t i = 0; i < object->children.size(); i++) {
+		const JsonValue& member = values[object->children[i]];
+		if (member.keyLength == keyLength && memcmp(member.key, key, keyLength) == 0)
+			return &member;
+	}
+	return NULL;
+}
+
+static const JsonValue* getElement(const std::vector<JsonValue>& values, const JsonValue* array, double index) {
+	// Written so that NaN fails too
+	if (array == NULL || array->type != JSON_ARRAY || !(index >= 0.0 && index < array->children.size()) || index != floor(index))
+		return NULL;
+	return &values[array->children[(size_t)index]];
+}
+
+static double getNumber(const std::vector<JsonValue>& values, const JsonValue* object, const char* key, double fallback) {
+	const JsonValue* member = findMember(values, object, key);
+	return member != NULL && (member->type == JSON_NUMBER || member->type == JSON_BOOL) ? member->number : fallback;
+}
+
+// A member that has to be a whole number from 0 to limit, or `fallback` when it is missing. False
+// for anything else, before it is cast: the cast of a negative, fractional or huge double is not
+// defined.
+static bool getUnsigned(const std::vector<JsonValue>& values, const JsonValue* object, const char* key, uint64_t fallback, uint64_t limit, uint64_t& out) {
+	const JsonValue* member = findMember(values, object, key);
+	if (member == NULL) {
+		out = fallback;
+		return true;
+	}
+	double number = member->number;
+	if (member->type != JSON_NUMBER || !(number >= 0.0 && number <= (double)limit) || number != floor(number))
+		return false;
+	out = (uint64_t)number;
+	return true;
+}
+
+static bool isString(const JsonValue* value, const char* text) {
+	return value != NULL && value->type == JSON_STRING && value->length == strlen(text) && memcmp(value->text, text, value->length) == 0;
+}
+
+// Where an accessor's elements are in the binary chunk, checked to lie inside it.
+struct AccessorView {
+	const unsigned char* data;
+	unsigned int count;
+	unsigned int componentType;
+	unsigned int components;
+	unsigned int stride;
+	bool normalized;
+	bool hasBounds;
+	float min[3], max[3];
+};
+
+struct GlbDocument {
+	std::vector<JsonValue> values;
+	const JsonValue* accessors;
+	const JsonValue* bufferViews;
+	const JsonValue* buffers;
+	const unsigned char* bin;
+	size_t binSize;
+};
+
+static unsigned int componentSize(unsigned int componentType) {
+	switch (componentType) {
+	case GLTF_BYTE: case GLTF_UNSIGNED_BYTE: return 1;
+	case GLTF_SHORT: case GLTF_UNSIGNED_SHORT: return 2;
+	case GLTF_UNSIGNED_INT: case GLTF_FLOAT: return 4;
+	default: return 0;
+	}
+}
+
+static unsigned int componentCount(const JsonValue* type) {
+	if (isString(type, "SCALAR")) return 1;
+	if (isString(type, "VEC2")) return 2;
+	if (isString(type, "VEC3")) return 3;
+	if (isString(type, "VEC4")) return 4;
+	return 0;
+}
+
+static bool resolveAccessor(const GlbDocument& glb, double index, AccessorView& view) {
+	const std::vector<JsonValue>& values = glb.values;
+	const JsonValue* accessor = getElement(values, glb.accessors, index);
+	if (accessor == NULL || findMember(values, accessor, "sparse") != NULL)
+		return false;
+	const JsonValue* bufferView = getElement(values, glb.bufferViews, getNumber(values, accessor, "bufferView", -1.0));
+	if (bufferView == NULL)
+		return false;
+	// Only the GLB's own binary chunk: buffer 0 without a uri
+	const JsonValue* buffer = getElement(values, glb.buffers, getNumber(values, bufferView, "buffer", -1.0));
+	if (buffer == NULL || findMember(values, buffer, "uri") != NULL || glb.bin == NULL)
+		return false;
+
+	uint64_t count, componentType, stride, viewOffset, viewLength, accessorOffset;
+	if (!getUnsigned(values, accessor, "count", 0, UINT32_MAX, count) || !getUnsigned(values, accessor, "componentType", 0, UINT32_MAX, componentType))
+		return false;
+	view.count = (unsigned int)count;
+	view.componentType = (unsigned int)componentType;
+	view.components = componentCount(findMember(values, accessor, "type"));
+	view.normalized = getNumber(values, accessor, "normalized", 0.0) != 0.0;
+	unsigned int elementSize = componentSize(view.componentType) * view.components;
+	// The spec caps byteStride at 252
+	if (!getUnsigned(values, bufferView, "byteStride", elementSize, 252, stride))
+		return false;
+	view.stride = (unsigned int)stride;
+	if (elementSize == 0 || view.count == 0 || view.stride < elementSize)
+		return false;
+
+	// Offsets and lengths are checked one at a time against what is left, so no sum can wrap
+	if (!getUnsigned(values, bufferView, "byteOffset", 0, glb.binSize, viewOffset)
+		|| !getUnsigned(values, bufferView, "byteLength", 0, glb.binSize - viewOffset, viewLength)
+		|| !getUnsigned(values, accessor, "byteOffset", 0, viewLength, accessorOffset))
+		return false;
+	// At most 252 * 2^32 bytes, far from wrapping
+	uint64_t span = (uint64_t)view.stride * (view.count - 1) + elementSize;
+	if (span > viewLength - accessorOffset)
+		return false;
+	view.data = glb.bin + viewOffset + accessorOffset;
+
+	const JsonValue* min = findMember(values, accessor, "min");
+	const JsonValue* max = findMember(values, accessor, "max");
+	view.hasBounds = min != NULL && max != NULL && min->type == JSON_ARRAY && max->type == JSON_ARRAY
+		&& min->children.size() >= 3 && max->children.size() >= 3;
+	for (int i = 0; view.hasBounds && i < 3; i++) {
+		view.min[i] = (float)getElement(values, min, i)->number;
+		view.max[i] = (float)getElement(values, max, i)->number;
+	}
+	return true;
+}
+
+// Reads element i as floats, normalizing integer components the way the glTF spec says: signed
+// ones divide by their largest value and clamp at -1, so both -128 and -127 are -1.
+static void readElement(const AccessorView& view, unsigned int i, float* out) {
+	const unsigned char* element = view.data + (size_t)view.stride * i;
+	for (unsigned int c = 0; c < view.components; c++) {
+		switch (view.componentType) {
+		case GLTF_FLOAT: memcpy(&out[c], element + 4 * c, 4); break;
+		case GLTF_UNSIGNED_BYTE: out[c] = element[c] / (view.normalized ? 255.0f : 1.0f); break;
+		case GLTF_BYTE: {
+			float value = (float)(signed char)element[c];
+			out[c] = view.normalized ? (value / 127.0f > -1.0f ? value / 127.0f : -1.0f) : value;
+			break;
+		}
+		case GLTF_UNSIGNED_SHORT: {
+			unsigned short value;
+			memcpy(&value, element + 2 * c, 2);
+			out[c] = value / (view.normalized ? 65535.0f : 1.0f);
+			break;
+		}
+		case GLTF_SHORT: {
+			short value;
+			memcpy(&value, element + 2 * c, 2);
+			out[c] = view.normalized ? (value / 32767.0f > -1.0f ? value / 32767.0f : -1.0f) : (float)value;
+			break;
+		}
+		default: out[c] = 0.0f; break;
+		}
+	}
+}
+
+static unsigned int readIndex(const AccessorView& view, unsigned int i) {
+	const unsigned char* element = view.data + (size_t)view.stride * i;
+	if (view.componentType == GLTF_UNSIGNED_BYTE)
+		return element[0];
+	if (view.componentType == GLTF_UNSIGNED_SHORT) {
+		unsigned short value;
+		memcpy(&value, element, 2);
+		return value;
+	}
+	unsigned int value;
+	memcpy(&value, element, 4);
+	return value;
+}
+
+// The attributes of one triangle primitive, resolved against the binary chunk.
+struct GlbPrimitive {
+	AccessorView positions, uvs, normals, indices;
+	bool indexed;
+};
+
+static bool resolvePrimitive(const GlbDocument& glb, const JsonValue* primitive, GlbPrimitive& out) {
+	const std::vector<JsonValue>& values = glb.values;
+	if (getNumber(values, primitive, "mode", 4.0) != 4.0) {
+		printf("Only triangle lists are supported\n");
+		return false;
+	}
+	const JsonValue* attributes = findMember(values, primitive, "attributes");
+	if (!resolveAccessor(glb, getNumber(values, attributes, "POSITION", -1.0), out.positions)
+		|| !resolveAccessor(glb, getNumber(values, attributes, "TEXCOORD_0", -1.0), out.uvs)
+		|| !resolveAccessor(glb, getNumber(values, attributes, "NORMAL", -1.0), out.normals)) {
+		printf("Every primitive needs POSITION, TEXCOORD_0 and NORMAL in the binary chunk\n");
+		return false;
+	}
+	bool typesOk = out.positions.componentType == GLTF_FLOAT && out.positions.components == 3
+		&& out.normals.componentType == GLTF_FLOAT && out.normals.components == 3
+		&& out.uvs.components == 2 && (out.uvs.componentType == GLTF_FLOAT || (out.uvs.normalized && out.uvs.componentType != GLTF_UNSIGNED_INT))
+		&& out.uvs.count == out.positions.count && out.normals.count == out.positions.count;
+
+	out.indexed = findMember(values, primitive, "indices") != NULL;
+	if (out.indexed) {
+		typesOk = typesOk && resolveAccessor(glb, getNumber(values, primitive, "indices", -1.0), out.indices)
+			&& out.indices.components == 1
+			&& (out.indices.componentType == GLTF_UNSIGNED_BYTE || out.indices.componentType == GLTF_UNSIGNED_SHORT || out.indices.componentType == GLTF_UNSIGNED_INT);
+	}
+	if (!typesOk)
+		printf("Unsupported accessor layout\n");
+	return typesOk;
+}
+
+// A single primitive that is already what the renderer would upload: interleaved float position |
+// uv | normal in 32-byte vertices, and tightly packed 16 or 32-bit indices.
+static bool matchesVertexFloat(const GlbPrimitive& primitive) {
+	const unsigned char* base = primitive.positions.data;
+	return primitive.indexed
+		&& primitive.uvs.componentType == GLTF_FLOAT
+		&& primitive.positions.stride == 32 && primitive.uvs.stride == 32 && primitive.normals.stride == 32
+		&& primitive.uvs.data == base + 12 && primitive.normals.data == base + 20
+		&& (primitive.indices.componentType == GLTF_UNSIGNED_SHORT || primitive.indices.componentType == GLTF_UNSIGNED_INT)
+		&& primitive.indices.stride == componentSize(primitive.indices.componentType)
+		&& primitive.indices.count % 3 == 0;
+}
+
+// Points the mesh into the mapping; only reads positions for the bounding sphere and the levels of
+// detail, and indices to check they stay in range.
+static bool viewMesh(const GlbPrimitive& primitive, Mesh& mesh) {
+	mesh.format = VERTEX_FLOAT;
+	mesh.vertexSize = getVertexSizes(VERTEX_FLOAT, mesh.positionSize, mesh.uvSize, mesh.normalSize);
+	mesh.vertices = primitive.positions.data;
+	mesh.vertexCount = primitive.positions.count;
+	mesh.indices = primitive.indices.data;
+	mesh.indexCount = primitive.indices.count;
+	mesh.indexSize = primitive.indices.stride;
+
+	for (unsigned int i = 0; i < mesh.indexCount; i++) {
+		if (readIndex(primitive.indices, i) >= mesh.vertexCount) {
+			printf("A face references a vertex that does not exist\n");
+			return false;
+		}
+	}
+
+	// POSITION must carry min / max, so the box is free; the sphere around it takes one pass
+	if (primitive.positions.hasBounds) {
+		mesh.boundsMin = glm::vec3(primitive.positions.min[0], primitive.positions.min[1], primitive.positions.min[2]);
+		mesh.boundsMax = glm::vec3(primitive.positions.max[0], primitive.positions.max[1], primitive.positions.max[2]);
+	}
+	else {
+		glm::vec3 position;
+		readElement(primitive.positions, 0, &position.x);
+		mesh.boundsMin = mesh.boundsMax = position;
+		for (unsigned int i = 1; i < mesh.vertexCount; i++) {
+			readElement(primitive.positions, i, &position.x);
+			mesh.boundsMin = glm::min(mesh.boundsMin, position);
+			mesh.boundsMax = glm::max(mesh.boundsMax, position);
+		}
+	}
+	mesh.sphereCentre = (mesh.boundsMin + mesh.boundsMax) * 0.5f;
+	float radiusSquared = 0.0f;
+	for (unsigned int i = 0; i < mesh.vertexCount; i++) {
+		glm::vec3 position;
+		readElement(primitive.positions, i, &position.x);
+		glm::vec3 offset = position - mesh.sphereCentre;
+		float distanceSquared = glm::dot(offset, offset);
+		if (distanceSquared > radiusSquared)
+			radiusSquared = distanceSquared;
+	}
+	mesh.sphereRadius = sqrtf(radiusSquared);
+
+	// Levels of detail, as loadMesh builds them. They collapse vertices onto their neighbours, so
+	// the vertices stay in the mapping and only the index buffer moves to the mesh's storage:
+	// level 0 as the file has it, the coarser levels after it in the same index size
+	std::vector<glm::vec3> positions(mesh.vertexCount);
+	for (unsigned int i = 0; i < mesh.vertexCount; i++)
+		readElement(primitive.positions, i, &positions[i].x);
+	std::vector<unsigned int> indices(mesh.indexCount);
+	for (unsigned int i = 0; i < mesh.indexCount; i++)
+		indices[i] = readIndex(primitive.indices, i);
+	std::vector<std::vector<unsigned int> > levels;
+	std::vector<float> errors;
+	buildLODChain(indices, positions, maxMeshLODs, levels, errors);
+
+	mesh.lods.count = (unsigned int)levels.size();
+	mesh.lods.indexOffset[0] = 0;
+	mesh.lods.indexCount[0] = mesh.indexCount;
+	mesh.lods.error[0] = 0.0f;
+	if (levels.size() == 1)
+		return true;
+	unsigned int indexCount = mesh.indexCount;
+	for (size_t l = 1; l < levels.size(); l++) {
+		optimizeVertexCache(levels[l], positions);
+		mesh.lods.indexOffset[l] = indexCount;
+		mesh.lods.indexCount[l] = (unsigned int)levels[l].size();
+		mesh.lods.error[l] = errors[l];
+		indexCount += mesh.lods.indexCount[l];
+	}
+	mesh.indexStorage.resize((size_t)indexCount * mesh.indexSize);
+	memcpy(mesh.indexStorage.data(), primitive.indices.data, (size_t)mesh.indexCount * mesh.indexSize);
+	for (size_t l = 1; l < levels.size(); l++) {
+		unsigned char* out = mesh.indexStorage.data() + (size_t)mesh.lods.indexOffset[l] * mesh.indexSize;
+		for (size_t i = 0; i < levels[l].size(); i++) {
+			if (mesh.indexSize == 2)
+				((unsigned short*)out)[i] = (unsigned short)levels[l][i];
+			else
+				((unsigned int*)out)[i] = levels[l][i];
+		}
+	}
+	mesh.indices = mesh.indexStorage.data();
+	mesh.indexCount = indexCount;
+	return true;
+}
+
+// Gathers every primitive into arrays, as the OBJ loaders would have produced them.
+static bool convertPrimitives(const std::vector<GlbPrimitive>& primitives, std::vector<unsigned int>& indices, std::vector<glm::vec3>& vertices, std::vector<glm::vec2>& uvs, std::vector<glm::vec3>& normals) {
+	for (size_t p = 0; p < primitives.size(); p++) {
+		const GlbPrimitive& primitive = primitives[p];
+		unsigned int base = (unsigned int)vertices.size();
+		unsigned int count = primitive.positions.count;
+		vertices.resize(base + count);
+		uvs.resize(base + count);
+		normals.resize(base + count);
+		for (unsigned int i = 0; i < count; i++) {
+			readElement(primitive.positions, i, &vertices[base + i].x);
+			readElement(primitive.uvs, i, &uvs[base + i].x);
+			readElement(primitive.normals, i, &normals[base + i].x);
+		}
+
+		unsigned int indexCount = primitive.indexed ? primitive.indices.count : count;
+		for (unsigned int i = 0; i + 2 < indexCount; i += 3) {
+			for (int corner = 0; corner < 3; corner++) {
+				unsigned int index = primitive.indexed ? readIndex(primitive.indices, i + corner) : i + corner;
+				if (index >= count) {
+					printf("A face references a vertex that does not exist\n");
+					return false;
+				}
+				indices.push_back(base + index);
+			}
+		}
+	}
+	return true;
+}
+
+// Checks the GLB container and parses its JSON chunk.
+static bool openGLB(const MappedFile& file, GlbDocument& glb) {
+	uint32_t header[3], chunk[2];
+	if (file.size < 20)
+		return false;
+	memcpy(header, file.data, sizeof(header));
+	memcpy(chunk, file.data + 12, sizeof(chunk));
+	if (header[0] != glbMagic || header[1] != 2 || header[2] > file.size || chunk[1] != glbChunkJSON || (uint64_t)20 + chunk[0] > header[2])
+		return false;
+
+	JsonParser parser;
+	parser.p = file.data + 20;
+	parser.end = parser.p + chunk[0];
+	parser.depth = 0;
+	unsigned int root;
+	if (!parseValue(parser, root) || parser.values[root].type != JSON_OBJECT)
+		return false;
+	glb.values.swap(parser.values);
+
+	glb.bin = NULL;
+	glb.binSize = 0;
+	uint64_t binChunk = 20 + (((uint64_t)chunk[0] + 3) & ~(uint64_t)3);
+	if (binChunk + 8 <= header[2]) {
+		memcpy(chunk, file.data + binChunk, sizeof(chunk));
+		if (chunk[1] == glbChunkBIN && binChunk + 8 + chunk[0] <= header[2]) {
+			glb.bin = (const unsigned char*)file.data + binChunk + 8;
+			glb.binSize = chunk[0];
+		}
+	}
+
+	const JsonValue* document = &glb.values[root];
+	glb.accessors = findMember(glb.values, document, "accessors");
+	glb.bufferViews = findMember(glb.values, document, "bufferViews");
+	glb.buffers = findMember(glb.values, document, "buffers");
+	return true;
+}
+
+bool loadGLB(const char* path, Mesh& mesh, VertexFormat format) {
+	std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+	initMesh(mesh);
+
+	MappedFile file;
+	if (!openMappedFile(path, file)) {
+		printf("Impossible to open the file ! Are you in the right path ? See Tutorial 1 for details\n");
+		return false;
+	}
+
+	GlbDocument glb;
+	if (!openGLB(file, glb)) {
+		printf("%s is not a binary glTF 2.0 file\n", path);
+		closeMappedFile(file);
+		return false;
+	}
+
+	const JsonValue* meshes = findMember(glb.values, &glb.values[0], "meshes");
+	const JsonValue* primitiveList = findMember(glb.values, getElement(glb.values, meshes, 0), "primitives");
+	std::vector<GlbPrimitive> primitives(primitiveList != NULL && primitiveList->type == JSON_ARRAY ? primitiveList->children.size() : 0);
+	bool ok = !primitives.empty();
+	for (size_t i = 0; ok && i < primitives.size(); i++)
+		ok = resolvePrimitive(glb, &glb.values[primitiveList->children[i]], primitives[i]);
+	if (!ok) {
+		printf("No mesh in %s that we can draw\n", path);
+		closeMappedFile(file);
+		return false;
+	}
+
+	bool zeroCopy = format == VERTEX_FLOAT && primitives.size() == 1 && matchesVertexFloat(primitives[0]);
+	if (zeroCopy) {
+		ok = viewMesh(primitives[0], mesh);
+		if (ok)
+			mesh.file = file;
+	}
+	else {
+		std::vector<unsigned int> indices;
+		std::vector<glm::vec3> vertices;
+		std::vector<glm::vec2> uvs;
+		std::vector<glm::vec3> normals;
+		ok = convertPrimitives(primitives, indices, vertices, uvs, normals);
+		closeMappedFile(file);
+		if (ok) {
+			std::vector<std::vector<unsigned int> > levels;
+			std::vector<float> errors;
+			buildLODChain(indices, vertices, maxMeshLODs, levels, errors);
+			buildMesh(path, levels, errors, vertices, uvs, normals, format, mesh);
+		}
+	}
+	if (!ok) {
+		closeMappedFile(file);
+		initMesh(mesh);
+		return false;
+	}
+
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+	printf("Loaded %s: %u vertices, %u triangles in %u LODs in %.2f ms (%s)\n", path, mesh.vertexCount, mesh.lods.indexCount[0] / 3, mesh.lods.count, ms,
+		zeroCopy ? (mesh.lods.count > 1 ? "zero-copy vertices" : "zero-copy") : "converted");
+	return true;
+}
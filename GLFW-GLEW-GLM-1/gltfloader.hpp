@@ -0,0 +1,16 @@
+#ifndef GLTFLOADER_HPP
+#define GLTFLOADER_HPP
+
+#include "mesh.hpp"
+
+// Loads the triangles of the first mesh of a binary glTF 2.0 file (.glb) with POSITION, NORMAL and
+// TEXCOORD_0 attributes. The file is mapped, never parsed beyond its JSON header: when the mesh is
+// a single primitive already laid out like VERTEX_FLOAT (float position | uv | normal interleaved
+// in one 32-byte stride) with 16 or 32-bit indices, the mesh points straight into the mapping and
+// glBufferData uploads it from there. Anything else is converted and goes through buildMesh. Either
+// way it gets the LOD chain loadMesh builds; with levels to add, the zero-copy mesh keeps only its
+// vertices in the mapping and the indices of every level in its storage.
+// Node transforms, materials and external .bin buffers are not supported.
+bool loadGLB(const char* path, Mesh& mesh, VertexFormat format = VERTEX_FLOAT);
+
+#endif
@@ -0,0 +1,164 @@
+// Include standard headers
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+#include <memory>
+
+#include "jobs.hpp"
+
+// Read from every loader thread, so atomic; 0 until the first caller fills in the core count
+static std::atomic<unsigned int> workerCount(0);
+
+unsigned int getWorkerCount() {
+	unsigned int count = workerCount.load();
+	if (count == 0) {
+		unsigned int cores = std::thread::hardware_concurrency();
+		if (cores == 0)
+			cores = 1;
+		// Another thread may have got there first, or setWorkerCount may have; keep theirs
+		if (workerCount.compare_exchange_strong(count, cores))
+			count = cores;
+	}
+	return count;
+}
+
+void setWorkerCount(unsigned int count) {
+	workerCount.store(count);
+}
+
+// Every parallelFor and job queue shares these threads, started on first use and kept until
+// exit, so loaders that split their work while running as jobs add tasks, not threads.
+// Work items run in the order they are posted.
+struct WorkerPool {
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable workSignal;
+	std::deque<std::function<void()> > work;
+	bool stopping;
+
+	WorkerPool() : stopping(false) {}
+	~WorkerPool() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		workSignal.notify_all();
+		for (size_t t = 0; t < threads.size(); t++)
+			threads[t].join();
+	}
+};
+
+static WorkerPool pool;
+
+static void runWorker() {
+	for (;;) {
+		std::function<void()> item;
+		{
+			std::unique_lock<std::mutex> lock(pool.mutex);
+			pool.workSignal.wait(lock, []() { return pool.stopping || !pool.work.empty(); });
+			if (pool.work.empty())
+				return;
+			item = std::move(pool.work.front());
+			pool.work.pop_front();
+		}
+		item();
+	}
+}
+
+// Queues an item, with the pool grown to the worker count first
+static void postWork(std::function<void()> item) {
+	{
+		std::lock_guard<std::mutex> lock(pool.mutex);
+		while (pool.threads.size() < getWorkerCount())
+			pool.threads.push_back(std::thread(runWorker));
+		pool.work.push_back(std::move(item));
+	}
+	pool.workSignal.notify_one();
+}
+
+// One parallelFor call. Helpers posted to the pool may only start once the caller is done, e.g.
+// when the pool is busy with other jobs, so the state outlives the call and a late helper finds
+// no task left; it never touches `task` then.
+struct ParallelFor {
+	const std::function<void(unsigned int)>* task;
+	unsigned int taskCount;
+	std::atomic<unsigned int> nextTask;
+	std::atomic<unsigned int> doneTasks;
+	std::mutex mutex;
+	std::condition_variable doneSignal;
+};
+
+// Tasks are handed out one at a time so uneven chunks still balance
+static void runTasks(ParallelFor& run) {
+	for (unsigned int i = run.nextTask++; i < run.taskCount; i = run.nextTask++) {
+		(*run.task)(i);
+		if (++run.doneTasks == run.taskCount) {
+			std::lock_guard<std::mutex> lock(run.mutex);
+			run.doneSignal.notify_all();
+		}
+	}
+}
+
+void parallelFor(unsigned int taskCount, const std::function<void(unsigned int)>& task) {
+	if (taskCount == 0)
+		return;
+
+	unsigned int threadCount = getWorkerCount();
+	if (threadCount > taskCount)
+		threadCount = taskCount;
+	if (threadCount == 1) {
+		for (unsigned int i = 0; i < taskCount; i++)
+			task(i);
+		return;
+	}
+
+	// The caller works through the tasks too, and only waits for the ones helpers already took.
+	// Called from a pool thread, it therefore finishes even when no other thread is free to help
+	std::shared_ptr<ParallelFor> run = std::make_shared<ParallelFor>();
+	run->task = &task;
+	run->taskCount = taskCount;
+	run->nextTask = 0;
+	run->doneTasks = 0;
+	for (unsigned int i = 1; i < threadCount; i++)
+		postWork([run]() { runTasks(*run); });
+	runTasks(*run);
+
+	std::unique_lock<std::mutex> lock(run->mutex);
+	run->doneSignal.wait(lock, [&run]() { return run->doneTasks.load() == run->taskCount; });
+}
+
+void startJobs(JobQueue& queue, const std::vector<std::function<void()> >& jobs) {
+	queue.jobs = jobs;
+	queue.finished.clear();
+	queue.finished.reserve(jobs.size());
+	queue.collected = 0;
+
+	for (unsigned int i = 0; i < jobs.size(); i++) {
+		postWork([&queue, i]() {
+			queue.jobs[i]();
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			queue.finished.push_back(i);
+			queue.finishedSignal.notify_all();
+		});
+	}
+}
+
+bool waitForJob(JobQueue& queue, unsigned int& index) {
+	if (queue.collected == queue.jobs.size()) {
+		finishJobs(queue);
+		return false;
+	}
+	std::unique_lock<std::mutex> lock(queue.mutex);
+	queue.finishedSignal.wait(lock, [&queue]() { return queue.finished.size() > queue.collected; });
+	index = queue.finished[queue.collected++];
+	return true;
+}
+
+void finishJobs(JobQueue& queue) {
+	std::unique_lock<std::mutex> lock(queue.mutex);
+	queue.finishedSignal.wait(lock, [&queue]() { return queue.finished.size() == queue.jobs.size(); });
+}
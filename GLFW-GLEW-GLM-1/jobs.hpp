@@ -0,0 +1,40 @@
+#ifndef JOBS_HPP
+#define JOBS_HPP
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+// Number of threads the loaders split work across. Defaults to the core count.
+unsigned int getWorkerCount();
+void setWorkerCount(unsigned int count);
+
+// Runs task(0) .. task(taskCount - 1) across the workers and returns when all are done.
+// The calling thread takes part, so taskCount == 1 costs no thread at all. The workers are one
+// pool shared with the job queues, so calling this from a job is fine: idle workers help, and
+// no threads are started for it.
+void parallelFor(unsigned int taskCount, const std::function<void(unsigned int)>& task);
+
+// Jobs that run in the background while the caller keeps working. Workers start them in
+// submission order; the caller collects them in the order they finish.
+struct JobQueue {
+	std::vector<std::function<void()> > jobs;
+	std::mutex mutex;
+	std::condition_variable finishedSignal;
+	std::vector<unsigned int> finished;
+	size_t collected;
+};
+
+void startJobs(JobQueue& queue, const std::vector<std::function<void()> >& jobs);
+
+// Blocks until another job is done and returns its index in `jobs`.
+// Returns false once every job has been collected.
+bool waitForJob(JobQueue& queue, unsigned int& index);
+
+// Waits for whatever is still running, e.g. before bailing out of main().
+void finishJobs(JobQueue& queue);
+
+#endif
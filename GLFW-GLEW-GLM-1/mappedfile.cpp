@@ -0,0 +1,152 @@
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mappedfile.hpp"
+
+bool openMappedFile(const char* path, MappedFile& file) {
+	file.data = NULL;
+	file.size = 0;
+	file.fileHandle = NULL;
+	file.mappingHandle = NULL;
+
+#ifdef _WIN32
+	HANDLE fileHandle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (fileHandle == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(fileHandle, &fileSize)) {
+		CloseHandle(fileHandle);
+		return false;
+	}
+	file.fileHandle = fileHandle;
+	file.size = (size_t)fileSize.QuadPart;
+
+	// Windows refuses to map empty files; an empty view is still a valid file
+	if (file.size == 0)
+		return true;
+
+	HANDLE mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mappingHandle == NULL) {
+		closeMappedFile(file);
+		return false;
+	}
+	file.mappingHandle = mappingHandle;
+
+	file.data = (const char*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+	if (file.data == NULL) {
+		closeMappedFile(file);
+		return false;
+	}
+#else
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		return false;
+	}
+	file.size = (size_t)st.st_size;
+
+	if (file.size > 0) {
+		void* view = mmap(NULL, file.size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (view == MAP_FAILED) {
+			close(fd);
+			file.size = 0;
+			return false;
+		}
+		madvise(view, file.size, MADV_SEQUENTIAL);
+		file.data = (const char*)view;
+	}
+	// The mapping stays valid after the descriptor is closed
+	close(fd);
+#endif
+	return true;
+}
+
+void closeMappedFile(MappedFile& file) {
+#ifdef _WIN32
+	if (file.data)
+		UnmapViewOfFile(file.data);
+	if (file.mappingHandle)
+		CloseHandle((HANDLE)file.mappingHandle);
+	if (file.fileHandle)
+		CloseHandle((HANDLE)file.fileHandle);
+#else
+	if (file.data)
+		munmap((void*)file.data, file.size);
+#endif
+	file.data = NULL;
+	file.size = 0;
+	file.fileHandle = NULL;
+	file.mappingHandle = NULL;
+}
+
+void releaseMappedRange(const MappedFile& file, size_t offset, size_t size) {
+	if (file.data == NULL || offset >= file.size)
+		return;
+	if (size > file.size - offset)
+		size = file.size - offset;
+#ifdef _WIN32
+	// Unlocking pages that were never locked takes them out of the working set
+	VirtualUnlock((LPVOID)(file.data + offset), size);
+#else
+	// madvise wants a page-aligned start; the view itself is page-aligned
+	size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+	size_t alignedOffset = offset & ~(pageSize - 1);
+	madvise((void*)(file.data + alignedOffset), size + (offset - alignedOffset), MADV_DONTNEED);
+#endif
+}
+
+bool statFile(const char* path, unsigned long long& size, long long& modifiedTime) {
+#ifdef _WIN32
+	struct _stat64 st;
+	if (_stat64(path, &st) != 0)
+		return false;
+#else
+	struct stat st;
+	if (stat(path, &st) != 0)
+		return false;
+#endif
+	size = (unsigned long long)st.st_size;
+	modifiedTime = (long long)st.st_mtime;
+	return true;
+}
+
+// 64-bit multiply/xorshift hash, 8 bytes per step; only used to tell whether a source changed.
+static uint64_t hashBytes(const char* data, size_t size) {
+	uint64_t h = 0x9E3779B97F4A7C15ull ^ size;
+	size_t i = 0;
+	for (; i + 8 <= size; i += 8) {
+		uint64_t k;
+		memcpy(&k, data + i, 8);
+		k *= 0x87C37B91114253D5ull;
+		k ^= k >> 31;
+		h = (h ^ k) * 0x4CF5AD432745937Full;
+	}
+	for (; i < size; i++)
+		h = (h ^ (unsigned char)data[i]) * 0x100000001B3ull;
+	return h ^ (h >> 29);
+}
+
+bool hashFile(const char* path, unsigned long long& hash) {
+	MappedFile file;
+	if (!openMappedFile(path, file))
+		return false;
+	hash = hashBytes(file.data, file.size);
+	closeMappedFile(file);
+	return true;
+}
@@ -0,0 +1,28 @@
+#ifndef MAPPEDFILE_HPP
+#define MAPPEDFILE_HPP
+
+#include <stddef.h>
+
+// Read-only view of a whole file mapped into memory.
+// data/size are valid between openMappedFile and closeMappedFile.
+struct MappedFile {
+	const char* data;
+	size_t size;
+	void* fileHandle;
+	void* mappingHandle;
+};
+
+bool openMappedFile(const char* path, MappedFile& file);
+void closeMappedFile(MappedFile& file);
+
+// Drops the pages of [offset, offset + size) from the resident set. The view stays valid;
+// touching the range again reads it back from the file. For files bigger than memory.
+void releaseMappedRange(const MappedFile& file, size_t offset, size_t size);
+
+// Size and last modification time (seconds since the epoch) of a file, without opening it.
+bool statFile(const char* path, unsigned long long& size, long long& modifiedTime);
+
+// Hash of a file's contents, for caches to tell whether their source changed when its mtime did.
+bool hashFile(const char* path, unsigned long long& hash);
+
+#endif
@@ -0,0 +1,452 @@
+// Include standard headers
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <string>
+#include <chrono>
+
+// Include GLM
+#include <glm/glm.hpp>
+
+#include "mappedfile.hpp"
+#include "objloader.hpp"
+#include "meshopt.hpp"
+#include "mesh.hpp"
+
+// Binary mesh cache, written next to the source as <path>.meshcache.
+// Layout (native endianness, every stream 16-byte aligned):
+//   MeshCacheHeader | interleaved vertices | indices (u16 or u32)
+// with the vertices in the VertexFormat recorded in the header. The index stream holds every
+// level of detail back to back; the header lists their ranges.
+// The header keys the cache to the source file: size + mtime are checked on every load,
+// the content hash only when the mtime moved (e.g. after a fresh checkout).
+struct MeshCacheHeader {
+	char magic[4];
+	uint32_t version;
+	uint64_t sourceSize;
+	int64_t sourceTime;
+	uint64_t sourceHash;
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	uint32_t indexSize;
+	uint32_t format;
+	float boundsMin[3];
+	float boundsMax[3];
+	float sphereCentre[3];
+	float sphereRadius;
+	float uvBoundsMin[2];
+	float uvBoundsMax[2];
+	uint32_t lodCount;
+	uint32_t lodIndexOffset[maxMeshLODs];
+	uint32_t lodIndexCount[maxMeshLODs];
+	float lodError[maxMeshLODs];
+	uint64_t vertexOffset;
+	uint64_t indexOffset;
+};
+
+static const char meshCacheMagic[4] = { 'M', 'E', 'S', 'H' };
+static const uint32_t meshCacheVersion = 6;
+
+static inline uint64_t alignOffset(uint64_t offset) {
+	return (offset + 15) & ~(uint64_t)15;
+}
+
+unsigned int getVertexSizes(VertexFormat format, unsigned int& positionSize, unsigned int& uvSize, unsigned int& normalSize) {
+	if (format == VERTEX_QUANTIZED) {
+		positionSize = 4 * sizeof(unsigned short);
+		uvSize = 2 * sizeof(unsigned short);
+		normalSize = 2 * sizeof(short);
+	}
+	else {
+		positionSize = sizeof(glm::vec3);
+		uvSize = sizeof(glm::vec2);
+		normalSize = sizeof(glm::vec3);
+	}
+	return positionSize + uvSize + normalSize;
+}
+
+static void setVertexSizes(Mesh& mesh, VertexFormat format) {
+	mesh.format = format;
+	mesh.vertexSize = getVertexSizes(format, mesh.positionSize, mesh.uvSize, mesh.normalSize);
+}
+
+void initMesh(Mesh& mesh) {
+	setVertexSizes(mesh, VERTEX_FLOAT);
+	mesh.vertices = NULL;
+	mesh.indices = NULL;
+	mesh.vertexCount = 0;
+	mesh.indexCount = 0;
+	mesh.indexSize = 0;
+	mesh.boundsMin = glm::vec3(0.0f);
+	mesh.boundsMax = glm::vec3(0.0f);
+	mesh.sphereCentre = glm::vec3(0.0f);
+	mesh.sphereRadius = 0.0f;
+	mesh.uvBoundsMin = glm::vec2(0.0f);
+	mesh.uvBoundsMax = glm::vec2(0.0f);
+	memset(&mesh.lods, 0, sizeof(mesh.lods));
+	mesh.file.data = NULL;
+	mesh.file.size = 0;
+	mesh.file.fileHandle = NULL;
+	mesh.file.mappingHandle = NULL;
+	std::vector<unsigned char>().swap(mesh.vertexStorage);
+	std::vector<unsigned char>().swap(mesh.indexStorage);
+}
+
+static bool writeMeshCache(const char* cachePath, MeshCacheHeader header, const Mesh& mesh) {
+	uint64_t sizes[2] = {
+		(uint64_t)mesh.vertexCount * mesh.vertexSize,
+		(uint64_t)mesh.indexCount * mesh.indexSize
+	};
+	const void* streams[2] = { mesh.vertices, mesh.indices };
+	uint64_t* offsets[2] = { &header.vertexOffset, &header.indexOffset };
+
+	uint64_t offset = alignOffset(sizeof(MeshCacheHeader));
+	for (int i = 0; i < 2; i++) {
+		*offsets[i] = offset;
+		offset = alignOffset(offset + sizes[i]);
+	}
+
+	// Write to a temporary name first so a crash never leaves a half-written cache behind
+	std::string tempPath = std::string(cachePath) + ".tmp";
+	FILE* file = fopen(tempPath.c_str(), "wb");
+	if (file == NULL)
+		return false;
+
+	static const char padding[16] = { 0 };
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+	uint64_t written = sizeof(header);
+	for (int i = 0; i < 2 && ok; i++) {
+		ok = fwrite(padding, 1, (size_t)(*offsets[i] - written), file) == *offsets[i] - written;
+		ok = ok && (sizes[i] == 0 || fwrite(streams[i], 1, (size_t)sizes[i], file) == sizes[i]);
+		written = *offsets[i] + sizes[i];
+	}
+	ok = fclose(file) == 0 && ok;
+
+	remove(cachePath);
+	if (!ok || rename(tempPath.c_str(), cachePath) != 0) {
+		remove(tempPath.c_str());
+		return false;
+	}
+	return true;
+}
+
+// Maps a cache and points the mesh at its streams after checking they are all inside the file.
+// Is every index a vertex of the mesh? The draw takes the indices as they are, so a corrupt cache
+// must not get past this with one that points outside the vertex buffer.
+static bool indicesInRange(const unsigned char* indices, uint32_t indexCount, uint32_t indexSize, uint32_t vertexCount) {
+	uint32_t largest = 0;
+	if (indexSize == 2) {
+		const uint16_t* index = (const uint16_t*)indices;
+		for (uint32_t i = 0; i < indexCount; i++)
+			largest = index[i] > largest ? index[i] : largest;
+	}
+	else {
+		const uint32_t* index = (const uint32_t*)indices;
+		for (uint32_t i = 0; i < indexCount; i++)
+			largest = index[i] > largest ? index[i] : largest;
+	}
+	return indexCount == 0 || largest < vertexCount;
+}
+
+static bool openMeshCache(const char* cachePath, Mesh& mesh) {
+	if (!openMappedFile(cachePath, mesh.file))
+		return false;
+
+	const MeshCacheHeader* header = (const MeshCacheHeader*)mesh.file.data;
+	bool valid = mesh.file.size >= sizeof(MeshCacheHeader)
+		&& memcmp(header->magic, meshCacheMagic, 4) == 0
+		&& header->version == meshCacheVersion
+		&& (header->format == VERTEX_FLOAT || header->format == VERTEX_QUANTIZED)
+		&& (header->indexSize == 2 || header->indexSize == 4);
+	if (valid) {
+		setVertexSizes(mesh, (VertexFormat)header->format);
+		uint64_t size = mesh.file.size;
+		// Offsets come first, so a corrupt one cannot wrap the sum past the size
+		valid = header->vertexOffset <= size && (uint64_t)header->vertexCount * mesh.vertexSize <= size - header->vertexOffset
+			&& header->indexOffset <= size && (uint64_t)header->indexCount * header->indexSize <= size - header->indexOffset
+			&& header->lodCount >= 1 && header->lodCount <= maxMeshLODs;
+		for (uint32_t l = 0; valid && l < header->lodCount; l++)
+			valid = (uint64_t)header->lodIndexOffset[l] + header->lodIndexCount[l] <= header->indexCount;
+		if (valid)
+			valid = indicesInRange((const unsigned char*)mesh.file.data + header->indexOffset, header->indexCount, header->indexSize, header->vertexCount);
+	}
+	if (!valid) {
+		closeMappedFile(mesh.file);
+		return false;
+	}
+
+	mesh.vertices = mesh.file.data + header->vertexOffset;
+	mesh.indices = mesh.file.data + header->indexOffset;
+	mesh.vertexCount = header->vertexCount;
+	mesh.indexCount = header->indexCount;
+	mesh.indexSize = header->indexSize;
+	mesh.boundsMin = glm::vec3(header->boundsMin[0], header->boundsMin[1], header->boundsMin[2]);
+	mesh.boundsMax = glm::vec3(header->boundsMax[0], header->boundsMax[1], header->boundsMax[2]);
+	mesh.sphereCentre = glm::vec3(header->sphereCentre[0], header->sphereCentre[1], header->sphereCentre[2]);
+	mesh.sphereRadius = header->sphereRadius;
+	mesh.uvBoundsMin = glm::vec2(header->uvBoundsMin[0], header->uvBoundsMin[1]);
+	mesh.uvBoundsMax = glm::vec2(header->uvBoundsMax[0], header->uvBoundsMax[1]);
+	mesh.lods.count = header->lodCount;
+	for (uint32_t l = 0; l < header->lodCount; l++) {
+		mesh.lods.indexOffset[l] = header->lodIndexOffset[l];
+		mesh.lods.indexCount[l] = header->lodIndexCount[l];
+		mesh.lods.error[l] = header->lodError[l];
+	}
+	return true;
+}
+
+// Records a new source mtime in an existing cache, so the content hash is not redone every run.
+static void touchMeshCache(const char* cachePath, long long sourceTime) {
+	FILE* file = fopen(cachePath, "r+b");
+	if (file == NULL)
+		return;
+	int64_t time = sourceTime;
+	if (fseek(file, offsetof(MeshCacheHeader, sourceTime), SEEK_SET) == 0)
+		fwrite(&time, sizeof(time), 1, file);
+	fclose(file);
+}
+
+// Copies the per-attribute arrays into position | uv | normal vertices.
+static void interleaveVertices(unsigned char* vertex, size_t count, unsigned int positionSize, unsigned int uvSize, unsigned int normalSize, const void* positions, const void* uvs, const void* normals) {
+	for (size_t i = 0; i < count; i++) {
+		memcpy(vertex, (const unsigned char*)positions + i * positionSize, positionSize);
+		vertex += positionSize;
+		memcpy(vertex, (const unsigned char*)uvs + i * uvSize, uvSize);
+		vertex += uvSize;
+		memcpy(vertex, (const unsigned char*)normals + i * normalSize, normalSize);
+		vertex += normalSize;
+	}
+}
+
+void packVertices(
+	VertexFormat format,
+	const std::vector<glm::vec3>& vertices,
+	const std::vector<glm::vec2>& uvs,
+	const std::vector<glm::vec3>& normals,
+	const glm::vec3& boundsMin,
+	const glm::vec3& boundsMax,
+	const glm::vec2& uvBoundsMin,
+	const glm::vec2& uvBoundsMax,
+	std::vector<unsigned char>& out_vertices
+) {
+	unsigned int positionSize, uvSize, normalSize;
+	unsigned int vertexSize = getVertexSizes(format, positionSize, uvSize, normalSize);
+	out_vertices.resize(vertices.size() * vertexSize);
+	if (format == VERTEX_QUANTIZED) {
+		std::vector<unsigned short> quantizedPositions, quantizedUVs;
+		std::vector<short> encodedNormals;
+		quantizePositions(vertices, boundsMin, boundsMax, quantizedPositions);
+		quantizeUVs(uvs, uvBoundsMin, uvBoundsMax, quantizedUVs);
+		encodeNormals(normals, encodedNormals);
+		interleaveVertices(out_vertices.data(), vertices.size(), positionSize, uvSize, normalSize, quantizedPositions.data(), quantizedUVs.data(), encodedNormals.data());
+	}
+	else {
+		interleaveVertices(out_vertices.data(), vertices.size(), positionSize, uvSize, normalSize, vertices.data(), uvs.data(), normals.data());
+	}
+}
+
+void buildMesh(
+	const char* name,
+	std::vector<std::vector<unsigned int> >& levels,
+	const std::vector<float>& errors,
+	std::vector<glm::vec3>& vertices,
+	std::vector<glm::vec2>& uvs,
+	std::vector<glm::vec3>& normals,
+	VertexFormat format,
+	Mesh& mesh
+) {
+	initMesh(mesh);
+
+	// Triangle order of every level for the post-transform cache; all levels go into one
+	// index buffer, level 0 first so the vertex fetch order follows it
+	std::vector<unsigned int> indices;
+	float acmrBefore, atvrBefore, acmrAfter, atvrAfter;
+	computeCacheStatistics(levels[0], vertices.size(), acmrBefore, atvrBefore);
+	mesh.lods.count = (unsigned int)levels.size();
+	printf("LODs of %s:", name);
+	for (size_t l = 0; l < levels.size(); l++) {
+		optimizeVertexCache(levels[l], vertices);
+		mesh.lods.indexOffset[l] = (unsigned int)indices.size();
+		mesh.lods.indexCount[l] = (unsigned int)levels[l].size();
+		mesh.lods.error[l] = errors[l];
+		indices.insert(indices.end(), levels[l].begin(), levels[l].end());
+		printf(" %u tris (error %g)", mesh.lods.indexCount[l] / 3, errors[l]);
+	}
+	printf("\n");
+
+	optimizeVertexFetch(indices, vertices, uvs, normals);
+	std::vector<unsigned int> finest(indices.begin(), indices.begin() + mesh.lods.indexCount[0]);
+	computeCacheStatistics(finest, vertices.size(), acmrAfter, atvrAfter);
+	printf("Optimized %s: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f (%u-entry FIFO)\n", name, acmrBefore, acmrAfter, atvrBefore, atvrAfter, vertexCacheSize);
+
+	setVertexSizes(mesh, format);
+	mesh.vertexCount = (unsigned int)vertices.size();
+	mesh.indexCount = (unsigned int)indices.size();
+	mesh.indexSize = mesh.vertexCount <= 65536 ? 2 : 4;
+	mesh.indexStorage.resize((size_t)mesh.indexCount * mesh.indexSize);
+	if (mesh.indexSize == 2) {
+		unsigned short* shortIndices = (unsigned short*)mesh.indexStorage.data();
+		for (size_t i = 0; i < indices.size(); i++)
+			shortIndices[i] = (unsigned short)indices[i];
+	}
+	else if (!indices.empty()) {
+		memcpy(mesh.indexStorage.data(), indices.data(), indices.size() * sizeof(unsigned int));
+	}
+
+	computeBounds(vertices, mesh.boundsMin, mesh.boundsMax, mesh.sphereCentre, mesh.sphereRadius);
+	if (mesh.vertexCount > 0) {
+		mesh.uvBoundsMin = mesh.uvBoundsMax = uvs[0];
+		for (size_t i = 1; i < uvs.size(); i++) {
+			mesh.uvBoundsMin = glm::min(mesh.uvBoundsMin, uvs[i]);
+			mesh.uvBoundsMax = glm::max(mesh.uvBoundsMax, uvs[i]);
+		}
+	}
+
+	packVertices(format, vertices, uvs, normals, mesh.boundsMin, mesh.boundsMax, mesh.uvBoundsMin, mesh.uvBoundsMax, mesh.vertexStorage);
+	if (format == VERTEX_QUANTIZED) {
+		size_t floatBytes = vertices.size() * (sizeof(glm::vec3) + sizeof(glm::vec2) + sizeof(glm::vec3));
+		size_t quantizedBytes = vertices.size() * mesh.vertexSize;
+		printf("Quantized %s: vertex data %.1f KB -> %.1f KB (saved %.1f KB)\n", name, floatBytes / 1024.0, quantizedBytes / 1024.0, (floatBytes - quantizedBytes) / 1024.0);
+	}
+
+	mesh.vertices = mesh.vertexStorage.data();
+	mesh.indices = mesh.indexStorage.data();
+}
+
+// Parses the OBJ and simplifies its levels of detail, then packs it in the requested format.
+static bool cookMesh(const char* path, VertexFormat format, Mesh& mesh) {
+	std::vector<unsigned int> indices;
+	std::vector<glm::vec3> vertices;
+	std::vector<glm::vec2> uvs;
+	std::vector<glm::vec3> normals;
+	if (!loadIndexedOBJ(path, indices, vertices, uvs, normals))
+		return false;
+
+	std::vector<std::vector<unsigned int> > levels;
+	std::vector<float> errors;
+	buildLODChain(indices, vertices, maxMeshLODs, levels, errors);
+	buildMesh(path, levels, errors, vertices, uvs, normals, format, mesh);
+	return true;
+}
+
+bool loadMesh(const char* path, Mesh& mesh, VertexFormat format) {
+	std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+	initMesh(mesh);
+
+	std::string cachePath = std::string(path) + ".meshcache";
+	unsigned long long sourceSize = 0;
+	long long sourceTime = 0;
+	bool haveSource = statFile(path, sourceSize, sourceTime);
+
+	if (openMeshCache(cachePath.c_str(), mesh)) {
+		const MeshCacheHeader* header = (const MeshCacheHeader*)mesh.file.data;
+
+		// A cache without its source is fine: ship the cache, not the OBJ
+		bool fresh = !haveSource || (header->sourceSize == sourceSize && header->sourceTime == sourceTime);
+		if (!fresh && header->sourceSize == sourceSize) {
+			unsigned long long sourceHash;
+			if (hashFile(path, sourceHash) && sourceHash == header->sourceHash) {
+				closeMappedFile(mesh.file);
+				touchMeshCache(cachePath.c_str(), sourceTime);
+				fresh = openMeshCache(cachePath.c_str(), mesh);
+			}
+		}
+		// A different format is only re-cooked when the source is around to cook it from
+		if (fresh && mesh.format != format && haveSource)
+			fresh = false;
+
+		if (fresh) {
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+			printf("Loaded %s from its cache: %u vertices, %u indices in %.2f ms\n", path, mesh.vertexCount, mesh.indexCount, ms);
+			return true;
+		}
+		closeMappedFile(mesh.file);
+		initMesh(mesh);
+	}
+
+	if (!cookMesh(path, format, mesh))
+		return false;
+
+	MeshCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, meshCacheMagic, 4);
+	header.version = meshCacheVersion;
+	header.sourceSize = sourceSize;
+	header.sourceTime = sourceTime;
+	unsigned long long sourceHash = 0;
+	hashFile(path, sourceHash);
+	header.sourceHash = sourceHash;
+	header.vertexCount = mesh.vertexCount;
+	header.indexCount = mesh.indexCount;
+	header.indexSize = mesh.indexSize;
+	header.format = mesh.format;
+	for (int i = 0; i < 3; i++) {
+		header.boundsMin[i] = mesh.boundsMin[i];
+		header.boundsMax[i] = mesh.boundsMax[i];
+		header.sphereCentre[i] = mesh.sphereCentre[i];
+	}
+	header.sphereRadius = mesh.sphereRadius;
+	for (int i = 0; i < 2; i++) {
+		header.uvBoundsMin[i] = mesh.uvBoundsMin[i];
+		header.uvBoundsMax[i] = mesh.uvBoundsMax[i];
+	}
+	header.lodCount = mesh.lods.count;
+	for (unsigned int l = 0; l < mesh.lods.count; l++) {
+		header.lodIndexOffset[l] = mesh.lods.indexOffset[l];
+		header.lodIndexCount[l] = mesh.lods.indexCount[l];
+		header.lodError[l] = mesh.lods.error[l];
+	}
+
+	// Serve even the first load from the mapping, so both paths upload the same way
+	Mesh cached;
+	initMesh(cached);
+	if (writeMeshCache(cachePath.c_str(), header, mesh) && openMeshCache(cachePath.c_str(), cached)) {
+		mesh.file = cached.file;
+		mesh.vertices = cached.vertices;
+		mesh.indices = cached.indices;
+		std::vector<unsigned char>().swap(mesh.vertexStorage);
+		std::vector<unsigned char>().swap(mesh.indexStorage);
+	}
+	else {
+		printf("Could not write %s, keeping the mesh in memory\n", cachePath.c_str());
+	}
+
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+	printf("Cooked %s: %u vertices, %u indices in %.2f ms\n", path, mesh.vertexCount, mesh.indexCount, ms);
+	return true;
+}
+
+void freeMesh(Mesh& mesh) {
+	closeMappedFile(mesh.file);
+	initMesh(mesh);
+}
+
+void getDequantization(const Mesh& mesh, glm::vec3& positionScale, glm::vec3& positionOffset, glm::vec2& uvScale, glm::vec2& uvOffset) {
+	if (mesh.format == VERTEX_QUANTIZED) {
+		positionScale = mesh.boundsMax - mesh.boundsMin;
+		positionOffset = mesh.boundsMin;
+		uvScale = mesh.uvBoundsMax - mesh.uvBoundsMin;
+		uvOffset = mesh.uvBoundsMin;
+	}
+	else {
+		positionScale = glm::vec3(1.0f);
+		positionOffset = glm::vec3(0.0f);
+		uvScale = glm::vec2(1.0f);
+		uvOffset = glm::vec2(0.0f);
+	}
+}
+
+unsigned int selectLOD(const MeshLODs& lods, unsigned int current, float pixelsPerUnit) {
+	if (lods.count == 0)
+		return 0;
+	unsigned int level = current < lods.count ? current : lods.count - 1;
+	// Refine as soon as the current level's error shows...
+	while (level > 0 && lods.error[level] * pixelsPerUnit > lodPixelError)
+		level--;
+	// ...but only coarsen once the next level is comfortably below the threshold
+	while (level + 1 < lods.count && lods.error[level + 1] * pixelsPerUnit < lodPixelError * (1.0f - lodHysteresis))
+		level++;
+	return level;
+}
@@ -0,0 +1,108 @@
+#ifndef MESH_HPP
+#define MESH_HPP
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "mappedfile.hpp"
+
+// How the vertex attributes of a mesh are stored, in the cache and in the VBO.
+// Either way they are interleaved per vertex: position | uv | normal.
+enum VertexFormat {
+	// vec3 positions, vec2 uvs, vec3 normals: 32 bytes per vertex
+	VERTEX_FLOAT,
+	// unorm16 x4 positions within the bounds (w unused, keeps 4-byte alignment),
+	// unorm16 x2 uvs within the uv bounds, octahedral snorm16 x2 normals: 16 bytes per vertex
+	VERTEX_QUANTIZED
+};
+
+// Bytes of each attribute of a vertex in the given format; returns the whole vertex size.
+unsigned int getVertexSizes(VertexFormat format, unsigned int& positionSize, unsigned int& uvSize, unsigned int& normalSize);
+
+// Levels of detail are index ranges within one index buffer over the shared vertices, finest first.
+const unsigned int maxMeshLODs = 6;
+struct MeshLODs {
+	unsigned int count;
+	unsigned int indexOffset[maxMeshLODs]; // in indices, not bytes
+	unsigned int indexCount[maxMeshLODs];
+	float error[maxMeshLODs]; // deviation from level 0 in model units
+};
+
+// An indexed mesh ready to be handed to glBufferData: one interleaved vertex buffer, one index buffer.
+// Both point into the mapped binary cache of the source file, or into the storage vectors
+// below when the cache could not be written.
+struct Mesh {
+	VertexFormat format;
+	const void* vertices;
+	const void* indices;
+	unsigned int vertexCount;
+	unsigned int indexCount;
+	unsigned int indexSize; // 2 or 4 bytes, for GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+	unsigned int vertexSize; // stride of the interleaved vertices
+	unsigned int positionSize, uvSize, normalSize; // bytes of each attribute, in that order in a vertex
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+	glm::vec3 sphereCentre; // bounding sphere, in model space
+	float sphereRadius;
+	glm::vec2 uvBoundsMin;
+	glm::vec2 uvBoundsMax;
+	MeshLODs lods;
+
+	MappedFile file;
+	std::vector<unsigned char> vertexStorage;
+	std::vector<unsigned char> indexStorage;
+};
+
+// Loads an OBJ through its binary cache (path + ".meshcache"). The first load parses the OBJ
+// and writes the cache; later loads only map it, as long as the OBJ and the format are unchanged.
+bool loadMesh(const char* path, Mesh& mesh, VertexFormat format = VERTEX_FLOAT);
+
+// Empties every field, releasing nothing; for meshes filled in by hand.
+void initMesh(Mesh& mesh);
+
+// Builds a mesh from arrays in memory, for sources other than OBJ files (and for the OBJ cook).
+// levels[0] is the full index list and every further level indexes the same vertices, with
+// errors[l] its deviation from level 0. Each level is reordered for the vertex cache, the
+// vertices for linear fetch, then everything is packed into the mesh's storage in the given
+// format. The arrays are consumed; the mesh is overwritten.
+void buildMesh(
+	const char* name,
+	std::vector<std::vector<unsigned int> >& levels,
+	const std::vector<float>& errors,
+	std::vector<glm::vec3>& vertices,
+	std::vector<glm::vec2>& uvs,
+	std::vector<glm::vec3>& normals,
+	VertexFormat format,
+	Mesh& mesh
+);
+
+// Interleaves per-attribute arrays into vertices of the given format. Quantized positions and
+// uvs are stored relative to the given bounds, which must contain them.
+void packVertices(
+	VertexFormat format,
+	const std::vector<glm::vec3>& vertices,
+	const std::vector<glm::vec2>& uvs,
+	const std::vector<glm::vec3>& normals,
+	const glm::vec3& boundsMin,
+	const glm::vec3& boundsMax,
+	const glm::vec2& uvBoundsMin,
+	const glm::vec2& uvBoundsMax,
+	std::vector<unsigned char>& out_vertices
+);
+
+// Releases the CPU copy; call once the buffers are uploaded.
+void freeMesh(Mesh& mesh);
+
+// Uniforms that turn the stored attributes back into model space in the vertex shader:
+// position = positionOffset + positionScale * attribute, uv = uvOffset + uvScale * attribute.
+// Identity for VERTEX_FLOAT meshes.
+void getDequantization(const Mesh& mesh, glm::vec3& positionScale, glm::vec3& positionOffset, glm::vec2& uvScale, glm::vec2& uvOffset);
+
+// Level to draw this frame: the coarsest whose error stays under lodPixelError on screen.
+// pixelsPerUnit is the on-screen size of one model unit at the object's distance; current is
+// last frame's level, which is only left for a coarser one with lodHysteresis to spare.
+const float lodPixelError = 1.0f;
+const float lodHysteresis = 0.25f;
+unsigned int selectLOD(const MeshLODs& lods, unsigned int current, float pixelsPerUnit);
+
+#endif
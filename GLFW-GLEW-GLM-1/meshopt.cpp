@@ -0,0 +1,666 @@
+// Include standard headers
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include <algorithm>
+
+// Include GLM
+#include <glm/glm.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MESHOPT_SSE2
+#endif
+
+#include "meshopt.hpp"
+
+// Overdraw ordering may cost at most this much ACMR over the cache-only order.
+static const float overdrawThreshold = 1.05f;
+
+// Vertex -> triangles adjacency in compressed rows.
+struct TriangleAdjacency {
+	std::vector<unsigned int> offsets;
+	std::vector<unsigned int> triangles;
+};
+
+static void buildAdjacency(const std::vector<unsigned int>& indices, size_t vertexCount, TriangleAdjacency& adjacency) {
+	adjacency.offsets.assign(vertexCount + 1, 0);
+	for (size_t i = 0; i < indices.size(); i++)
+		adjacency.offsets[indices[i] + 1]++;
+	for (size_t v = 0; v < vertexCount; v++)
+		adjacency.offsets[v + 1] += adjacency.offsets[v];
+
+	std::vector<unsigned int> fill(adjacency.offsets.begin(), adjacency.offsets.end() - 1);
+	adjacency.triangles.resize(indices.size());
+	for (size_t i = 0; i < indices.size(); i++)
+		adjacency.triangles[fill[indices[i]]++] = (unsigned int)(i / 3);
+}
+
+// Tipsify: fan around the current vertex, then pick the next fanning vertex among the ones
+// just emitted, preferring those that will still be in the cache once their fan is done.
+static void tipsify(const std::vector<unsigned int>& indices, size_t vertexCount, unsigned int cacheSize, std::vector<unsigned int>& out_indices) {
+	size_t triangleCount = indices.size() / 3;
+	TriangleAdjacency adjacency;
+	buildAdjacency(indices, vertexCount, adjacency);
+
+	std::vector<unsigned int> liveTriangles(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++)
+		liveTriangles[v] = adjacency.offsets[v + 1] - adjacency.offsets[v];
+
+	std::vector<unsigned int> cacheTime(vertexCount, 0);
+	std::vector<char> emitted(triangleCount, 0);
+	std::vector<unsigned int> deadEnd;
+	std::vector<unsigned int> candidates;
+	deadEnd.reserve(indices.size());
+	out_indices.clear();
+	out_indices.reserve(indices.size());
+
+	unsigned int time = cacheSize + 1;
+	size_t cursor = 0;
+	long long fanning = vertexCount > 0 ? 0 : -1;
+
+	while (fanning >= 0) {
+		candidates.clear();
+
+		for (unsigned int a = adjacency.offsets[fanning]; a < adjacency.offsets[fanning + 1]; a++) {
+			unsigned int triangle = adjacency.triangles[a];
+			if (emitted[triangle])
+				continue;
+			for (int k = 0; k < 3; k++) {
+				unsigned int v = indices[triangle * 3 + k];
+				out_indices.push_back(v);
+				deadEnd.push_back(v);
+				candidates.push_back(v);
+				liveTriangles[v]--;
+				if (time - cacheTime[v] > cacheSize)
+					cacheTime[v] = time++;
+			}
+			emitted[triangle] = 1;
+		}
+
+		// Next vertex: the candidate with live triangles that stays in the cache the longest
+		long long next = -1;
+		int best = -1;
+		for (size_t c = 0; c < candidates.size(); c++) {
+			unsigned int v = candidates[c];
+			if (liveTriangles[v] == 0)
+				continue;
+			int priority = 0;
+			if (time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize)
+				priority = (int)(time - cacheTime[v]);
+			if (priority > best) {
+				best = priority;
+				next = v;
+			}
+		}
+
+		// Dead end: back up through recently emitted vertices, then scan in input order
+		while (next < 0 && !deadEnd.empty()) {
+			unsigned int v = deadEnd.back();
+			deadEnd.pop_back();
+			if (liveTriangles[v] > 0)
+				next = v;
+		}
+		while (next < 0 && cursor < vertexCount) {
+			if (liveTriangles[cursor] > 0)
+				next = (long long)cursor;
+			cursor++;
+		}
+		fanning = next;
+	}
+}
+
+// Splits the triangle order where the cache goes completely cold and sorts those clusters so the
+// ones facing away from the mesh centre are drawn first; they are the likeliest occluders.
+static void sortClustersForOverdraw(std::vector<unsigned int>& indices, const std::vector<glm::vec3>& vertices, unsigned int cacheSize) {
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0)
+		return;
+
+	std::vector<size_t> clusterStarts;
+	std::vector<unsigned int> cache(cacheSize, ~0u);
+	size_t head = 0;
+	for (size_t t = 0; t < triangleCount; t++) {
+		int misses = 0;
+		for (int k = 0; k < 3; k++) {
+			unsigned int v = indices[t * 3 + k];
+			if (std::find(cache.begin(), cache.end(), v) == cache.end()) {
+				cache[head] = v;
+				head = (head + 1) % cacheSize;
+				misses++;
+			}
+		}
+		if (misses == 3 || t == 0)
+			clusterStarts.push_back(t);
+	}
+	clusterStarts.push_back(triangleCount);
+	size_t clusterCount = clusterStarts.size() - 1;
+	if (clusterCount < 2)
+		return;
+
+	glm::vec3 meshCentre(0.0f);
+	float meshArea = 0.0f;
+	std::vector<glm::vec3> clusterCentres(clusterCount, glm::vec3(0.0f));
+	std::vector<glm::vec3> clusterNormals(clusterCount, glm::vec3(0.0f));
+	std::vector<float> clusterAreas(clusterCount, 0.0f);
+	for (size_t c = 0; c < clusterCount; c++) {
+		for (size_t t = clusterStarts[c]; t < clusterStarts[c + 1]; t++) {
+			const glm::vec3& a = vertices[indices[t * 3 + 0]];
+			const glm::vec3& b = vertices[indices[t * 3 + 1]];
+			const glm::vec3& d = vertices[indices[t * 3 + 2]];
+			glm::vec3 normal = glm::cross(b - a, d - a);
+			float area = glm::length(normal);
+			glm::vec3 centre = (a + b + d) / 3.0f;
+			clusterCentres[c] += centre * area;
+			clusterNormals[c] += normal;
+			clusterAreas[c] += area;
+		}
+		meshCentre += clusterCentres[c];
+		meshArea += clusterAreas[c];
+	}
+	if (meshArea > 0.0f)
+		meshCentre = meshCentre / meshArea;
+
+	std::vector<float> sortKeys(clusterCount);
+	for (size_t c = 0; c < clusterCount; c++) {
+		glm::vec3 centre = clusterAreas[c] > 0.0f ? clusterCentres[c] / clusterAreas[c] : meshCentre;
+		float normalLength = glm::length(clusterNormals[c]);
+		sortKeys[c] = normalLength > 0.0f ? glm::dot(centre - meshCentre, clusterNormals[c] / normalLength) : 0.0f;
+	}
+
+	std::vector<unsigned int> order(clusterCount);
+	for (size_t c = 0; c < clusterCount; c++)
+		order[c] = (unsigned int)c;
+	std::stable_sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) {
+		return sortKeys[a] > sortKeys[b];
+	});
+
+	std::vector<unsigned int> sorted;
+	sorted.reserve(indices.size());
+	for (size_t c = 0; c < clusterCount; c++) {
+		size_t cluster = order[c];
+		sorted.insert(sorted.end(), indices.begin() + clusterStarts[cluster] * 3, indices.begin() + clusterStarts[cluster + 1] * 3);
+	}
+	indices.swap(sorted);
+}
+
+void optimizeVertexCache(
+	std::vector<unsigned int>& indices,
+	const std::vector<glm::vec3>& vertices
+) {
+	std::vector<unsigned int> cacheOrder;
+	tipsify(indices, vertices.size(), vertexCacheSize, cacheOrder);
+
+	std::vector<unsigned int> overdrawOrder(cacheOrder);
+	sortClustersForOverdraw(overdrawOrder, vertices, vertexCacheSize);
+
+	float cacheAcmr, overdrawAcmr, atvr;
+	computeCacheStatistics(cacheOrder, vertices.size(), cacheAcmr, atvr);
+	computeCacheStatistics(overdrawOrder, vertices.size(), overdrawAcmr, atvr);
+	if (overdrawAcmr <= cacheAcmr * overdrawThreshold)
+		indices.swap(overdrawOrder);
+	else
+		indices.swap(cacheOrder);
+}
+
+void optimizeVertexFetch(
+	std::vector<unsigned int>& indices,
+	std::vector<glm::vec3>& vertices,
+	std::vector<glm::vec2>& uvs,
+	std::vector<glm::vec3>& normals
+) {
+	std::vector<unsigned int> remap(vertices.size(), ~0u);
+	unsigned int nextVertex = 0;
+	for (size_t i = 0; i < indices.size(); i++) {
+		unsigned int& slot = remap[indices[i]];
+		if (slot == ~0u)
+			slot = nextVertex++;
+		indices[i] = slot;
+	}
+
+	std::vector<glm::vec3> newVertices(nextVertex);
+	std::vector<glm::vec2> newUVs(nextVertex);
+	std::vector<glm::vec3> newNormals(nextVertex);
+	for (size_t v = 0; v < remap.size(); v++) {
+		if (remap[v] == ~0u)
+			continue;
+		newVertices[remap[v]] = vertices[v];
+		newUVs[remap[v]] = uvs[v];
+		newNormals[remap[v]] = normals[v];
+	}
+	vertices.swap(newVertices);
+	uvs.swap(newUVs);
+	normals.swap(newNormals);
+}
+
+void computeCacheStatistics(
+	const std::vector<unsigned int>& indices,
+	size_t vertexCount,
+	float& acmr,
+	float& atvr
+) {
+	// FIFO cache, tracked by the time each vertex entered it
+	std::vector<size_t> insertedAt(vertexCount, 0);
+	size_t misses = 0;
+	for (size_t i = 0; i < indices.size(); i++) {
+		unsigned int v = indices[i];
+		if (insertedAt[v] == 0 || misses + 1 - insertedAt[v] > vertexCacheSize) {
+			misses++;
+			insertedAt[v] = misses;
+		}
+	}
+	size_t triangleCount = indices.size() / 3;
+	acmr = triangleCount ? (float)misses / triangleCount : 0.0f;
+	atvr = vertexCount ? (float)misses / vertexCount : 0.0f;
+}
+
+static inline unsigned short quantizeUnorm16(float value, float minimum, float extent) {
+	float normalized = extent > 0.0f ? (value - minimum) / extent : 0.0f;
+	normalized = normalized < 0.0f ? 0.0f : (normalized > 1.0f ? 1.0f : normalized);
+	return (unsigned short)(normalized * 65535.0f + 0.5f);
+}
+
+static inline short quantizeSnorm16(float value) {
+	value = value < -1.0f ? -1.0f : (value > 1.0f ? 1.0f : value);
+	return (short)(value * 32767.0f + (value >= 0.0f ? 0.5f : -0.5f));
+}
+
+void quantizePositions(
+	const std::vector<glm::vec3>& vertices,
+	const glm::vec3& boundsMin,
+	const glm::vec3& boundsMax,
+	std::vector<unsigned short>& out_positions
+) {
+	glm::vec3 extent = boundsMax - boundsMin;
+	out_positions.resize(vertices.size() * 4);
+	for (size_t i = 0; i < vertices.size(); i++) {
+		for (int k = 0; k < 3; k++)
+			out_positions[i * 4 + k] = quantizeUnorm16(vertices[i][k], boundsMin[k], extent[k]);
+		out_positions[i * 4 + 3] = 0;
+	}
+}
+
+void quantizeUVs(
+	const std::vector<glm::vec2>& uvs,
+	const glm::vec2& boundsMin,
+	const glm::vec2& boundsMax,
+	std::vector<unsigned short>& out_uvs
+) {
+	glm::vec2 extent = boundsMax - boundsMin;
+	out_uvs.resize(uvs.size() * 2);
+	for (size_t i = 0; i < uvs.size(); i++) {
+		for (int k = 0; k < 2; k++)
+			out_uvs[i * 2 + k] = quantizeUnorm16(uvs[i][k], boundsMin[k], extent[k]);
+	}
+}
+
+void encodeNormals(
+	const std::vector<glm::vec3>& normals,
+	std::vector<short>& out_normals
+) {
+	out_normals.resize(normals.size() * 2);
+	for (size_t i = 0; i < normals.size(); i++) {
+		glm::vec3 n = normals[i];
+		float l1 = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+		float x = l1 > 0.0f ? n.x / l1 : 0.0f;
+		float y = l1 > 0.0f ? n.y / l1 : 0.0f;
+
+		// Fold the lower hemisphere over the diagonals
+		if (n.z < 0.0f) {
+			float foldedX = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+			float foldedY = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+			x = foldedX;
+			y = foldedY;
+		}
+		out_normals[i * 2 + 0] = quantizeSnorm16(x);
+		out_normals[i * 2 + 1] = quantizeSnorm16(y);
+	}
+}
+
+#ifdef MESHOPT_SSE2
+// Four packed vec3 (three unaligned loads) transposed into x, y and z lanes.
+static inline void loadVertices4(const glm::vec3* vertices, __m128& x, __m128& y, __m128& z) {
+	const float* f = &vertices[0].x;
+	__m128 x0y0z0x1 = _mm_loadu_ps(f);
+	__m128 y1z1x2y2 = _mm_loadu_ps(f + 4);
+	__m128 z2x3y3z3 = _mm_loadu_ps(f + 8);
+	__m128 x2y2x3y3 = _mm_shuffle_ps(y1z1x2y2, z2x3y3z3, _MM_SHUFFLE(2, 1, 3, 2));
+	__m128 y0z0y1z1 = _mm_shuffle_ps(x0y0z0x1, y1z1x2y2, _MM_SHUFFLE(1, 0, 2, 1));
+	x = _mm_shuffle_ps(x0y0z0x1, x2y2x3y3, _MM_SHUFFLE(2, 0, 3, 0));
+	y = _mm_shuffle_ps(y0z0y1z1, x2y2x3y3, _MM_SHUFFLE(3, 1, 2, 0));
+	z = _mm_shuffle_ps(y0z0y1z1, z2x3y3z3, _MM_SHUFFLE(3, 0, 3, 1));
+}
+
+static inline float horizontalMin(__m128 v) {
+	v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+	v = _mm_min_ss(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_cvtss_f32(v);
+}
+
+static inline float horizontalMax(__m128 v) {
+	v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+	v = _mm_max_ss(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_cvtss_f32(v);
+}
+#endif
+
+void computeBounds(
+	const std::vector<glm::vec3>& vertices,
+	glm::vec3& boundsMin,
+	glm::vec3& boundsMax,
+	glm::vec3& sphereCentre,
+	float& sphereRadius
+) {
+	size_t count = vertices.size();
+	if (count == 0) {
+		boundsMin = boundsMax = sphereCentre = glm::vec3(0.0f);
+		sphereRadius = 0.0f;
+		return;
+	}
+
+	boundsMin = boundsMax = vertices[0];
+	size_t i = 0;
+#ifdef MESHOPT_SSE2
+	if (count >= 4) {
+		__m128 minX, minY, minZ;
+		loadVertices4(&vertices[0], minX, minY, minZ);
+		__m128 maxX = minX, maxY = minY, maxZ = minZ;
+		for (i = 4; i + 4 <= count; i += 4) {
+			__m128 x, y, z;
+			loadVertices4(&vertices[i], x, y, z);
+			minX = _mm_min_ps(minX, x);
+			minY = _mm_min_ps(minY, y);
+			minZ = _mm_min_ps(minZ, z);
+			maxX = _mm_max_ps(maxX, x);
+			maxY = _mm_max_ps(maxY, y);
+			maxZ = _mm_max_ps(maxZ, z);
+		}
+		boundsMin = glm::vec3(horizontalMin(minX), horizontalMin(minY), horizontalMin(minZ));
+		boundsMax = glm::vec3(horizontalMax(maxX), horizontalMax(maxY), horizontalMax(maxZ));
+	}
+#endif
+	for (; i < count; i++) {
+		boundsMin = glm::min(boundsMin, vertices[i]);
+		boundsMax = glm::max(boundsMax, vertices[i]);
+	}
+
+	// Second pass: the farthest vertex from the box centre sets the radius
+	sphereCentre = (boundsMin + boundsMax) * 0.5f;
+	float radiusSquared = 0.0f;
+	i = 0;
+#ifdef MESHOPT_SSE2
+	__m128 centreX = _mm_set1_ps(sphereCentre.x);
+	__m128 centreY = _mm_set1_ps(sphereCentre.y);
+	__m128 centreZ = _mm_set1_ps(sphereCentre.z);
+	__m128 maxDistance = _mm_setzero_ps();
+	for (; i + 4 <= count; i += 4) {
+		__m128 x, y, z;
+		loadVertices4(&vertices[i], x, y, z);
+		x = _mm_sub_ps(x, centreX);
+		y = _mm_sub_ps(y, centreY);
+		z = _mm_sub_ps(z, centreZ);
+		__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+		maxDistance = _mm_max_ps(maxDistance, distance);
+	}
+	radiusSquared = horizontalMax(maxDistance);
+#endif
+	for (; i < count; i++) {
+		glm::vec3 d = vertices[i] - sphereCentre;
+		radiusSquared = std::max(radiusSquared, glm::dot(d, d));
+	}
+	sphereRadius = sqrtf(radiusSquared);
+}
+
+// Symmetric 4x4 quadric of squared plane distances, plus the total plane weight so the error
+// can be turned back into a distance.
+struct Quadric {
+	double a00, a01, a02, a03, a11, a12, a13, a22, a23, a33;
+	double weight;
+};
+
+static void addPlaneQuadric(Quadric& q, const glm::vec3& normal, float d, double weight) {
+	double a = normal.x, b = normal.y, c = normal.z, e = d;
+	q.a00 += weight * a * a; q.a01 += weight * a * b; q.a02 += weight * a * c; q.a03 += weight * a * e;
+	q.a11 += weight * b * b; q.a12 += weight * b * c; q.a13 += weight * b * e;
+	q.a22 += weight * c * c; q.a23 += weight * c * e;
+	q.a33 += weight * e * e;
+	q.weight += weight;
+}
+
+static void addQuadric(Quadric& q, const Quadric& r) {
+	q.a00 += r.a00; q.a01 += r.a01; q.a02 += r.a02; q.a03 += r.a03;
+	q.a11 += r.a11; q.a12 += r.a12; q.a13 += r.a13;
+	q.a22 += r.a22; q.a23 += r.a23;
+	q.a33 += r.a33;
+	q.weight += r.weight;
+}
+
+// Root mean square distance of p to the planes accumulated in q (and in r).
+static float quadricError(const Quadric& q, const Quadric& r, const glm::vec3& p) {
+	double x = p.x, y = p.y, z = p.z;
+	double a00 = q.a00 + r.a00, a01 = q.a01 + r.a01, a02 = q.a02 + r.a02, a03 = q.a03 + r.a03;
+	double a11 = q.a11 + r.a11, a12 = q.a12 + r.a12, a13 = q.a13 + r.a13;
+	double a22 = q.a22 + r.a22, a23 = q.a23 + r.a23, a33 = q.a33 + r.a33;
+	double error = a00 * x * x + 2 * a01 * x * y + 2 * a02 * x * z + 2 * a03 * x
+		+ a11 * y * y + 2 * a12 * y * z + 2 * a13 * y
+		+ a22 * z * z + 2 * a23 * z
+		+ a33;
+	double weight = q.weight + r.weight;
+	return weight > 0.0 && error > 0.0 ? (float)sqrt(error / weight) : 0.0f;
+}
+
+struct Collapse {
+	unsigned int from;
+	unsigned int to;
+	float error;
+};
+
+// Edge-collapse simplifier state shared by all the levels of one chain, so the quadrics keep
+// measuring the distance to the original surface.
+struct Simplifier {
+	const std::vector<glm::vec3>* vertices;
+	std::vector<unsigned int> indices;
+	std::vector<Quadric> quadrics;
+	std::vector<char> locked;
+	float error;
+};
+
+static void initSimplifier(Simplifier& simplifier, const std::vector<unsigned int>& indices, const std::vector<glm::vec3>& vertices) {
+	size_t vertexCount = vertices.size();
+	simplifier.vertices = &vertices;
+	simplifier.indices = indices;
+	simplifier.error = 0.0f;
+
+	// Weld vertices by position: seams (one position, several uv/normal sets) must stay put
+	std::vector<unsigned int> weld(vertexCount);
+	{
+		std::vector<unsigned int> order(vertexCount);
+		for (size_t v = 0; v < vertexCount; v++)
+			order[v] = (unsigned int)v;
+		std::sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) {
+			const glm::vec3& p = vertices[a];
+			const glm::vec3& q = vertices[b];
+			if (p.x != q.x) return p.x < q.x;
+			if (p.y != q.y) return p.y < q.y;
+			if (p.z != q.z) return p.z < q.z;
+			return a < b;
+		});
+		simplifier.locked.assign(vertexCount, 0);
+		for (size_t i = 0; i < vertexCount; i++) {
+			bool samePosition = i > 0 && vertices[order[i]] == vertices[order[i - 1]];
+			weld[order[i]] = samePosition ? weld[order[i - 1]] : order[i];
+			if (samePosition) {
+				simplifier.locked[order[i]] = 1;
+				simplifier.locked[order[i - 1]] = 1;
+			}
+		}
+	}
+
+	// Open borders (a welded edge without its twin) are locked as well
+	std::vector<unsigned long long> edges;
+	edges.reserve(indices.size());
+	for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+		for (int k = 0; k < 3; k++) {
+			unsigned long long a = weld[indices[t + k]], b = weld[indices[t + (k + 1) % 3]];
+			edges.push_back(a << 32 | b);
+		}
+	}
+	std::sort(edges.begin(), edges.end());
+	for (size_t i = 0; i < edges.size(); i++) {
+		unsigned long long twin = (edges[i] & 0xFFFFFFFFull) << 32 | edges[i] >> 32;
+		if (!std::binary_search(edges.begin(), edges.end(), twin)) {
+			simplifier.locked[edges[i] >> 32] = 1;
+			simplifier.locked[edges[i] & 0xFFFFFFFFull] = 1;
+		}
+	}
+
+	Quadric zero;
+	memset(&zero, 0, sizeof(zero));
+	simplifier.quadrics.assign(vertexCount, zero);
+	for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+		const glm::vec3& a = vertices[indices[t + 0]];
+		const glm::vec3& b = vertices[indices[t + 1]];
+		const glm::vec3& c = vertices[indices[t + 2]];
+		glm::vec3 normal = glm::cross(b - a, c - a);
+		float area = glm::length(normal);
+		if (area <= 0.0f)
+			continue;
+		normal = normal / area;
+		float d = -glm::dot(normal, a);
+		for (int k = 0; k < 3; k++)
+			addPlaneQuadric(simplifier.quadrics[indices[t + k]], normal, d, area * 0.5);
+	}
+}
+
+// Would moving `from` onto `to` flip (or squash) any triangle that survives the collapse?
+static bool collapseFlips(const Simplifier& simplifier, const std::vector<unsigned int>& adjacencyOffsets, const std::vector<unsigned int>& adjacency, unsigned int from, unsigned int to) {
+	const std::vector<glm::vec3>& vertices = *simplifier.vertices;
+	const std::vector<unsigned int>& indices = simplifier.indices;
+	for (unsigned int a = adjacencyOffsets[from]; a < adjacencyOffsets[from + 1]; a++) {
+		size_t t = adjacency[a] * 3;
+		unsigned int i0 = indices[t], i1 = indices[t + 1], i2 = indices[t + 2];
+		if (i0 == to || i1 == to || i2 == to)
+			continue;
+		glm::vec3 before = glm::cross(vertices[i1] - vertices[i0], vertices[i2] - vertices[i0]);
+		glm::vec3 p0 = vertices[i0 == from ? to : i0];
+		glm::vec3 p1 = vertices[i1 == from ? to : i1];
+		glm::vec3 p2 = vertices[i2 == from ? to : i2];
+		glm::vec3 after = glm::cross(p1 - p0, p2 - p0);
+		if (glm::dot(before, after) <= 0.0f)
+			return true;
+	}
+	return false;
+}
+
+// Collapses edges, cheapest first, until the index count reaches the target or nothing can move.
+static void simplifyTo(Simplifier& simplifier, size_t targetIndexCount) {
+	std::vector<unsigned int>& indices = simplifier.indices;
+	size_t vertexCount = simplifier.vertices->size();
+
+	while (indices.size() > targetIndexCount) {
+		TriangleAdjacency adjacency;
+		buildAdjacency(indices, vertexCount, adjacency);
+
+		// Cheapest collapse out of every unlocked vertex
+		std::vector<Collapse> collapses;
+		std::vector<float> bestError(vertexCount, -1.0f);
+		std::vector<unsigned int> bestTarget(vertexCount, 0);
+		for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+			for (int k = 0; k < 3; k++) {
+				unsigned int from = indices[t + k];
+				if (simplifier.locked[from])
+					continue;
+				for (int j = 1; j < 3; j++) {
+					unsigned int to = indices[t + (k + j) % 3];
+					float error = quadricError(simplifier.quadrics[from], simplifier.quadrics[to], (*simplifier.vertices)[to]);
+					if (bestError[from] < 0.0f || error < bestError[from]) {
+						bestError[from] = error;
+						bestTarget[from] = to;
+					}
+				}
+			}
+		}
+		for (size_t v = 0; v < vertexCount; v++) {
+			if (bestError[v] >= 0.0f) {
+				Collapse collapse = { (unsigned int)v, bestTarget[v], bestError[v] };
+				collapses.push_back(collapse);
+			}
+		}
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) {
+			return a.error < b.error;
+		});
+
+		// Apply non-overlapping collapses; each removes the two triangles along its edge
+		std::vector<unsigned int> remap(vertexCount);
+		for (size_t v = 0; v < vertexCount; v++)
+			remap[v] = (unsigned int)v;
+		std::vector<char> touched(vertexCount, 0);
+		size_t removedIndices = 0;
+		size_t collapsed = 0;
+		size_t budget = indices.size() - targetIndexCount;
+
+		for (size_t c = 0; c < collapses.size() && removedIndices < budget; c++) {
+			const Collapse& collapse = collapses[c];
+			if (touched[collapse.from] || touched[collapse.to])
+				continue;
+			if (collapseFlips(simplifier, adjacency.offsets, adjacency.triangles, collapse.from, collapse.to))
+				continue;
+
+			remap[collapse.from] = collapse.to;
+			addQuadric(simplifier.quadrics[collapse.to], simplifier.quadrics[collapse.from]);
+			simplifier.error = std::max(simplifier.error, collapse.error);
+			collapsed++;
+
+			// Freeze the neighbourhood so the flip test above stays valid for this pass
+			for (unsigned int a = adjacency.offsets[collapse.from]; a < adjacency.offsets[collapse.from + 1]; a++) {
+				size_t t = adjacency.triangles[a] * 3;
+				bool shared = indices[t] == collapse.to || indices[t + 1] == collapse.to || indices[t + 2] == collapse.to;
+				if (shared)
+					removedIndices += 3;
+				for (int k = 0; k < 3; k++)
+					touched[indices[t + k]] = 1;
+			}
+		}
+		if (collapsed == 0)
+			break;
+
+		size_t write = 0;
+		for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+			unsigned int a = remap[indices[t]], b = remap[indices[t + 1]], c = remap[indices[t + 2]];
+			if (a == b || b == c || a == c)
+				continue;
+			indices[write++] = a;
+			indices[write++] = b;
+			indices[write++] = c;
+		}
+		indices.resize(write);
+	}
+}
+
+void buildLODChain(
+	const std::vector<unsigned int>& indices,
+	const std::vector<glm::vec3>& vertices,
+	unsigned int maxLevels,
+	std::vector<std::vector<unsigned int> >& out_levels,
+	std::vector<float>& out_errors
+) {
+	out_levels.assign(1, indices);
+	out_errors.assign(1, 0.0f);
+
+	Simplifier simplifier;
+	initSimplifier(simplifier, indices, vertices);
+
+	while (out_levels.size() < maxLevels) {
+		size_t previous = simplifier.indices.size();
+		size_t target = (size_t)(previous * lodReduction) / 3 * 3;
+		if (target < minLODTriangles * 3)
+			break;
+		simplifyTo(simplifier, target);
+
+		// Stop once the locked seams/borders leave too little to collapse
+		if (simplifier.indices.size() > previous * (1.0f + lodReduction) / 2.0f)
+			break;
+		out_levels.push_back(simplifier.indices);
+		out_errors.push_back(simplifier.error);
+	}
+}
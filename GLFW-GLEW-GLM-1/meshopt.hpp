@@ -0,0 +1,84 @@
+#ifndef MESHOPT_HPP
+#define MESHOPT_HPP
+
+#include <vector>
+#include <glm/glm.hpp>
+
+// Size of the FIFO post-transform cache the optimizer targets and the statistics simulate.
+const unsigned int vertexCacheSize = 16;
+
+// Reorders triangles for post-transform cache reuse (Tipsify, Sander et al. 2007),
+// then sorts the resulting clusters front-to-back-ish to cut overdraw.
+void optimizeVertexCache(
+	std::vector<unsigned int> & indices,
+	const std::vector<glm::vec3> & vertices
+);
+
+// Renumbers vertices in first-use order so the VBO is fetched linearly.
+// Unreferenced vertices are dropped.
+void optimizeVertexFetch(
+	std::vector<unsigned int> & indices,
+	std::vector<glm::vec3> & vertices,
+	std::vector<glm::vec2> & uvs,
+	std::vector<glm::vec3> & normals
+);
+
+// Average cache miss ratio (misses per triangle) and average transform to vertex ratio
+// (misses per vertex) of a FIFO cache of vertexCacheSize entries.
+void computeCacheStatistics(
+	const std::vector<unsigned int> & indices,
+	size_t vertexCount,
+	float & acmr,
+	float & atvr
+);
+
+// unorm16 x4 positions relative to the bounds; the 4th component is padding.
+void quantizePositions(
+	const std::vector<glm::vec3> & vertices,
+	const glm::vec3 & boundsMin,
+	const glm::vec3 & boundsMax,
+	std::vector<unsigned short> & out_positions
+);
+
+// unorm16 x2 uvs relative to the uv bounds.
+void quantizeUVs(
+	const std::vector<glm::vec2> & uvs,
+	const glm::vec2 & boundsMin,
+	const glm::vec2 & boundsMax,
+	std::vector<unsigned short> & out_uvs
+);
+
+// Octahedral unit vectors as snorm16 x2 (Cigolle et al. 2014).
+void encodeNormals(
+	const std::vector<glm::vec3> & normals,
+	std::vector<short> & out_normals
+);
+
+// Axis-aligned bounds and a bounding sphere around their centre, which is tight for the
+// round bodies of this scene. SSE2 where available: both passes stream 4 vertices at a time.
+void computeBounds(
+	const std::vector<glm::vec3> & vertices,
+	glm::vec3 & boundsMin,
+	glm::vec3 & boundsMax,
+	glm::vec3 & sphereCentre,
+	float & sphereRadius
+);
+
+// Every LOD level aims for this fraction of the previous level's triangles.
+const float lodReduction = 0.5f;
+// Levels stop before they would drop under this many triangles.
+const unsigned int minLODTriangles = 32;
+
+// Quadric error edge-collapse LOD chain (Garland & Heckbert 1997). Level 0 is the input.
+// Vertices are only collapsed onto their neighbours, so every level indexes the same vertex
+// buffer; uv seams and open borders are locked. out_errors holds each level's deviation from
+// the original surface, in model units.
+void buildLODChain(
+	const std::vector<unsigned int> & indices,
+	const std::vector<glm::vec3> & vertices,
+	unsigned int maxLevels,
+	std::vector<std::vector<unsigned int> > & out_levels,
+	std::vector<float> & out_errors
+);
+
+#endif
@@ -0,0 +1,549 @@
+// Include standard headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+#include <vector>
+#include <chrono>
+
+// Include GLM
+#include <glm/glm.hpp>
+
+#include "jobs.hpp"
+#include "mappedfile.hpp"
+#include "objloader.hpp"
+
+static inline bool isBlank(char c) {
+	return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static inline bool isDigit(char c) {
+	return (unsigned)(c - '0') < 10u;
+}
+
+static inline const char* skipBlanks(const char* p, const char* end) {
+	while (p < end && isBlank(*p))
+		p++;
+	return p;
+}
+
+static inline const char* nextLine(const char* p, const char* end) {
+	const char* newline = (const char*)memchr(p, '\n', end - p);
+	return newline ? newline + 1 : end;
+}
+
+// Anything the fast path cannot round exactly goes through strtof, which is what fscanf("%f") uses.
+static bool parseFloatSlow(const char*& p, const char* end, float& out) {
+	char token[128];
+	size_t length = 0;
+	while (p + length < end && !isBlank(p[length]) && p[length] != '\n' && length < sizeof(token) - 1) {
+		token[length] = p[length];
+		length++;
+	}
+	token[length] = '\0';
+
+	char* tokenEnd;
+	out = strtof(token, &tokenEnd);
+	if (tokenEnd == token)
+		return false;
+	p += tokenEnd - token;
+	return true;
+}
+
+// from_chars-style float parser. The mantissa and the power of ten are both exact in a double,
+// so one multiply/divide gives the correctly rounded double; the only case where narrowing that
+// to float differs from strtof is when it lands exactly on a float midpoint, which falls back.
+static bool parseFloat(const char*& p, const char* end, float& out) {
+	static const double powersOf10[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+
+	p = skipBlanks(p, end);
+	const char* start = p;
+
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')) {
+		negative = *p == '-';
+		p++;
+	}
+
+	uint64_t mantissa = 0;
+	int significantDigits = 0;
+	int exponent = 0;
+	bool anyDigits = false;
+
+	while (p < end && isDigit(*p)) {
+		if (mantissa != 0 || *p != '0') {
+			mantissa = mantissa * 10 + (*p - '0');
+			significantDigits++;
+		}
+		anyDigits = true;
+		p++;
+	}
+	if (p < end && *p == '.') {
+		p++;
+		while (p < end && isDigit(*p)) {
+			if (mantissa != 0 || *p != '0') {
+				mantissa = mantissa * 10 + (*p - '0');
+				significantDigits++;
+			}
+			exponent--;
+			anyDigits = true;
+			p++;
+		}
+	}
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		const char* q = p + 1;
+		bool negativeExponent = false;
+		if (q < end && (*q == '-' || *q == '+')) {
+			negativeExponent = *q == '-';
+			q++;
+		}
+		if (q < end && isDigit(*q)) {
+			int value = 0;
+			while (q < end && isDigit(*q)) {
+				if (value < 10000)
+					value = value * 10 + (*q - '0');
+				q++;
+			}
+			exponent += negativeExponent ? -value : value;
+			p = q;
+		}
+	}
+
+	// Hex floats, inf/nan, long mantissas and big exponents are rare enough to not care
+	bool delimited = p == end || isBlank(*p) || *p == '\n';
+	if (!anyDigits || !delimited || significantDigits > 15 || exponent < -22 || exponent > 22) {
+		p = start;
+		return parseFloatSlow(p, end, out);
+	}
+
+	double value = (double)mantissa;
+	value = exponent < 0 ? value / powersOf10[-exponent] : value * powersOf10[exponent];
+
+	double magnitude = fabs(value);
+	if (magnitude != 0.0) {
+		uint64_t bits;
+		memcpy(&bits, &value, sizeof(bits));
+		bool subnormal = magnitude < 1.1754943508222875e-38;
+		bool floatMidpoint = (bits & 0x1FFFFFFFull) == 0x10000000ull;
+		if (subnormal || floatMidpoint) {
+			p = start;
+			return parseFloatSlow(p, end, out);
+		}
+	}
+
+	out = (float)(negative ? -value : value);
+	return true;
+}
+
+static bool parseIndex(const char*& p, const char* end, unsigned int& out) {
+	if (p >= end || !isDigit(*p))
+		return false;
+	unsigned int value = 0;
+	while (p < end && isDigit(*p)) {
+		value = value * 10 + (*p - '0');
+		p++;
+	}
+	out = value;
+	return true;
+}
+
+// One "v/vt/vn" corner of a face.
+static bool parseCorner(const char*& p, const char* end, unsigned int& vertexIndex, unsigned int& uvIndex, unsigned int& normalIndex) {
+	p = skipBlanks(p, end);
+	if (!parseIndex(p, end, vertexIndex) || p >= end || *p++ != '/')
+		return false;
+	if (!parseIndex(p, end, uvIndex) || p >= end || *p++ != '/')
+		return false;
+	return parseIndex(p, end, normalIndex);
+}
+
+enum ObjRecord { OBJ_OTHER, OBJ_VERTEX, OBJ_UV, OBJ_NORMAL, OBJ_FACE };
+
+// Classifies the line starting at p (leading blanks already skipped) and moves p past the keyword.
+static inline ObjRecord readRecordType(const char*& p, const char* end) {
+	size_t left = end - p;
+	if (left >= 2 && p[0] == 'v') {
+		if (isBlank(p[1])) {
+			p += 2;
+			return OBJ_VERTEX;
+		}
+		if (left >= 3 && isBlank(p[2])) {
+			if (p[1] == 't') {
+				p += 3;
+				return OBJ_UV;
+			}
+			if (p[1] == 'n') {
+				p += 3;
+				return OBJ_NORMAL;
+			}
+		}
+	}
+	else if (left >= 2 && p[0] == 'f' && isBlank(p[1])) {
+		p += 2;
+		return OBJ_FACE;
+	}
+	return OBJ_OTHER;
+}
+// A slice of the file cut at line boundaries, and where its records land in the merged streams.
+struct ObjChunk {
+	const char* begin;
+	const char* end;
+	size_t counts[5];
+	size_t firstPosition, firstUV, firstNormal, firstCorner;
+	bool ok;
+};
+
+// Don't bother spinning up threads for less than this much text per chunk.
+static const size_t minChunkBytes = 1 << 20;
+static const size_t minDeindexCorners = 1 << 16;
+
+// Cheap first pass so every stream can be sized exactly once.
+static void countRecords(ObjChunk& chunk) {
+	memset(chunk.counts, 0, sizeof(chunk.counts));
+	const char* p = chunk.begin;
+	while (p < chunk.end) {
+		p = skipBlanks(p, chunk.end);
+		chunk.counts[readRecordType(p, chunk.end)]++;
+		p = nextLine(p, chunk.end);
+	}
+}
+
+// Parses one chunk straight into its slice of the (already sized) streams.
+static bool parseChunk(const ObjChunk& chunk, ObjData& data) {
+	glm::vec3* positions = data.positions.data() + chunk.firstPosition;
+	glm::vec2* uvs = data.uvs.data() + chunk.firstUV;
+	glm::vec3* normals = data.normals.data() + chunk.firstNormal;
+	unsigned int* vertexIndices = data.vertexIndices.data() + chunk.firstCorner;
+	unsigned int* uvIndices = data.uvIndices.data() + chunk.firstCorner;
+	unsigned int* normalIndices = data.normalIndices.data() + chunk.firstCorner;
+
+	const char* p = chunk.begin;
+	const char* end = chunk.end;
+	while (p < end) {
+		p = skipBlanks(p, end);
+
+		switch (readRecordType(p, end)) {
+		case OBJ_VERTEX: {
+			glm::vec3 vertex;
+			if (!parseFloat(p, end, vertex.x) || !parseFloat(p, end, vertex.y) || !parseFloat(p, end, vertex.z))
+				return false;
+			*positions++ = vertex;
+			break;
+		}
+		case OBJ_UV: {
+			glm::vec2 uv;
+			if (!parseFloat(p, end, uv.x) || !parseFloat(p, end, uv.y))
+				return false;
+			uv.y = -uv.y; // Invert V coordinate since we will only use DDS texture, which are inverted. Remove if you want to use TGA or BMP loaders.
+			*uvs++ = uv;
+			break;
+		}
+		case OBJ_NORMAL: {
+			glm::vec3 normal;
+			if (!parseFloat(p, end, normal.x) || !parseFloat(p, end, normal.y) || !parseFloat(p, end, normal.z))
+				return false;
+			*normals++ = normal;
+			break;
+		}
+		case OBJ_FACE: {
+			// Like the old fscanf loader, anything after the 3rd corner (e.g. a quad's 4th) is dropped
+			for (int i = 0; i < 3; i++) {
+				if (!parseCorner(p, end, *vertexIndices++, *uvIndices++, *normalIndices++))
+					return false;
+			}
+			break;
+		}
+		default:
+			// Probably a comment, eat up the rest of the line
+			break;
+		}
+
+		p = nextLine(p, end);
+	}
+	return true;
+}
+
+// Splits the file into one chunk per worker, counts and parses every chunk in parallel.
+// OBJ indices are absolute, so merging is only a matter of prefix-summing each chunk's
+// record counts into its write offsets; no index is rewritten.
+static bool parseOBJ(const char* begin, const char* end, ObjData& data) {
+	size_t size = end - begin;
+	size_t chunkCount = getWorkerCount();
+	if (chunkCount > size / minChunkBytes)
+		chunkCount = size / minChunkBytes;
+	if (chunkCount == 0)
+		chunkCount = 1;
+
+	std::vector<ObjChunk> chunks(chunkCount);
+	const char* chunkBegin = begin;
+	for (size_t i = 0; i < chunkCount; i++) {
+		const char* chunkEnd = i + 1 == chunkCount ? end : begin + size * (i + 1) / chunkCount;
+		if (chunkEnd < chunkBegin)
+			chunkEnd = chunkBegin;
+		if (chunkEnd < end)
+			chunkEnd = nextLine(chunkEnd, end);
+		chunks[i].begin = chunkBegin;
+		chunks[i].end = chunkEnd;
+		chunkBegin = chunkEnd;
+	}
+
+	parallelFor((unsigned int)chunkCount, [&](unsigned int i) {
+		countRecords(chunks[i]);
+	});
+
+	size_t positionCount = 0, uvCount = 0, normalCount = 0, cornerCount = 0;
+	for (size_t i = 0; i < chunkCount; i++) {
+		chunks[i].firstPosition = positionCount;
+		chunks[i].firstUV = uvCount;
+		chunks[i].firstNormal = normalCount;
+		chunks[i].firstCorner = cornerCount;
+		positionCount += chunks[i].counts[OBJ_VERTEX];
+		uvCount += chunks[i].counts[OBJ_UV];
+		normalCount += chunks[i].counts[OBJ_NORMAL];
+		cornerCount += 3 * chunks[i].counts[OBJ_FACE];
+	}
+	data.positions.resize(positionCount);
+	data.uvs.resize(uvCount);
+	data.normals.resize(normalCount);
+	data.vertexIndices.resize(cornerCount);
+	data.uvIndices.resize(cornerCount);
+	data.normalIndices.resize(cornerCount);
+
+	parallelFor((unsigned int)chunkCount, [&](unsigned int i) {
+		chunks[i].ok = parseChunk(chunks[i], data);
+	});
+
+	for (size_t i = 0; i < chunkCount; i++) {
+		if (!chunks[i].ok)
+			return false;
+	}
+	return true;
+}
+
+
+// Maps and parses a whole OBJ file, reporting failures the way the loaders always did.
+static bool readOBJ(const char* path, ObjData& data, size_t& fileSize) {
+	MappedFile file;
+	if (!openMappedFile(path, file)) {
+		printf("Impossible to open the file ! Are you in the right path ? See Tutorial 1 for details\n");
+		getchar();
+		return false;
+	}
+
+	bool ok = parseOBJ(file.data, file.data + file.size, data);
+	fileSize = file.size;
+	closeMappedFile(file);
+	if (!ok)
+		printf("File can't be read by our simple parser :-( Try exporting with other options\n");
+	return ok;
+}
+
+bool streamOBJ(
+	const char* path,
+	size_t windowBytes,
+	const std::function<bool(const ObjData&)>& window
+) {
+	MappedFile file;
+	if (!openMappedFile(path, file)) {
+		printf("Impossible to open the file ! Are you in the right path ? See Tutorial 1 for details\n");
+		return false;
+	}
+	if (windowBytes < minChunkBytes)
+		windowBytes = minChunkBytes;
+
+	// The streams keep their capacity from one window to the next
+	ObjData data;
+	const char* end = file.data + file.size;
+	bool ok = true;
+	for (const char* windowBegin = file.data; ok && windowBegin < end; ) {
+		const char* windowEnd = (size_t)(end - windowBegin) > windowBytes ? nextLine(windowBegin + windowBytes, end) : end;
+		if (!parseOBJ(windowBegin, windowEnd, data)) {
+			printf("File can't be read by our simple parser :-( Try exporting with other options\n");
+			ok = false;
+		}
+		else {
+			ok = window(data);
+		}
+		releaseMappedRange(file, windowBegin - file.data, windowEnd - windowBegin);
+		windowBegin = windowEnd;
+	}
+	closeMappedFile(file);
+	return ok;
+}
+
+static void printLoadTime(const char* path, size_t triangles, size_t fileSize, std::chrono::steady_clock::time_point startTime) {
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+	printf("Loaded %s: %u triangles in %.1f ms (%.1f MB/s, %u threads)\n", path, (unsigned int)triangles, seconds * 1000.0, fileSize / (1024.0 * 1024.0) / (seconds > 0.0 ? seconds : 1e-9), getWorkerCount());
+}
+
+
+// Very, VERY simple OBJ loader.
+// Here is a short list of features a real function would provide :
+// - Binary files. Reading a model should be just a few memcpy's away, not parsing a file at runtime. In short : OBJ is not very great.
+// - Animations & bones (includes bones weights)
+// - Multiple UVs
+// - All attributes should be optional, not "forced"
+// - More stable. Change a line in the OBJ file and it crashes.
+// - More secure. Change another line and you can inject code.
+// - Loading from memory, stream, etc
+
+bool loadOBJ(
+	const char* path,
+	std::vector<glm::vec3>& out_vertices,
+	std::vector<glm::vec2>& out_uvs,
+	std::vector<glm::vec3>& out_normals
+) {
+	printf("Loading OBJ file %s...\n", path);
+	std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+	ObjData data;
+	size_t fileSize;
+	if (!readOBJ(path, data, fileSize))
+		return false;
+
+	size_t first = out_vertices.size();
+	size_t count = data.vertexIndices.size();
+	out_vertices.resize(first + count);
+	out_uvs.resize(first + count);
+	out_normals.resize(first + count);
+
+	// For each vertex of each triangle, split in ranges across the workers
+	unsigned int rangeCount = getWorkerCount();
+	if (rangeCount > count / minDeindexCorners)
+		rangeCount = (unsigned int)(count / minDeindexCorners);
+	if (rangeCount == 0)
+		rangeCount = 1;
+	std::vector<char> rangeOk(rangeCount);
+
+	parallelFor(rangeCount, [&](unsigned int range) {
+		size_t rangeBegin = count * range / rangeCount;
+		size_t rangeEnd = count * (range + 1) / rangeCount;
+		rangeOk[range] = 1;
+		for (size_t i = rangeBegin; i < rangeEnd; i++) {
+
+			// Get the indices of its attributes
+			unsigned int vertexIndex = data.vertexIndices[i];
+			unsigned int uvIndex = data.uvIndices[i];
+			unsigned int normalIndex = data.normalIndices[i];
+
+			if (vertexIndex - 1 >= data.positions.size() || uvIndex - 1 >= data.uvs.size() || normalIndex - 1 >= data.normals.size()) {
+				rangeOk[range] = 0;
+				return;
+			}
+
+			// Put the attributes in buffers
+			out_vertices[first + i] = data.positions[vertexIndex - 1];
+			out_uvs[first + i] = data.uvs[uvIndex - 1];
+			out_normals[first + i] = data.normals[normalIndex - 1];
+		}
+	});
+
+	for (unsigned int range = 0; range < rangeCount; range++) {
+		if (!rangeOk[range]) {
+			printf("A face references a vertex that does not exist\n");
+			out_vertices.resize(first);
+			out_uvs.resize(first);
+			out_normals.resize(first);
+			return false;
+		}
+	}
+
+	printLoadTime(path, count / 3, fileSize, startTime);
+	return true;
+}
+
+
+static inline uint32_t hashCorner(unsigned int vertexIndex, unsigned int uvIndex, unsigned int normalIndex) {
+	uint32_t h = vertexIndex * 0x9E3779B1u;
+	h ^= uvIndex * 0x85EBCA77u;
+	h ^= normalIndex * 0xC2B2AE3Du;
+	return h ^ (h >> 15);
+}
+
+// Same as loadOBJ, but every distinct v/vt/vn triple becomes one vertex and the faces
+// are returned as indices into them. Faces are deduplicated on their OBJ index triples,
+// with an open addressing table sized from the corner count so it never rehashes.
+bool loadIndexedOBJ(
+	const char* path,
+	std::vector<unsigned int>& out_indices,
+	std::vector<glm::vec3>& out_vertices,
+	std::vector<glm::vec2>& out_uvs,
+	std::vector<glm::vec3>& out_normals
+) {
+	printf("Loading OBJ file %s...\n", path);
+	std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+	ObjData data;
+	size_t fileSize;
+	if (!readOBJ(path, data, fileSize))
+		return false;
+
+	size_t count = data.vertexIndices.size();
+	size_t tableSize = 16;
+	while (tableSize < count * 2)
+		tableSize *= 2;
+	size_t tableMask = tableSize - 1;
+
+	// Slot holds the output vertex + 1, 0 is empty; the keys live in the source index arrays
+	std::vector<unsigned int> table(tableSize, 0);
+	std::vector<unsigned int> firstCorner;
+	firstCorner.reserve(count / 4 + 16);
+
+	size_t base = out_vertices.size();
+	size_t firstIndex = out_indices.size();
+	out_indices.reserve(firstIndex + count);
+
+	for (size_t i = 0; i < count; i++) {
+		unsigned int vertexIndex = data.vertexIndices[i];
+		unsigned int uvIndex = data.uvIndices[i];
+		unsigned int normalIndex = data.normalIndices[i];
+
+		size_t slot = hashCorner(vertexIndex, uvIndex, normalIndex) & tableMask;
+		for (;;) {
+			unsigned int entry = table[slot];
+			if (entry == 0) {
+				if (vertexIndex - 1 >= data.positions.size() || uvIndex - 1 >= data.uvs.size() || normalIndex - 1 >= data.normals.size()) {
+					printf("A face references a vertex that does not exist\n");
+					out_indices.resize(firstIndex);
+					out_vertices.resize(base);
+					out_uvs.resize(base);
+					out_normals.resize(base);
+					return false;
+				}
+				firstCorner.push_back((unsigned int)i);
+				table[slot] = (unsigned int)firstCorner.size();
+				out_indices.push_back((unsigned int)(base + firstCorner.size() - 1));
+				break;
+			}
+			unsigned int corner = firstCorner[entry - 1];
+			if (data.vertexIndices[corner] == vertexIndex && data.uvIndices[corner] == uvIndex && data.normalIndices[corner] == normalIndex) {
+				out_indices.push_back((unsigned int)(base + entry - 1));
+				break;
+			}
+			slot = (slot + 1) & tableMask;
+		}
+	}
+
+	size_t uniqueCount = firstCorner.size();
+	out_vertices.resize(base + uniqueCount);
+	out_uvs.resize(base + uniqueCount);
+	out_normals.resize(base + uniqueCount);
+	for (size_t i = 0; i < uniqueCount; i++) {
+		unsigned int corner = firstCorner[i];
+		out_vertices[base + i] = data.positions[data.vertexIndices[corner] - 1];
+		out_uvs[base + i] = data.uvs[data.uvIndices[corner] - 1];
+		out_normals[base + i] = data.normals[data.normalIndices[corner] - 1];
+	}
+
+	size_t vertexBytes = sizeof(glm::vec3) + sizeof(glm::vec2) + sizeof(glm::vec3);
+	size_t indexBytes = uniqueCount <= 65536 ? sizeof(unsigned short) : sizeof(unsigned int);
+	printf("Indexed %s: %u unique vertices from %u corners, VBO %.1f KB -> %.1f KB (+ %.1f KB indices)\n", path,
+		(unsigned int)uniqueCount, (unsigned int)count,
+		count * vertexBytes / 1024.0, uniqueCount * vertexBytes / 1024.0, count * indexBytes / 1024.0);
+	printLoadTime(path, count / 3, fileSize, startTime);
+	return true;
+}
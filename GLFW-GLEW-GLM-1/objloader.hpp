@@ -1,6 +1,18 @@
 #ifndef OBJLOADER_H
 #define OBJLOADER_H
 
+#include <vector>
+#include <functional>
+#include <glm/glm.hpp>
+
+// Raw OBJ streams, exactly as they appear in the file (indices are 1-based).
+struct ObjData {
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec2> uvs;
+	std::vector<glm::vec3> normals;
+	std::vector<unsigned int> vertexIndices, uvIndices, normalIndices;
+};
+
 bool loadOBJ(
 	const char * path, 
 	std::vector<glm::vec3> & out_vertices, 
@@ -8,14 +20,22 @@ bool loadOBJ(
 	std::vector<glm::vec3> & out_normals
 );
 
-
-
-bool loadAssImp(
+bool loadIndexedOBJ(
 	const char * path, 
-	std::vector<unsigned short> & indices,
-	std::vector<glm::vec3> & vertices,
-	std::vector<glm::vec2> & uvs,
-	std::vector<glm::vec3> & normals
+	std::vector<unsigned int> & out_indices,
+	std::vector<glm::vec3> & out_vertices, 
+	std::vector<glm::vec2> & out_uvs, 
+	std::vector<glm::vec3> & out_normals
+);
+
+// For files too big to hold parsed: the OBJ is parsed about windowBytes of text at a time, cut
+// at line ends, and each window's records go to the callback (return false to stop). Faces keep
+// their absolute OBJ indices. Every parsed window is released again, so resident memory stays
+// near windowBytes plus the parsed records whatever the size of the file.
+bool streamOBJ(
+	const char * path,
+	size_t windowBytes,
+	const std::function<bool(const ObjData &)> & window
 );
 
 #endif
\ No newline at end of file
@@ -0,0 +1,138 @@
+// Include standard headers
+#include <string.h>
+#include <vector>
+#include <chrono>
+#include <functional>
+
+#include "renderqueue.hpp"
+
+const int renderKeyPassShift = 60, renderKeyProgramShift = 56, renderKeyTextureShift = 44, renderKeyMeshShift = 32;
+
+unsigned long long makeRenderKey(unsigned int pass, unsigned int program, unsigned int texture, unsigned int mesh, float depth) {
+	// A non-negative float's bits sort the same way as its value
+	unsigned int depthBits = 0;
+	if (depth > 0.0f)
+		memcpy(&depthBits, &depth, sizeof(depthBits));
+	return ((unsigned long long)(pass & 0xf) << renderKeyPassShift) | ((unsigned long long)(program & 0xf) << renderKeyProgramShift)
+		| ((unsigned long long)(texture & 0xfff) << renderKeyTextureShift) | ((unsigned long long)(mesh & 0xfff) << renderKeyMeshShift) | depthBits;
+}
+
+unsigned int getRenderKeyPass(unsigned long long key) {
+	return (unsigned int)(key >> renderKeyPassShift) & 0xf;
+}
+
+unsigned int getRenderKeyProgram(unsigned long long key) {
+	return (unsigned int)(key >> renderKeyProgramShift) & 0xf;
+}
+
+unsigned int getRenderKeyTexture(unsigned long long key) {
+	return (unsigned int)(key >> renderKeyTextureShift) & 0xfff;
+}
+
+unsigned int getRenderKeyMesh(unsigned long long key) {
+	return (unsigned int)(key >> renderKeyMeshShift) & 0xfff;
+}
+
+void createRenderQueue(RenderQueue& queue) {
+	queue.commands.clear();
+	queue.sorted.clear();
+	queue.frames = 0;
+	queue.commandCount = queue.stateChanges = 0;
+	queue.sortMs = queue.submitMs = 0.0;
+	queue.lastCommands = queue.lastStateChanges = 0;
+	queue.lastSortMs = queue.lastSubmitMs = 0.0;
+}
+
+void beginRenderQueue(RenderQueue& queue) {
+	queue.commands.clear();
+}
+
+void submitRenderCommand(RenderQueue& queue, unsigned long long key, unsigned int item) {
+	RenderCommand command;
+	command.key = key;
+	command.item = item;
+	queue.commands.push_back(command);
+}
+
+// Least significant byte first, one counting pass per byte. Bytes every key has the same, like
+// the pass of a frame with one pass, are skipped, so a frame of a few programs and meshes sorts
+// in about the passes its depths need.
+static void sortRenderCommands(RenderQueue& queue) {
+	size_t count = queue.commands.size();
+	if (count < 2)
+		return;
+
+	size_t histograms[8][256];
+	memset(histograms, 0, sizeof(histograms));
+	for (size_t i = 0; i < count; i++) {
+		unsigned long long key = queue.commands[i].key;
+		for (int b = 0; b < 8; b++)
+			histograms[b][(key >> (b * 8)) & 0xff]++;
+	}
+
+	queue.sorted.resize(count);
+	RenderCommand* from = queue.commands.data();
+	RenderCommand* to = queue.sorted.data();
+	for (int b = 0; b < 8; b++) {
+		size_t* histogram = histograms[b];
+		if (histogram[(from[0].key >> (b * 8)) & 0xff] == count)
+			continue;
+		size_t offset = 0;
+		for (int d = 0; d < 256; d++) {
+			size_t digits = histogram[d];
+			histogram[d] = offset;
+			offset += digits;
+		}
+		for (size_t i = 0; i < count; i++)
+			to[histogram[(from[i].key >> (b * 8)) & 0xff]++] = from[i];
+		RenderCommand* swap = from;
+		from = to;
+		to = swap;
+	}
+	if (from != queue.commands.data())
+		queue.commands.swap(queue.sorted);
+}
+
+void executeRenderQueue(RenderQueue& queue, const std::function<void(const RenderCommand&, unsigned int)>& draw) {
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	sortRenderCommands(queue);
+	std::chrono::steady_clock::time_point sorted = std::chrono::steady_clock::now();
+
+	unsigned int stateChanges = 0;
+	for (size_t i = 0; i < queue.commands.size(); i++) {
+		const RenderCommand& command = queue.commands[i];
+		unsigned int changes;
+		if (i == 0)
+			changes = RENDER_CHANGE_PASS | RENDER_CHANGE_PROGRAM | RENDER_CHANGE_TEXTURE | RENDER_CHANGE_MESH;
+		else {
+			unsigned long long previous = queue.commands[i - 1].key;
+			changes = 0;
+			if (getRenderKeyPass(command.key) != getRenderKeyPass(previous))
+				changes = RENDER_CHANGE_PASS | RENDER_CHANGE_PROGRAM | RENDER_CHANGE_TEXTURE | RENDER_CHANGE_MESH;
+			else if (getRenderKeyProgram(command.key) != getRenderKeyProgram(previous))
+				changes = RENDER_CHANGE_PROGRAM | RENDER_CHANGE_TEXTURE | RENDER_CHANGE_MESH;
+			else {
+				if (getRenderKeyTexture(command.key) != getRenderKeyTexture(previous))
+					changes |= RENDER_CHANGE_TEXTURE;
+				if (getRenderKeyMesh(command.key) != getRenderKeyMesh(previous))
+					changes |= RENDER_CHANGE_MESH;
+			}
+		}
+		for (unsigned int bit = RENDER_CHANGE_PROGRAM; bit <= RENDER_CHANGE_MESH; bit <<= 1) {
+			if (changes & bit)
+				stateChanges++;
+		}
+		draw(command, changes);
+	}
+
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	queue.lastCommands = (unsigned int)queue.commands.size();
+	queue.lastStateChanges = stateChanges;
+	queue.lastSortMs = std::chrono::duration<double, std::milli>(sorted - start).count();
+	queue.lastSubmitMs = std::chrono::duration<double, std::milli>(end - sorted).count();
+	queue.frames++;
+	queue.commandCount += queue.lastCommands;
+	queue.stateChanges += stateChanges;
+	queue.sortMs += queue.lastSortMs;
+	queue.submitMs += queue.lastSubmitMs;
+}
@@ -0,0 +1,56 @@
+#ifndef RENDERQUEUE_HPP
+#define RENDERQUEUE_HPP
+
+#include <vector>
+#include <functional>
+
+// A draw, as the render loop submits it: what to draw is up to the caller (`item`), where it goes
+// in the frame is the key. Keys sort by pass, then program, texture and mesh, so draws that share
+// state end up next to each other, and last by depth, front to back.
+struct RenderCommand {
+	unsigned long long key;
+	unsigned int item;
+};
+
+// Bits of the key, from the top: pass 4, program 4, texture 12, mesh 12, depth 32
+unsigned long long makeRenderKey(unsigned int pass, unsigned int program, unsigned int texture, unsigned int mesh, float depth);
+unsigned int getRenderKeyPass(unsigned long long key);
+unsigned int getRenderKeyProgram(unsigned long long key);
+unsigned int getRenderKeyTexture(unsigned long long key);
+unsigned int getRenderKeyMesh(unsigned long long key);
+
+// What changed since the previous command. A new pass or program changes everything after it,
+// since uniforms and bindings are set per program.
+enum RenderChanges {
+	RENDER_CHANGE_PASS = 1,
+	RENDER_CHANGE_PROGRAM = 2,
+	RENDER_CHANGE_TEXTURE = 4,
+	RENDER_CHANGE_MESH = 8
+};
+
+// The commands of one frame, radix sorted by key before they are executed. Counters are summed
+// over the frames; `last...` are the latest frame's.
+struct RenderQueue {
+	std::vector<RenderCommand> commands;
+	std::vector<RenderCommand> sorted; // scratch for the sort
+
+	unsigned int frames;
+	unsigned long long commandCount, stateChanges;
+	double sortMs, submitMs;
+	unsigned int lastCommands, lastStateChanges;
+	double lastSortMs, lastSubmitMs;
+};
+
+void createRenderQueue(RenderQueue& queue);
+
+// Empties the queue for a new frame
+void beginRenderQueue(RenderQueue& queue);
+
+void submitRenderCommand(RenderQueue& queue, unsigned long long key, unsigned int item);
+
+// Sorts the commands and calls draw for each in key order, with the RenderChanges it needs to
+// bind first. A state is only reported as changed when its part of the key differs from the
+// previous command's, so the caller binds nothing twice in a row.
+void executeRenderQueue(RenderQueue& queue, const std::function<void(const RenderCommand&, unsigned int)>& draw);
+
+#endif
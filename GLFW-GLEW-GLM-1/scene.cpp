@@ -0,0 +1,184 @@
+// Include standard headers
+#include <math.h>
+#include <vector>
+#include <chrono>
+
+// Include GLM
+#include <glm/glm.hpp>
+
+#include "jobs.hpp"
+#include "scene.hpp"
+
+// Below this many bodies the transform pass runs on the calling thread; waking the worker pool
+// for it costs more than the pass itself. Above, the pass is split over the pool's persistent
+// threads, which stay up from frame to frame
+const unsigned int sceneParallelBodies = 32768;
+const unsigned int sceneBodiesPerTask = 8192;
+
+void createScene(Scene& scene, unsigned int reserveCount) {
+	scene.count = 0;
+	scene.position.clear();
+	scene.velocity.clear();
+	scene.orbitAngle.clear();
+	scene.orbitSpeed.clear();
+	scene.scale.clear();
+	scene.mesh.clear();
+	scene.texture.clear();
+	scene.flags.clear();
+	scene.lod.clear();
+	scene.modelMatrix.clear();
+	scene.bodySlot.clear();
+	scene.slotBody.clear();
+	scene.slotGeneration.clear();
+	scene.freeSlots.clear();
+	if (reserveCount > 0) {
+		scene.position.reserve(reserveCount);
+		scene.velocity.reserve(reserveCount);
+		scene.orbitAngle.reserve(reserveCount);
+		scene.orbitSpeed.reserve(reserveCount);
+		scene.scale.reserve(reserveCount);
+		scene.mesh.reserve(reserveCount);
+		scene.texture.reserve(reserveCount);
+		scene.flags.reserve(reserveCount);
+		scene.lod.reserve(reserveCount);
+		scene.modelMatrix.reserve(reserveCount);
+		scene.bodySlot.reserve(reserveCount);
+		scene.slotBody.reserve(reserveCount);
+		scene.slotGeneration.reserve(reserveCount);
+	}
+	scene.updates = 0;
+	scene.updateMs = scene.longestUpdateMs = 0.0;
+}
+
+BodyHandle addBody(Scene& scene, const BodyDesc& desc) {
+	BodyHandle handle;
+	if (!scene.freeSlots.empty()) {
+		handle.slot = scene.freeSlots.back();
+		scene.freeSlots.pop_back();
+	}
+	else {
+		handle.slot = (unsigned int)scene.slotBody.size();
+		scene.slotBody.push_back(0);
+		scene.slotGeneration.push_back(0);
+	}
+	handle.generation = ++scene.slotGeneration[handle.slot];
+	scene.slotBody[handle.slot] = scene.count;
+
+	scene.position.push_back(desc.position);
+	scene.velocity.push_back(desc.velocity);
+	scene.orbitAngle.push_back(desc.orbitAngle);
+	scene.orbitSpeed.push_back(desc.orbitSpeed);
+	scene.scale.push_back(desc.scale);
+	scene.mesh.push_back(desc.mesh);
+	scene.texture.push_back(desc.texture);
+	scene.flags.push_back(desc.flags);
+	scene.lod.push_back(0);
+	scene.modelMatrix.push_back(glm::mat4(1.0f));
+	scene.bodySlot.push_back(handle.slot);
+	scene.count++;
+	return handle;
+}
+
+bool isBodyAlive(const Scene& scene, BodyHandle handle) {
+	return handle.slot < scene.slotGeneration.size() && scene.slotGeneration[handle.slot] == handle.generation && (handle.generation & 1) != 0;
+}
+
+unsigned int getBodyIndex(const Scene& scene, BodyHandle handle) {
+	return scene.slotBody[handle.slot];
+}
+
+BodyHandle getBodyHandle(const Scene& scene, unsigned int index) {
+	BodyHandle handle;
+	handle.slot = scene.bodySlot[index];
+	handle.generation = scene.slotGeneration[handle.slot];
+	return handle;
+}
+
+bool removeBody(Scene& scene, BodyHandle handle) {
+	if (!isBodyAlive(scene, handle))
+		return false;
+
+	// The last body takes the removed one's place, so the arrays stay packed
+	unsigned int index = scene.slotBody[handle.slot];
+	unsigned int last = scene.count - 1;
+	if (index != last) {
+		scene.position[index] = scene.position[last];
+		scene.velocity[index] = scene.velocity[last];
+		scene.orbitAngle[index] = scene.orbitAngle[last];
+		scene.orbitSpeed[index] = scene.orbitSpeed[last];
+		scene.scale[index] = scene.scale[last];
+		scene.mesh[index] = scene.mesh[last];
+		scene.texture[index] = scene.texture[last];
+		scene.flags[index] = scene.flags[last];
+		scene.lod[index] = scene.lod[last];
+		scene.modelMatrix[index] = scene.modelMatrix[last];
+		scene.bodySlot[index] = scene.bodySlot[last];
+		scene.slotBody[scene.bodySlot[index]] = index;
+	}
+	scene.position.pop_back();
+	scene.velocity.pop_back();
+	scene.orbitAngle.pop_back();
+	scene.orbitSpeed.pop_back();
+	scene.scale.pop_back();
+	scene.mesh.pop_back();
+	scene.texture.pop_back();
+	scene.flags.pop_back();
+	scene.lod.pop_back();
+	scene.modelMatrix.pop_back();
+	scene.bodySlot.pop_back();
+	scene.count--;
+
+	scene.slotGeneration[handle.slot]++;
+	scene.freeSlots.push_back(handle.slot);
+	return true;
+}
+
+// The model matrix is rotate(orbitAngle around y) * translate(position) * scale(scale), written
+// out column by column instead of multiplying three matrices
+static void updateBodies(Scene& scene, unsigned int begin, unsigned int end, float orbitStep, float seconds) {
+	glm::vec3* position = scene.position.data();
+	const glm::vec3* velocity = scene.velocity.data();
+	float* orbitAngle = scene.orbitAngle.data();
+	const float* orbitSpeed = scene.orbitSpeed.data();
+	const float* scale = scene.scale.data();
+	glm::mat4* modelMatrix = scene.modelMatrix.data();
+	for (unsigned int i = begin; i < end; i++) {
+		position[i].x += velocity[i].x * seconds;
+		position[i].y += velocity[i].y * seconds;
+		position[i].z += velocity[i].z * seconds;
+		orbitAngle[i] += orbitSpeed[i] * orbitStep;
+
+		float angle = orbitAngle[i] * (3.14159265358979f / 180.0f);
+		float c = cosf(angle);
+		float s = sinf(angle);
+		glm::mat4& m = modelMatrix[i];
+		m[0][0] = c * scale[i]; m[0][1] = 0.0f;     m[0][2] = -s * scale[i]; m[0][3] = 0.0f;
+		m[1][0] = 0.0f;         m[1][1] = scale[i]; m[1][2] = 0.0f;          m[1][3] = 0.0f;
+		m[2][0] = s * scale[i]; m[2][1] = 0.0f;     m[2][2] = c * scale[i];  m[2][3] = 0.0f;
+		m[3][0] = c * position[i].x + s * position[i].z;
+		m[3][1] = position[i].y;
+		m[3][2] = c * position[i].z - s * position[i].x;
+		m[3][3] = 1.0f;
+	}
+}
+
+void updateScene(Scene& scene, float orbitStep, float seconds) {
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	if (scene.count < sceneParallelBodies)
+		updateBodies(scene, 0, scene.count, orbitStep, seconds);
+	else {
+		unsigned int taskCount = (scene.count + sceneBodiesPerTask - 1) / sceneBodiesPerTask;
+		parallelFor(taskCount, [&](unsigned int task) {
+			unsigned int begin = task * sceneBodiesPerTask;
+			unsigned int end = begin + sceneBodiesPerTask < scene.count ? begin + sceneBodiesPerTask : scene.count;
+			updateBodies(scene, begin, end, orbitStep, seconds);
+		});
+	}
+
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	scene.updates++;
+	scene.updateMs += ms;
+	if (ms > scene.longestUpdateMs)
+		scene.longestUpdateMs = ms;
+}
@@ -0,0 +1,79 @@
+#ifndef SCENE_HPP
+#define SCENE_HPP
+
+#include <vector>
+#include <glm/glm.hpp>
+
+// Names a body for as long as it exists. The slot is reused after the body is removed, with the
+// generation counted up, so a handle kept past the removal no longer finds anything.
+struct BodyHandle {
+	unsigned int slot;
+	unsigned int generation;
+};
+
+enum BodyFlags {
+	BODY_SOLID = 1, // projectiles crash into it
+	BODY_DESTRUCTIBLE = 2, // goes when something crashes into it
+	BODY_VIRTUAL_TEXTURED = 4, // `texture` is the index of a virtual texture, not a layer of the texture array
+	BODY_PROJECTILE = 8, // goes when it crashes into a solid body
+	BODY_INSTANCED = 16 // drawn in one instanced draw with the other such bodies of its mesh and texture
+};
+
+// What a body starts out as
+struct BodyDesc {
+	glm::vec3 position;
+	glm::vec3 velocity; // units per second
+	float orbitAngle; // degrees around the y axis through the origin; the position turns with it
+	float orbitSpeed; // how much of each frame's orbit step the body turns by
+	float scale;
+	unsigned int mesh;
+	unsigned int texture;
+	unsigned int flags;
+};
+
+// Every body of the scene, structure of arrays: index i of each vector is one body, and the
+// bodies are packed in [0, count) so that the per-frame passes run straight through the fields
+// they need. Removing a body moves the last one into its place; handles go through the slot
+// tables to find where a body is now.
+struct Scene {
+	unsigned int count;
+	std::vector<glm::vec3> position;
+	std::vector<glm::vec3> velocity;
+	std::vector<float> orbitAngle;
+	std::vector<float> orbitSpeed;
+	std::vector<float> scale;
+	std::vector<unsigned int> mesh;
+	std::vector<unsigned int> texture;
+	std::vector<unsigned int> flags;
+	std::vector<unsigned int> lod; // level of detail it was last drawn at
+	std::vector<glm::mat4> modelMatrix; // from updateScene
+	std::vector<unsigned int> bodySlot; // slot of each body
+
+	// Per slot
+	std::vector<unsigned int> slotBody; // where the slot's body is in the arrays above
+	std::vector<unsigned int> slotGeneration; // odd while the slot holds a body
+	std::vector<unsigned int> freeSlots;
+
+	unsigned int updates;
+	double updateMs, longestUpdateMs;
+};
+
+void createScene(Scene& scene, unsigned int reserveCount = 0);
+
+BodyHandle addBody(Scene& scene, const BodyDesc& desc);
+
+// Returns false when the handle is stale
+bool removeBody(Scene& scene, BodyHandle handle);
+
+bool isBodyAlive(const Scene& scene, BodyHandle handle);
+
+// Index of the body in the scene's arrays, valid until the next removal; the body must be alive
+unsigned int getBodyIndex(const Scene& scene, BodyHandle handle);
+
+BodyHandle getBodyHandle(const Scene& scene, unsigned int index);
+
+// Moves every body by its velocity over `seconds`, turns it by orbitStep degrees times its
+// orbit speed, and recomputes the model matrices. Call once per frame before drawing.
+void updateScene(Scene& scene, float orbitStep, float seconds);
+
+#endif
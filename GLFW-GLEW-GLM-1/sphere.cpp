@@ -0,0 +1,81 @@
+// Include standard headers
+#include <stdio.h>
+#include <math.h>
+#include <vector>
+#include <chrono>
+
+// Include GLM
+#include <glm/glm.hpp>
+
+#include "mesh.hpp"
+#include "sphere.hpp"
+
+void generateSphereMesh(
+	const char* name,
+	const glm::vec3& centre,
+	float radius,
+	unsigned int segments,
+	Mesh& mesh,
+	VertexFormat format
+) {
+	std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+	const float pi = 3.14159265358979f;
+	if (segments < minSphereSegments)
+		segments = minSphereSegments;
+	segments &= ~1u;
+	unsigned int rings = segments / 2;
+
+	// (rings + 1) x (segments + 1) grid: the poles and the seam get a vertex per uv
+	std::vector<glm::vec3> vertices;
+	std::vector<glm::vec2> uvs;
+	std::vector<glm::vec3> normals;
+	vertices.reserve((rings + 1) * (segments + 1));
+	for (unsigned int ring = 0; ring <= rings; ring++) {
+		float theta = pi * ring / rings;
+		for (unsigned int segment = 0; segment <= segments; segment++) {
+			float phi = 2.0f * pi * segment / segments;
+			// Longitude runs counterclockwise seen from +y, so the texture is not mirrored from outside
+			glm::vec3 normal(cosf(phi) * sinf(theta), cosf(theta), -sinf(phi) * sinf(theta));
+			vertices.push_back(centre + normal * radius);
+			uvs.push_back(glm::vec2((float)segment / segments, (float)ring / rings));
+			normals.push_back(normal);
+		}
+	}
+
+	// Every level steps over 2^level rings and meridians of the same grid
+	std::vector<std::vector<unsigned int> > levels;
+	std::vector<float> errors;
+	for (unsigned int step = 1; levels.size() < maxMeshLODs && segments % step == 0 && rings % step == 0 && segments / step >= minSphereSegments; step *= 2) {
+		std::vector<unsigned int> indices;
+		for (unsigned int ring = 0; ring < rings; ring += step) {
+			for (unsigned int segment = 0; segment < segments; segment += step) {
+				unsigned int a = ring * (segments + 1) + segment;
+				unsigned int b = a + step * (segments + 1);
+				unsigned int c = b + step;
+				unsigned int d = a + step;
+				// Counter-clockwise from outside; the pole rows lose one triangle of each quad
+				if (ring + step < rings) {
+					indices.push_back(a);
+					indices.push_back(b);
+					indices.push_back(c);
+				}
+				if (ring > 0) {
+					indices.push_back(a);
+					indices.push_back(c);
+					indices.push_back(d);
+				}
+			}
+		}
+		levels.push_back(indices);
+
+		// A facet's centre sinks radius * (1 - cos^2(step angle / 2)) below the sphere; relative to level 0
+		float halfAngle = pi * step / segments;
+		float level0HalfAngle = pi / segments;
+		errors.push_back(radius * (cosf(level0HalfAngle) * cosf(level0HalfAngle) - cosf(halfAngle) * cosf(halfAngle)));
+	}
+
+	buildMesh(name, levels, errors, vertices, uvs, normals, format, mesh);
+
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+	printf("Generated %s: %u vertices, %u indices in %.2f ms\n", name, mesh.vertexCount, mesh.indexCount, ms);
+}
@@ -0,0 +1,23 @@
+#ifndef SPHERE_HPP
+#define SPHERE_HPP
+
+#include <glm/glm.hpp>
+
+#include "mesh.hpp"
+
+// Procedural UV sphere as an alternative to loading an OBJ: no file I/O, just arithmetic.
+// segments is the number of meridians (rings = segments / 2); uvs are equirectangular with the
+// top of the texture at the north pole (+y). Coarser levels of detail take every 2nd, 4th, ...
+// ring and meridian of the full grid, so they come for free and share its vertices; levels stop
+// once a level would have fewer than minSphereSegments meridians.
+const unsigned int minSphereSegments = 8;
+void generateSphereMesh(
+	const char* name,
+	const glm::vec3& centre,
+	float radius,
+	unsigned int segments,
+	Mesh& mesh,
+	VertexFormat format = VERTEX_FLOAT
+);
+
+#endif
@@ -0,0 +1,471 @@
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#endif
+
+// Include standard headers
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <float.h>
+#include <vector>
+#include <string>
+#include <chrono>
+
+// Include GLM
+#include <glm/glm.hpp>
+
+#include "mappedfile.hpp"
+#include "objloader.hpp"
+#include "meshopt.hpp"
+#include "mesh.hpp"
+#include "streammesh.hpp"
+
+// Chunked mesh cache, written next to the source as <path>.streamcache.
+// Layout (native endianness, every stream 16-byte aligned):
+//   StreamCacheHeader | chunk 0 vertices | chunk 0 indices (u16) | chunk 1 ... | StreamChunk table
+// The table goes last because the chunk count is only known once the whole OBJ went through.
+// Unlike the mesh cache there is no content hash: hashing tens of GB costs as much as re-cooking.
+struct StreamCacheHeader {
+	char magic[4];
+	uint32_t version;
+	uint64_t sourceSize;
+	int64_t sourceTime;
+	uint32_t format;
+	uint32_t chunkCount;
+	uint64_t triangleCount;
+	float boundsMin[3];
+	float boundsMax[3];
+	float sphereCentre[3];
+	float sphereRadius;
+	float uvBoundsMin[2];
+	float uvBoundsMax[2];
+	uint64_t chunkOffset;
+};
+
+static const char streamCacheMagic[4] = { 'S', 'T', 'R', 'M' };
+static const uint32_t streamCacheVersion = 1;
+
+// Triangles read back from the face spill at a time
+static const size_t faceBatch = 1 << 16;
+
+static inline uint64_t alignOffset(uint64_t offset) {
+	return (offset + 15) & ~(uint64_t)15;
+}
+
+static inline uint32_t hashCorner(unsigned int vertexIndex, unsigned int uvIndex, unsigned int normalIndex) {
+	uint32_t h = vertexIndex * 0x9E3779B1u;
+	h ^= uvIndex * 0x85EBCA77u;
+	h ^= normalIndex * 0xC2B2AE3Du;
+	return h ^ (h >> 15);
+}
+
+// Pads the file up to the next 16-byte boundary and appends the bytes there.
+static bool writeAligned(FILE* file, uint64_t& offset, const void* data, size_t size, uint64_t& out_offset) {
+	static const char padding[16] = { 0 };
+	size_t paddingSize = (size_t)(alignOffset(offset) - offset);
+	if (paddingSize > 0 && fwrite(padding, 1, paddingSize, file) != paddingSize)
+		return false;
+	out_offset = offset + paddingSize;
+	if (size > 0 && fwrite(data, 1, size, file) != size)
+		return false;
+	offset = out_offset + size;
+	return true;
+}
+
+// Faces of one chunk, gathered from the spills until it runs out of 16-bit indices.
+// The table maps OBJ index triples to chunk vertices: slot holds the vertex + 1, 0 is empty.
+struct ChunkBuilder {
+	std::vector<unsigned int> table;
+	std::vector<unsigned int> keys; // v / vt / vn of each chunk vertex
+	std::vector<unsigned int> indices;
+	std::vector<glm::vec3> vertices;
+	std::vector<glm::vec2> uvs;
+	std::vector<glm::vec3> normals;
+};
+
+// Everything the chunks of one cook share
+struct StreamCook {
+	VertexFormat format;
+	glm::vec3 boundsMin, boundsMax;
+	glm::vec2 uvBoundsMin, uvBoundsMax;
+	const glm::vec3* positions;
+	const glm::vec2* uvs;
+	const glm::vec3* normals;
+	uint64_t positionCount, uvCount, normalCount;
+	FILE* file;
+	uint64_t offset;
+	std::vector<StreamChunk> chunks;
+	std::vector<unsigned char> vertexBytes;
+	std::vector<unsigned short> shortIndices;
+};
+
+// Optimizes the chunk on its own, packs it and appends it to the cache.
+static bool writeChunk(StreamCook& cook, ChunkBuilder& chunk) {
+	if (chunk.indices.empty())
+		return true;
+
+	optimizeVertexCache(chunk.indices, chunk.vertices);
+	optimizeVertexFetch(chunk.indices, chunk.vertices, chunk.uvs, chunk.normals);
+
+	StreamChunk record;
+	glm::vec3 chunkMin, chunkMax, centre;
+	computeBounds(chunk.vertices, chunkMin, chunkMax, centre, record.sphereRadius);
+	for (int i = 0; i < 3; i++)
+		record.sphereCentre[i] = centre[i];
+
+	packVertices(cook.format, chunk.vertices, chunk.uvs, chunk.normals, cook.boundsMin, cook.boundsMax, cook.uvBoundsMin, cook.uvBoundsMax, cook.vertexBytes);
+	cook.shortIndices.resize(chunk.indices.size());
+	for (size_t i = 0; i < chunk.indices.size(); i++)
+		cook.shortIndices[i] = (unsigned short)chunk.indices[i];
+
+	record.vertexCount = (uint32_t)chunk.vertices.size();
+	record.indexCount = (uint32_t)chunk.indices.size();
+	if (!writeAligned(cook.file, cook.offset, cook.vertexBytes.data(), cook.vertexBytes.size(), record.vertexOffset)
+		|| !writeAligned(cook.file, cook.offset, cook.shortIndices.data(), cook.shortIndices.size() * sizeof(unsigned short), record.indexOffset))
+		return false;
+	cook.chunks.push_back(record);
+
+	std::fill(chunk.table.begin(), chunk.table.end(), 0);
+	chunk.keys.clear();
+	chunk.indices.clear();
+	chunk.vertices.clear();
+	chunk.uvs.clear();
+	chunk.normals.clear();
+	return true;
+}
+
+// Adds one face corner to the chunk, as an existing chunk vertex when the triple was seen before.
+static bool addCorner(StreamCook& cook, ChunkBuilder& chunk, const unsigned int* corner) {
+	unsigned int vertexIndex = corner[0], uvIndex = corner[1], normalIndex = corner[2];
+	size_t tableMask = chunk.table.size() - 1;
+	size_t slot = hashCorner(vertexIndex, uvIndex, normalIndex) & tableMask;
+	for (;;) {
+		unsigned int entry = chunk.table[slot];
+		if (entry == 0)
+			break;
+		const unsigned int* key = &chunk.keys[3 * (entry - 1)];
+		if (key[0] == vertexIndex && key[1] == uvIndex && key[2] == normalIndex) {
+			chunk.indices.push_back(entry - 1);
+			return true;
+		}
+		slot = (slot + 1) & tableMask;
+	}
+
+	if (vertexIndex - 1 >= cook.positionCount || uvIndex - 1 >= cook.uvCount || normalIndex - 1 >= cook.normalCount) {
+		printf("A face references a vertex that does not exist\n");
+		return false;
+	}
+	chunk.keys.insert(chunk.keys.end(), corner, corner + 3);
+	chunk.vertices.push_back(cook.positions[vertexIndex - 1]);
+	chunk.uvs.push_back(cook.uvs[uvIndex - 1]);
+	chunk.normals.push_back(cook.normals[normalIndex - 1]);
+	chunk.table[slot] = (unsigned int)chunk.vertices.size();
+	chunk.indices.push_back((unsigned int)chunk.vertices.size() - 1);
+	return true;
+}
+
+// Streams the OBJ into the cache in two passes over bounded memory:
+// 1. The OBJ is parsed window by window. Positions, uvs and normals are appended to one spill
+//    file each, face corners to a fourth, and the bounds of the whole mesh are accumulated.
+// 2. The attribute spills are mapped and the faces read back in order. Faces are gathered into a
+//    chunk until it runs out of 16-bit indices, then the chunk is optimized, packed and written
+//    out, and the attribute pages it touched are released.
+static bool cookStreamedMesh(const char* path, const std::string& cachePath, VertexFormat format, size_t memoryBudget, const StreamCacheHeader& source) {
+	enum { SPILL_POSITIONS, SPILL_UVS, SPILL_NORMALS, SPILL_FACES, SPILL_COUNT };
+	static const char* spillNames[SPILL_COUNT] = { ".positions.tmp", ".uvs.tmp", ".normals.tmp", ".faces.tmp" };
+	std::string spillPaths[SPILL_COUNT];
+	FILE* spills[SPILL_COUNT] = { NULL };
+	bool ok = true;
+	for (int i = 0; i < SPILL_COUNT; i++) {
+		spillPaths[i] = cachePath + spillNames[i];
+		spills[i] = fopen(spillPaths[i].c_str(), "wb");
+		ok = ok && spills[i] != NULL;
+	}
+
+	StreamCook cook;
+	cook.format = format;
+	cook.boundsMin = glm::vec3(FLT_MAX);
+	cook.boundsMax = glm::vec3(-FLT_MAX);
+	cook.uvBoundsMin = glm::vec2(FLT_MAX);
+	cook.uvBoundsMax = glm::vec2(-FLT_MAX);
+	cook.positionCount = cook.uvCount = cook.normalCount = 0;
+	uint64_t cornerCount = 0;
+
+	// The text window, its parsed records and the interleaved corners each take about a quarter
+	std::vector<unsigned int> corners;
+	if (ok) {
+		ok = streamOBJ(path, memoryBudget / 4, [&](const ObjData& data) {
+			for (size_t i = 0; i < data.positions.size(); i++) {
+				cook.boundsMin = glm::min(cook.boundsMin, data.positions[i]);
+				cook.boundsMax = glm::max(cook.boundsMax, data.positions[i]);
+			}
+			for (size_t i = 0; i < data.uvs.size(); i++) {
+				cook.uvBoundsMin = glm::min(cook.uvBoundsMin, data.uvs[i]);
+				cook.uvBoundsMax = glm::max(cook.uvBoundsMax, data.uvs[i]);
+			}
+			size_t count = data.vertexIndices.size();
+			corners.resize(3 * count);
+			for (size_t i = 0; i < count; i++) {
+				corners[3 * i + 0] = data.vertexIndices[i];
+				corners[3 * i + 1] = data.uvIndices[i];
+				corners[3 * i + 2] = data.normalIndices[i];
+			}
+			cook.positionCount += data.positions.size();
+			cook.uvCount += data.uvs.size();
+			cook.normalCount += data.normals.size();
+			cornerCount += count;
+			return fwrite(data.positions.data(), sizeof(glm::vec3), data.positions.size(), spills[SPILL_POSITIONS]) == data.positions.size()
+				&& fwrite(data.uvs.data(), sizeof(glm::vec2), data.uvs.size(), spills[SPILL_UVS]) == data.uvs.size()
+				&& fwrite(data.normals.data(), sizeof(glm::vec3), data.normals.size(), spills[SPILL_NORMALS]) == data.normals.size()
+				&& fwrite(corners.data(), sizeof(unsigned int), corners.size(), spills[SPILL_FACES]) == corners.size();
+		});
+	}
+	std::vector<unsigned int>().swap(corners);
+	for (int i = 0; i < SPILL_COUNT; i++) {
+		if (spills[i] != NULL)
+			ok = fclose(spills[i]) == 0 && ok;
+	}
+	if (ok && cornerCount == 0) {
+		printf("%s has no faces to stream\n", path);
+		ok = false;
+	}
+
+	MappedFile attributes[3];
+	for (int i = 0; i < 3; i++) {
+		attributes[i].data = NULL;
+		attributes[i].size = 0;
+	}
+	for (int i = 0; i < 3 && ok; i++)
+		ok = openMappedFile(spillPaths[i].c_str(), attributes[i]);
+	FILE* faces = ok ? fopen(spillPaths[SPILL_FACES].c_str(), "rb") : NULL;
+
+	std::string tempPath = cachePath + ".tmp";
+	cook.file = ok && faces != NULL ? fopen(tempPath.c_str(), "wb") : NULL;
+	ok = cook.file != NULL;
+
+	StreamCacheHeader header = source;
+	cook.offset = 0;
+	uint64_t headerOffset;
+	ok = ok && writeAligned(cook.file, cook.offset, &header, sizeof(header), headerOffset);
+
+	if (ok) {
+		cook.positions = (const glm::vec3*)attributes[SPILL_POSITIONS].data;
+		cook.uvs = (const glm::vec2*)attributes[SPILL_UVS].data;
+		cook.normals = (const glm::vec3*)attributes[SPILL_NORMALS].data;
+
+		ChunkBuilder chunk;
+		chunk.table.assign(2 * streamChunkVertices, 0);
+		std::vector<unsigned int> batch(9 * faceBatch);
+		size_t triangles;
+		while (ok && (triangles = fread(batch.data(), 9 * sizeof(unsigned int), faceBatch, faces)) > 0) {
+			for (size_t t = 0; ok && t < triangles; t++) {
+				// Start a new chunk when this triangle might not fit
+				if (chunk.vertices.size() + 3 > streamChunkVertices || chunk.indices.size() == 3 * streamChunkTriangles) {
+					ok = writeChunk(cook, chunk);
+					for (int i = 0; i < 3; i++)
+						releaseMappedRange(attributes[i], 0, attributes[i].size);
+				}
+				for (int c = 0; c < 3 && ok; c++)
+					ok = addCorner(cook, chunk, &batch[9 * t + 3 * c]);
+			}
+		}
+		ok = ok && !ferror(faces) && writeChunk(cook, chunk);
+	}
+
+	if (ok) {
+		// The sphere of the whole mesh encloses the chunk spheres, around the centre of the bounds
+		glm::vec3 centre = (cook.boundsMin + cook.boundsMax) * 0.5f;
+		float radius = 0.0f;
+		for (size_t i = 0; i < cook.chunks.size(); i++) {
+			const StreamChunk& record = cook.chunks[i];
+			glm::vec3 chunkCentre(record.sphereCentre[0], record.sphereCentre[1], record.sphereCentre[2]);
+			float reach = glm::length(chunkCentre - centre) + record.sphereRadius;
+			if (reach > radius)
+				radius = reach;
+		}
+
+		header.format = format;
+		header.chunkCount = (uint32_t)cook.chunks.size();
+		header.triangleCount = cornerCount / 3;
+		for (int i = 0; i < 3; i++) {
+			header.boundsMin[i] = cook.boundsMin[i];
+			header.boundsMax[i] = cook.boundsMax[i];
+			header.sphereCentre[i] = centre[i];
+		}
+		header.sphereRadius = radius;
+		for (int i = 0; i < 2; i++) {
+			header.uvBoundsMin[i] = cook.uvBoundsMin[i];
+			header.uvBoundsMax[i] = cook.uvBoundsMax[i];
+		}
+		ok = writeAligned(cook.file, cook.offset, cook.chunks.data(), cook.chunks.size() * sizeof(StreamChunk), header.chunkOffset)
+			&& fseek(cook.file, 0, SEEK_SET) == 0
+			&& fwrite(&header, sizeof(header), 1, cook.file) == 1;
+	}
+
+	if (cook.file != NULL)
+		ok = fclose(cook.file) == 0 && ok;
+	if (faces != NULL)
+		fclose(faces);
+	for (int i = 0; i < 3; i++)
+		closeMappedFile(attributes[i]);
+	for (int i = 0; i < SPILL_COUNT; i++)
+		remove(spillPaths[i].c_str());
+
+	// Same as the mesh cache: never leave a half-written cache behind
+	remove(cachePath.c_str());
+	if (!ok || rename(tempPath.c_str(), cachePath.c_str()) != 0) {
+		remove(tempPath.c_str());
+		return false;
+	}
+	return true;
+}
+
+// Maps a cache and points the mesh at its chunk table after checking every chunk is inside the file.
+// Offsets are checked before the lengths after them, so a corrupt one cannot wrap the sum. The
+// indices are left for chunkIndicesInRange, which reads them as they are uploaded.
+static bool openStreamCache(const char* cachePath, StreamedMesh& mesh) {
+	if (!openMappedFile(cachePath, mesh.file))
+		return false;
+
+	const StreamCacheHeader* header = (const StreamCacheHeader*)mesh.file.data;
+	uint64_t size = mesh.file.size;
+	bool valid = size >= sizeof(StreamCacheHeader)
+		&& memcmp(header->magic, streamCacheMagic, 4) == 0
+		&& header->version == streamCacheVersion
+		&& (header->format == VERTEX_FLOAT || header->format == VERTEX_QUANTIZED)
+		&& header->chunkOffset <= size && (uint64_t)header->chunkCount * sizeof(StreamChunk) <= size - header->chunkOffset;
+	if (valid) {
+		mesh.format = (VertexFormat)header->format;
+		mesh.vertexSize = getVertexSizes(mesh.format, mesh.positionSize, mesh.uvSize, mesh.normalSize);
+		mesh.chunks = (const StreamChunk*)(mesh.file.data + header->chunkOffset);
+		for (uint32_t i = 0; valid && i < header->chunkCount; i++) {
+			const StreamChunk& chunk = mesh.chunks[i];
+			valid = chunk.vertexCount <= streamChunkVertices && chunk.indexCount <= 3 * streamChunkTriangles
+				&& chunk.vertexOffset <= size && (uint64_t)chunk.vertexCount * mesh.vertexSize <= size - chunk.vertexOffset
+				&& chunk.indexOffset <= size && (uint64_t)chunk.indexCount * sizeof(unsigned short) <= size - chunk.indexOffset;
+		}
+	}
+	if (!valid) {
+		closeMappedFile(mesh.file);
+		return false;
+	}
+
+	mesh.boundsMin = glm::vec3(header->boundsMin[0], header->boundsMin[1], header->boundsMin[2]);
+	mesh.boundsMax = glm::vec3(header->boundsMax[0], header->boundsMax[1], header->boundsMax[2]);
+	mesh.sphereCentre = glm::vec3(header->sphereCentre[0], header->sphereCentre[1], header->sphereCentre[2]);
+	mesh.sphereRadius = header->sphereRadius;
+	mesh.uvBoundsMin = glm::vec2(header->uvBoundsMin[0], header->uvBoundsMin[1]);
+	mesh.uvBoundsMax = glm::vec2(header->uvBoundsMax[0], header->uvBoundsMax[1]);
+	mesh.triangleCount = header->triangleCount;
+	mesh.chunkCount = header->chunkCount;
+
+	// The header and the chunk table are all that is needed up front
+	releaseMappedRange(mesh.file, 0, mesh.file.size);
+	return true;
+}
+
+bool openStreamedMesh(const char* path, StreamedMesh& mesh, VertexFormat format, size_t memoryBudget) {
+	std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+	mesh.chunkCount = 0;
+	mesh.chunks = NULL;
+
+	std::string cachePath = std::string(path) + ".streamcache";
+	unsigned long long sourceSize = 0;
+	long long sourceTime = 0;
+	bool haveSource = statFile(path, sourceSize, sourceTime);
+
+	if (openStreamCache(cachePath.c_str(), mesh)) {
+		const StreamCacheHeader* header = (const StreamCacheHeader*)mesh.file.data;
+		bool fresh = !haveSource || (header->sourceSize == sourceSize && header->sourceTime == sourceTime && mesh.format == format);
+		if (fresh) {
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+			printf("Mapped %s from its cache: %llu triangles in %u chunks in %.2f ms\n", path, mesh.triangleCount, mesh.chunkCount, ms);
+			return true;
+		}
+		closeMappedFile(mesh.file);
+	}
+	if (!haveSource) {
+		printf("Impossible to open the file ! Are you in the right path ? See Tutorial 1 for details\n");
+		return false;
+	}
+
+	StreamCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, streamCacheMagic, 4);
+	header.version = streamCacheVersion;
+	header.sourceSize = sourceSize;
+	header.sourceTime = sourceTime;
+	if (!cookStreamedMesh(path, cachePath, format, memoryBudget, header) || !openStreamCache(cachePath.c_str(), mesh)) {
+		printf("Could not stream %s into %s\n", path, cachePath.c_str());
+		return false;
+	}
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+	printf("Streamed %s: %.1f MB of OBJ into %u chunks (%llu triangles) in %.1f s, peak RSS %.1f MB with a %.1f MB budget\n", path,
+		sourceSize / (1024.0 * 1024.0), mesh.chunkCount, mesh.triangleCount, seconds,
+		getPeakMemoryUsage() / (1024.0 * 1024.0), memoryBudget / (1024.0 * 1024.0));
+	return true;
+}
+
+const void* getChunkVertices(const StreamedMesh& mesh, unsigned int chunk) {
+	return mesh.file.data + mesh.chunks[chunk].vertexOffset;
+}
+
+const void* getChunkIndices(const StreamedMesh& mesh, unsigned int chunk) {
+	return mesh.file.data + mesh.chunks[chunk].indexOffset;
+}
+
+bool chunkIndicesInRange(const StreamedMesh& mesh, unsigned int chunk) {
+	const StreamChunk& record = mesh.chunks[chunk];
+	const unsigned short* indices = (const unsigned short*)getChunkIndices(mesh, chunk);
+	unsigned int largest = 0;
+	for (uint32_t i = 0; i < record.indexCount; i++)
+		largest = indices[i] > largest ? indices[i] : largest;
+	return record.indexCount == 0 || largest < record.vertexCount;
+}
+
+void releaseChunk(const StreamedMesh& mesh, unsigned int chunk) {
+	const StreamChunk& record = mesh.chunks[chunk];
+	releaseMappedRange(mesh.file, (size_t)record.vertexOffset, (size_t)(record.indexOffset + record.indexCount * sizeof(unsigned short) - record.vertexOffset));
+}
+
+void closeStreamedMesh(StreamedMesh& mesh) {
+	closeMappedFile(mesh.file);
+	mesh.chunkCount = 0;
+	mesh.chunks = NULL;
+}
+
+void getDequantization(const StreamedMesh& mesh, glm::vec3& positionScale, glm::vec3& positionOffset, glm::vec2& uvScale, glm::vec2& uvOffset) {
+	if (mesh.format == VERTEX_QUANTIZED) {
+		positionScale = mesh.boundsMax - mesh.boundsMin;
+		positionOffset = mesh.boundsMin;
+		uvScale = mesh.uvBoundsMax - mesh.uvBoundsMin;
+		uvOffset = mesh.uvBoundsMin;
+	}
+	else {
+		positionScale = glm::vec3(1.0f);
+		positionOffset = glm::vec3(0.0f);
+		uvScale = glm::vec2(1.0f);
+		uvOffset = glm::vec2(0.0f);
+	}
+}
+
+size_t getPeakMemoryUsage() {
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return 0;
+	return counters.PeakWorkingSetSize;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+	return (size_t)usage.ru_maxrss * 1024; // kilobytes on Linux
+#endif
+}
@@ -0,0 +1,70 @@
+#ifndef STREAMMESH_HPP
+#define STREAMMESH_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <glm/glm.hpp>
+
+#include "mappedfile.hpp"
+#include "mesh.hpp"
+
+// Meshes bigger than memory are cut into chunks small enough for 16-bit indices. Every chunk is
+// a GPU-ready vertex and index range of the cache with its own bounding sphere, so chunks are
+// culled, uploaded and drawn one at a time and never all need to be in memory.
+const unsigned int streamChunkVertices = 65536;
+const unsigned int streamChunkTriangles = 2 * streamChunkVertices;
+
+// One chunk as stored in the cache; offsets are in bytes from the start of the file.
+struct StreamChunk {
+	uint64_t vertexOffset;
+	uint64_t indexOffset;
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	float sphereCentre[3];
+	float sphereRadius;
+};
+
+// A chunked mesh mapped from its cache (path + ".streamcache"). Quantized chunks are relative to
+// the bounds of the whole mesh, so one set of dequantization uniforms draws all of them.
+struct StreamedMesh {
+	VertexFormat format;
+	unsigned int vertexSize;
+	unsigned int positionSize, uvSize, normalSize; // bytes of each attribute, in that order in a vertex
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+	glm::vec3 sphereCentre;
+	float sphereRadius;
+	glm::vec2 uvBoundsMin;
+	glm::vec2 uvBoundsMax;
+	unsigned long long triangleCount;
+	unsigned int chunkCount;
+	const StreamChunk* chunks;
+
+	MappedFile file;
+};
+
+// Maps the cache of an OBJ, cooking it first when it is missing or stale. The cook never holds
+// the model whole: the OBJ is parsed in windows, its attributes spilled to temporary files next
+// to the cache and its faces gathered into chunks, in about memoryBudget bytes all told.
+bool openStreamedMesh(const char* path, StreamedMesh& mesh, VertexFormat format, size_t memoryBudget);
+
+// A chunk's interleaved vertices and 16-bit indices, inside the mapping.
+const void* getChunkVertices(const StreamedMesh& mesh, unsigned int chunk);
+const void* getChunkIndices(const StreamedMesh& mesh, unsigned int chunk);
+
+// True when every index of a chunk points at one of its own vertices. It reads all the indices,
+// so it is meant for just before they are uploaded, when they are read anyway.
+bool chunkIndicesInRange(const StreamedMesh& mesh, unsigned int chunk);
+
+// Drops a chunk's pages from memory, e.g. once it is uploaded. Reading it again maps it back in.
+void releaseChunk(const StreamedMesh& mesh, unsigned int chunk);
+
+void closeStreamedMesh(StreamedMesh& mesh);
+
+// Same as for a Mesh: uniforms that turn the stored attributes back into model space.
+void getDequantization(const StreamedMesh& mesh, glm::vec3& positionScale, glm::vec3& positionOffset, glm::vec2& uvScale, glm::vec2& uvOffset);
+
+// Largest resident set of the process so far, in bytes.
+size_t getPeakMemoryUsage();
+
+#endif
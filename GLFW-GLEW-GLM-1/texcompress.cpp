@@ -0,0 +1,543 @@
+// Include standard headers
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <stdint.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TEXCOMPRESS_SSE2
+#endif
+
+#include "jobs.hpp"
+#include "texcompress.hpp"
+
+// A 4x4 block, one array per channel so four pixels fill a register.
+struct Block {
+	alignas(16) float r[16];
+	alignas(16) float g[16];
+	alignas(16) float b[16];
+	alignas(16) float a[16];
+};
+
+// The colours a block can pick from, laid out the same way.
+struct Palette {
+	alignas(16) float r[16];
+	alignas(16) float g[16];
+	alignas(16) float b[16];
+	alignas(16) float a[16];
+	int count;
+};
+
+// BC7 interpolation weights for 4-bit indices, out of 64.
+static const int bc7Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+// Where each index sits between the two endpoints, for the least squares refit.
+static const float bc1Positions[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+static const float bc7Positions[16] = {
+	0 / 64.0f, 4 / 64.0f, 9 / 64.0f, 13 / 64.0f, 17 / 64.0f, 21 / 64.0f, 26 / 64.0f, 30 / 64.0f,
+	34 / 64.0f, 38 / 64.0f, 43 / 64.0f, 47 / 64.0f, 51 / 64.0f, 55 / 64.0f, 60 / 64.0f, 64 / 64.0f
+};
+
+static inline float clampChannel(float value) {
+	return value < 0.0f ? 0.0f : (value > 255.0f ? 255.0f : value);
+}
+
+size_t getLevelSize(TextureFormat format, int width, int height, int channels) {
+	size_t blocks = (size_t)((width + 3) / 4) * ((height + 3) / 4);
+	switch (format) {
+	case TEXTURE_BC1:
+		return blocks * 8;
+	case TEXTURE_BC7:
+		return blocks * 16;
+	default:
+		return (size_t)width * height * channels;
+	}
+}
+
+// Reads the block at (bx, by) as RGBA. Gray is spread over r, g and b; alpha is 255 unless the
+// source has it and the format keeps it.
+static void loadBlock(const unsigned char* pixels, int width, int height, int channels, int bx, int by, bool keepAlpha, Block& block) {
+	bool hasAlpha = keepAlpha && (channels == 2 || channels == 4);
+	for (int y = 0; y < 4; y++) {
+		int sy = by * 4 + y < height ? by * 4 + y : height - 1;
+		const unsigned char* row = pixels + (size_t)sy * width * channels;
+		for (int x = 0; x < 4; x++) {
+			int sx = bx * 4 + x < width ? bx * 4 + x : width - 1;
+			const unsigned char* p = row + (size_t)sx * channels;
+			int i = y * 4 + x;
+			block.r[i] = p[0];
+			block.g[i] = channels >= 3 ? p[1] : p[0];
+			block.b[i] = channels >= 3 ? p[2] : p[0];
+			block.a[i] = hasAlpha ? p[channels - 1] : 255.0f;
+		}
+	}
+}
+
+// Picks the closest palette entry for every pixel and returns the summed squared error. This is
+// where the encoders spend their time, so it does four pixels at once when it can.
+static float findIndices(const Block& block, const Palette& palette, unsigned char* indices) {
+#ifdef TEXCOMPRESS_SSE2
+	__m128 total = _mm_setzero_ps();
+	for (int i = 0; i < 16; i += 4) {
+		__m128 r = _mm_load_ps(block.r + i);
+		__m128 g = _mm_load_ps(block.g + i);
+		__m128 b = _mm_load_ps(block.b + i);
+		__m128 a = _mm_load_ps(block.a + i);
+		__m128 best = _mm_set1_ps(FLT_MAX);
+		__m128i bestIndex = _mm_setzero_si128();
+		for (int k = 0; k < palette.count; k++) {
+			__m128 dr = _mm_sub_ps(r, _mm_set1_ps(palette.r[k]));
+			__m128 dg = _mm_sub_ps(g, _mm_set1_ps(palette.g[k]));
+			__m128 db = _mm_sub_ps(b, _mm_set1_ps(palette.b[k]));
+			__m128 da = _mm_sub_ps(a, _mm_set1_ps(palette.a[k]));
+			__m128 error = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)), _mm_add_ps(_mm_mul_ps(db, db), _mm_mul_ps(da, da)));
+			__m128i closer = _mm_castps_si128(_mm_cmplt_ps(error, best));
+			best = _mm_min_ps(error, best);
+			bestIndex = _mm_or_si128(_mm_andnot_si128(closer, bestIndex), _mm_and_si128(closer, _mm_set1_epi32(k)));
+		}
+		total = _mm_add_ps(total, best);
+
+		alignas(16) int32_t lanes[4];
+		_mm_store_si128((__m128i*)lanes, bestIndex);
+		for (int j = 0; j < 4; j++)
+			indices[i + j] = (unsigned char)lanes[j];
+	}
+	alignas(16) float sums[4];
+	_mm_store_ps(sums, total);
+	return sums[0] + sums[1] + sums[2] + sums[3];
+#else
+	float total = 0.0f;
+	for (int i = 0; i < 16; i++) {
+		float best = FLT_MAX;
+		for (int k = 0; k < palette.count; k++) {
+			float dr = block.r[i] - palette.r[k], dg = block.g[i] - palette.g[k];
+			float db = block.b[i] - palette.b[k], da = block.a[i] - palette.a[k];
+			float error = dr * dr + dg * dg + db * db + da * da;
+			if (error < best) {
+				best = error;
+				indices[i] = (unsigned char)k;
+			}
+		}
+		total += best;
+	}
+	return total;
+#endif
+}
+
+// Both ends of the line through the block's colours: its mean and principal axis (power iteration
+// on the covariance), stretched to the furthest pixels on either side.
+static void fitLine(const Block& block, int channels, float e0[4], float e1[4]) {
+	const float* values[4] = { block.r, block.g, block.b, block.a };
+	float mean[4] = { 255.0f, 255.0f, 255.0f, 255.0f };
+	for (int c = 0; c < channels; c++) {
+		float sum = 0.0f;
+		for (int i = 0; i < 16; i++)
+			sum += values[c][i];
+		mean[c] = sum / 16.0f;
+	}
+
+	float covariance[4][4] = { { 0.0f } };
+	for (int c = 0; c < channels; c++) {
+		for (int d = c; d < channels; d++) {
+			float sum = 0.0f;
+			for (int i = 0; i < 16; i++)
+				sum += (values[c][i] - mean[c]) * (values[d][i] - mean[d]);
+			covariance[c][d] = covariance[d][c] = sum;
+		}
+	}
+
+	// Start from the row of the channel that varies most, which cannot be orthogonal to the axis
+	int widest = 0;
+	for (int c = 1; c < channels; c++)
+		if (covariance[c][c] > covariance[widest][widest])
+			widest = c;
+	float axis[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	for (int c = 0; c < channels; c++)
+		axis[c] = covariance[widest][c];
+	for (int iteration = 0; iteration < 8; iteration++) {
+		float next[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		float scale = 0.0f;
+		for (int c = 0; c < channels; c++) {
+			for (int d = 0; d < channels; d++)
+				next[c] += covariance[c][d] * axis[d];
+			if (fabsf(next[c]) > scale)
+				scale = fabsf(next[c]);
+		}
+		if (scale == 0.0f)
+			break;
+		for (int c = 0; c < channels; c++)
+			axis[c] = next[c] / scale;
+	}
+
+	float length = 0.0f;
+	for (int c = 0; c < channels; c++)
+		length += axis[c] * axis[c];
+	float tMin = 0.0f, tMax = 0.0f;
+	if (length > 0.0f) {
+		length = sqrtf(length);
+		for (int c = 0; c < channels; c++)
+			axis[c] /= length;
+		tMin = FLT_MAX;
+		tMax = -FLT_MAX;
+		for (int i = 0; i < 16; i++) {
+			float t = 0.0f;
+			for (int c = 0; c < channels; c++)
+				t += (values[c][i] - mean[c]) * axis[c];
+			if (t < tMin)
+				tMin = t;
+			if (t > tMax)
+				tMax = t;
+		}
+	}
+	for (int c = 0; c < 4; c++) {
+		e0[c] = c < channels ? clampChannel(mean[c] + axis[c] * tMin) : 255.0f;
+		e1[c] = c < channels ? clampChannel(mean[c] + axis[c] * tMax) : 255.0f;
+	}
+}
+
+// Least squares endpoints for fixed indices: the pair whose interpolants, at each pixel's
+// position, come closest to the pixels. False when every pixel sits at the same position.
+static bool refitEndpoints(const Block& block, const unsigned char* indices, const float* positions, int channels, float e0[4], float e1[4]) {
+	const float* values[4] = { block.r, block.g, block.b, block.a };
+	float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+	float ax[4] = { 0.0f, 0.0f, 0.0f, 0.0f }, bx[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	for (int i = 0; i < 16; i++) {
+		float t = positions[indices[i]], s = 1.0f - t;
+		aa += s * s;
+		ab += s * t;
+		bb += t * t;
+		for (int c = 0; c < channels; c++) {
+			ax[c] += s * values[c][i];
+			bx[c] += t * values[c][i];
+		}
+	}
+	float determinant = aa * bb - ab * ab;
+	if (fabsf(determinant) < 1e-6f)
+		return false;
+	for (int c = 0; c < channels; c++) {
+		e0[c] = clampChannel((bb * ax[c] - ab * bx[c]) / determinant);
+		e1[c] = clampChannel((aa * bx[c] - ab * ax[c]) / determinant);
+	}
+	return true;
+}
+
+static inline void writeBits(unsigned char* out, int& bit, unsigned int value, int count) {
+	for (int i = 0; i < count; i++, bit++)
+		out[bit >> 3] |= (unsigned char)(((value >> i) & 1) << (bit & 7));
+}
+
+static inline unsigned int readBits(const unsigned char* in, int& bit, int count) {
+	unsigned int value = 0;
+	for (int i = 0; i < count; i++, bit++)
+		value |= (unsigned int)((in[bit >> 3] >> (bit & 7)) & 1) << i;
+	return value;
+}
+
+// ----- BC1 -----
+
+static inline int packRGB565(const float c[3]) {
+	int r = (int)(c[0] * (31.0f / 255.0f) + 0.5f);
+	int g = (int)(c[1] * (63.0f / 255.0f) + 0.5f);
+	int b = (int)(c[2] * (31.0f / 255.0f) + 0.5f);
+	return (r << 11) | (g << 5) | b;
+}
+
+static inline void unpackRGB565(int value, int c[3]) {
+	int r = (value >> 11) & 31, g = (value >> 5) & 63, b = value & 31;
+	c[0] = (r << 3) | (r >> 2);
+	c[1] = (g << 2) | (g >> 4);
+	c[2] = (b << 3) | (b >> 2);
+}
+
+// The four colours of a block in four-colour mode, rounded the way decoders do.
+static void setBC1Palette(int color0, int color1, Palette& palette) {
+	int c0[3], c1[3];
+	unpackRGB565(color0, c0);
+	unpackRGB565(color1, c1);
+	float* channels[3] = { palette.r, palette.g, palette.b };
+	for (int c = 0; c < 3; c++) {
+		channels[c][0] = (float)c0[c];
+		channels[c][1] = (float)c1[c];
+		channels[c][2] = (float)((2 * c0[c] + c1[c]) / 3);
+		channels[c][3] = (float)((c0[c] + 2 * c1[c]) / 3);
+	}
+	for (int k = 0; k < 4; k++)
+		palette.a[k] = 255.0f;
+	palette.count = 4;
+}
+
+static void encodeBC1Block(const Block& block, unsigned char* out) {
+	float e0[4], e1[4];
+	fitLine(block, 3, e0, e1);
+	int color0 = packRGB565(e1), color1 = packRGB565(e0);
+
+	Palette palette;
+	unsigned char indices[16], trial[16];
+	setBC1Palette(color0, color1, palette);
+	float error = findIndices(block, palette, indices);
+
+	// The line's extremes overshoot once the colours snap to 5:6:5; refit them to the indices
+	for (int iteration = 0; iteration < 2 && error > 0.0f; iteration++) {
+		if (!refitEndpoints(block, indices, bc1Positions, 3, e0, e1))
+			break;
+		int refit0 = packRGB565(e0), refit1 = packRGB565(e1);
+		if (refit0 == color0 && refit1 == color1)
+			break;
+		setBC1Palette(refit0, refit1, palette);
+		float refitError = findIndices(block, palette, trial);
+		if (refitError >= error)
+			break;
+		error = refitError;
+		color0 = refit0;
+		color1 = refit1;
+		memcpy(indices, trial, sizeof(indices));
+	}
+
+	// Four-colour mode needs color0 > color1. Swapping the ends swaps indices 0 <-> 1 and 2 <-> 3;
+	// equal ends decode in three-colour mode, where only index 0 is still the same colour
+	if (color0 < color1) {
+		int swap = color0;
+		color0 = color1;
+		color1 = swap;
+		for (int i = 0; i < 16; i++)
+			indices[i] ^= 1;
+	}
+	else if (color0 == color1) {
+		memset(indices, 0, sizeof(indices));
+	}
+
+	uint32_t bits = 0;
+	for (int i = 0; i < 16; i++)
+		bits |= (uint32_t)indices[i] << (2 * i);
+	out[0] = (unsigned char)color0;
+	out[1] = (unsigned char)(color0 >> 8);
+	out[2] = (unsigned char)color1;
+	out[3] = (unsigned char)(color1 >> 8);
+	for (int i = 0; i < 4; i++)
+		out[4 + i] = (unsigned char)(bits >> (8 * i));
+}
+
+static void decodeBC1Block(const unsigned char* in, unsigned char rgba[16][4]) {
+	int color0 = in[0] | (in[1] << 8), color1 = in[2] | (in[3] << 8);
+	int c0[3], c1[3];
+	unpackRGB565(color0, c0);
+	unpackRGB565(color1, c1);
+
+	unsigned char palette[4][4];
+	for (int c = 0; c < 3; c++) {
+		palette[0][c] = (unsigned char)c0[c];
+		palette[1][c] = (unsigned char)c1[c];
+		if (color0 > color1) {
+			palette[2][c] = (unsigned char)((2 * c0[c] + c1[c]) / 3);
+			palette[3][c] = (unsigned char)((c0[c] + 2 * c1[c]) / 3);
+		}
+		else {
+			palette[2][c] = (unsigned char)((c0[c] + c1[c]) / 2);
+			palette[3][c] = 0;
+		}
+	}
+	palette[0][3] = palette[1][3] = palette[2][3] = 255;
+	palette[3][3] = color0 > color1 ? 255 : 0;
+
+	uint32_t bits = in[4] | (in[5] << 8) | (in[6] << 16) | ((uint32_t)in[7] << 24);
+	for (int i = 0; i < 16; i++)
+		memcpy(rgba[i], palette[(bits >> (2 * i)) & 3], 4);
+}
+
+// ----- BC7 -----
+
+// Mode 6 endpoints: 7 bits per channel and one p-bit per endpoint, shared by its channels, that
+// becomes the lowest of 8 bits once decoded.
+struct BC7Endpoints {
+	int q0[4], q1[4];
+	int p0, p1;
+};
+
+static inline int quantizeBC7(float value, int pbit) {
+	int q = (int)floorf((value - pbit) * 0.5f + 0.5f);
+	return q < 0 ? 0 : (q > 127 ? 127 : q);
+}
+
+static void setBC7Palette(const BC7Endpoints& endpoints, Palette& palette) {
+	float* channels[4] = { palette.r, palette.g, palette.b, palette.a };
+	for (int c = 0; c < 4; c++) {
+		int c0 = (endpoints.q0[c] << 1) | endpoints.p0;
+		int c1 = (endpoints.q1[c] << 1) | endpoints.p1;
+		for (int k = 0; k < 16; k++)
+			channels[c][k] = (float)(((64 - bc7Weights[k]) * c0 + bc7Weights[k] * c1 + 32) >> 6);
+	}
+	palette.count = 16;
+}
+
+// Picks the p-bit that lands an endpoint closest to where it was fitted.
+static int quantizeBC7Endpoint(const float e[4], int q[4]) {
+	float bestError = FLT_MAX;
+	int bestPbit = 0;
+	for (int pbit = 0; pbit < 2; pbit++) {
+		float error = 0.0f;
+		for (int c = 0; c < 4; c++) {
+			float d = e[c] - (float)((quantizeBC7(e[c], pbit) << 1) | pbit);
+			error += d * d;
+		}
+		if (error < bestError) {
+			bestError = error;
+			bestPbit = pbit;
+		}
+	}
+	for (int c = 0; c < 4; c++)
+		q[c] = quantizeBC7(e[c], bestPbit);
+	return bestPbit;
+}
+
+// Quantizes e0 and e1 and keeps them in `best` if they beat bestError. Returns the error of
+// what is now in `best`.
+static float quantizeBC7Endpoints(const Block& block, const float e0[4], const float e1[4], BC7Endpoints& best, unsigned char* indices, float bestError) {
+	BC7Endpoints endpoints;
+	endpoints.p0 = quantizeBC7Endpoint(e0, endpoints.q0);
+	endpoints.p1 = quantizeBC7Endpoint(e1, endpoints.q1);
+	Palette palette;
+	unsigned char trial[16];
+	setBC7Palette(endpoints, palette);
+	float error = findIndices(block, palette, trial);
+	if (error < bestError) {
+		bestError = error;
+		best = endpoints;
+		memcpy(indices, trial, sizeof(trial));
+	}
+	return bestError;
+}
+
+static void encodeBC7Block(const Block& block, unsigned char* out) {
+	float e0[4], e1[4];
+	fitLine(block, 4, e0, e1);
+
+	BC7Endpoints endpoints;
+	unsigned char indices[16];
+	float error = quantizeBC7Endpoints(block, e0, e1, endpoints, indices, FLT_MAX);
+	for (int iteration = 0; iteration < 2 && error > 0.0f; iteration++) {
+		if (!refitEndpoints(block, indices, bc7Positions, 4, e0, e1))
+			break;
+		float refitError = quantizeBC7Endpoints(block, e0, e1, endpoints, indices, error);
+		if (refitError >= error)
+			break;
+		error = refitError;
+	}
+
+	// The first index is stored without its top bit, so it has to be below 8
+	if (indices[0] >= 8) {
+		for (int c = 0; c < 4; c++) {
+			int swap = endpoints.q0[c];
+			endpoints.q0[c] = endpoints.q1[c];
+			endpoints.q1[c] = swap;
+		}
+		int swap = endpoints.p0;
+		endpoints.p0 = endpoints.p1;
+		endpoints.p1 = swap;
+		for (int i = 0; i < 16; i++)
+			indices[i] = (unsigned char)(15 - indices[i]);
+	}
+
+	// Mode 6: 7 mode bits (0000001), r0 r1 g0 g1 b0 b1 a0 a1 in 7 bits each, p0, p1, then the
+	// indices in 4 bits each, 3 for the first
+	memset(out, 0, 16);
+	int bit = 0;
+	writeBits(out, bit, 1 << 6, 7);
+	for (int c = 0; c < 4; c++) {
+		writeBits(out, bit, endpoints.q0[c], 7);
+		writeBits(out, bit, endpoints.q1[c], 7);
+	}
+	writeBits(out, bit, endpoints.p0, 1);
+	writeBits(out, bit, endpoints.p1, 1);
+	writeBits(out, bit, indices[0], 3);
+	for (int i = 1; i < 16; i++)
+		writeBits(out, bit, indices[i], 4);
+}
+
+// Mode 6 only, the one mode the encoder writes; blocks in any other mode decode to zero.
+static void decodeBC7Block(const unsigned char* in, unsigned char rgba[16][4]) {
+	if ((in[0] & 0x7F) != 0x40) {
+		memset(rgba, 0, 16 * 4);
+		return;
+	}
+
+	int bit = 7;
+	int q0[4], q1[4];
+	for (int c = 0; c < 4; c++) {
+		q0[c] = readBits(in, bit, 7);
+		q1[c] = readBits(in, bit, 7);
+	}
+	int p0 = readBits(in, bit, 1), p1 = readBits(in, bit, 1);
+	for (int i = 0; i < 16; i++) {
+		int index = readBits(in, bit, i == 0 ? 3 : 4);
+		for (int c = 0; c < 4; c++) {
+			int c0 = (q0[c] << 1) | p0, c1 = (q1[c] << 1) | p1;
+			rgba[i][c] = (unsigned char)(((64 - bc7Weights[index]) * c0 + bc7Weights[index] * c1 + 32) >> 6);
+		}
+	}
+}
+
+// ----- Levels -----
+
+void compressLevel(TextureFormat format, const unsigned char* pixels, int width, int height, int channels, unsigned char* out_blocks) {
+	if (format == TEXTURE_UNCOMPRESSED) {
+		memcpy(out_blocks, pixels, (size_t)width * height * channels);
+		return;
+	}
+
+	int blocksWide = (width + 3) / 4, blocksHigh = (height + 3) / 4;
+	size_t blockSize = format == TEXTURE_BC1 ? 8 : 16;
+
+	// One task per row of blocks: every block costs about the same, and rows are independent
+	parallelFor((unsigned int)blocksHigh, [&](unsigned int by) {
+		Block block;
+		unsigned char* out = out_blocks + (size_t)by * blocksWide * blockSize;
+		for (int bx = 0; bx < blocksWide; bx++, out += blockSize) {
+			loadBlock(pixels, width, height, channels, bx, (int)by, format == TEXTURE_BC7, block);
+			if (format == TEXTURE_BC1)
+				encodeBC1Block(block, out);
+			else
+				encodeBC7Block(block, out);
+		}
+	});
+}
+
+void decompressLevel(TextureFormat format, const unsigned char* blocks, int width, int height, unsigned char* out_rgba) {
+	int blocksWide = (width + 3) / 4, blocksHigh = (height + 3) / 4;
+	size_t blockSize = format == TEXTURE_BC1 ? 8 : 16;
+	for (int by = 0; by < blocksHigh; by++) {
+		for (int bx = 0; bx < blocksWide; bx++, blocks += blockSize) {
+			unsigned char rgba[16][4];
+			if (format == TEXTURE_BC1)
+				decodeBC1Block(blocks, rgba);
+			else
+				decodeBC7Block(blocks, rgba);
+
+			// Partial blocks at the right and bottom edges only fill what is inside the level
+			for (int y = 0; y < 4 && by * 4 + y < height; y++)
+				for (int x = 0; x < 4 && bx * 4 + x < width; x++)
+					memcpy(out_rgba + ((size_t)(by * 4 + y) * width + bx * 4 + x) * 4, rgba[y * 4 + x], 4);
+		}
+	}
+}
+
+double computePSNR(const unsigned char* pixels, int channels, const unsigned char* rgba, int width, int height, bool compareAlpha) {
+	// Which decoded channel each source channel ended up in: gray is compared against r
+	static const int decodedChannel[4][4] = { { 0 }, { 0, 3 }, { 0, 1, 2 }, { 0, 1, 2, 3 } };
+	const int* map = decodedChannel[channels - 1];
+	// Alpha is the last channel of gray + alpha and RGBA sources
+	int compared = !compareAlpha && (channels == 2 || channels == 4) ? channels - 1 : channels;
+
+	double sum = 0.0;
+	size_t count = (size_t)width * height;
+	for (size_t i = 0; i < count; i++) {
+		for (int c = 0; c < compared; c++) {
+			double difference = (double)pixels[i * channels + c] - rgba[i * 4 + map[c]];
+			sum += difference * difference;
+		}
+	}
+	if (sum == 0.0)
+		return INFINITY;
+	double meanSquaredError = sum / ((double)count * compared);
+	return 10.0 * log10(255.0 * 255.0 / meanSquaredError);
+}
@@ -0,0 +1,35 @@
+#ifndef TEXCOMPRESS_HPP
+#define TEXCOMPRESS_HPP
+
+#include <stddef.h>
+
+// How the levels of a texture are stored, in the texture cache and on the GPU.
+enum TextureFormat {
+	// Tightly packed 8-bit rows of 1 to 4 channels, as decoded
+	TEXTURE_UNCOMPRESSED,
+	// BC1 (DXT1): 8 bytes per 4x4 block, opaque RGB at 4 bits per pixel. Quick to encode,
+	// but smooth gradients band
+	TEXTURE_BC1,
+	// BC7, mode 6 only: 16 bytes per 4x4 block, RGBA at 8 bits per pixel. Much closer to
+	// the source and several times slower to encode
+	TEXTURE_BC7
+};
+
+// Bytes a width x height level takes in the format; compressed levels round up to whole blocks.
+size_t getLevelSize(TextureFormat format, int width, int height, int channels);
+
+// Encodes a level of tightly packed 8-bit pixels with 1 to 4 channels (gray, gray + alpha, RGB,
+// RGBA) into rows of 4x4 blocks; a partial block repeats the last row and column. Rows of blocks
+// are spread over the workers, and SSE2 does the palette search when the compiler targets it.
+void compressLevel(TextureFormat format, const unsigned char* pixels, int width, int height, int channels, unsigned char* out_blocks);
+
+// Decodes blocks written by compressLevel back to RGBA8 rows, for drivers without the extension
+// and to measure the error.
+void decompressLevel(TextureFormat format, const unsigned char* blocks, int width, int height, unsigned char* out_rgba);
+
+// Peak signal-to-noise ratio of decoded RGBA8 rows against the source pixels, over the channels
+// the source has, in dB. Without compareAlpha the source's alpha is left out, for formats like
+// BC1 that do not keep it.
+double computePSNR(const unsigned char* pixels, int channels, const unsigned char* rgba, int width, int height, bool compareAlpha);
+
+#endif
@@ -0,0 +1,540 @@
+// Include standard headers
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <string>
+#include <chrono>
+
+// Include GLEW
+#include <GL/glew.h>
+
+#include "stb_image.h"
+#include "mappedfile.hpp"
+#include "texcompress.hpp"
+#include "texture.hpp"
+#include "decodearena.hpp"
+
+// Texture cache, written next to the source as <path>.texcache. KTX-like:
+//   TextureCacheHeader | level 0 | level 1 | ... (native endianness, every level 16-byte aligned)
+// with every level as tightly packed 8-bit rows of `channels` components, or as rows of 4x4 blocks
+// when `format` is compressed, down to 1 x 1.
+// Keyed to the source file the same way as the mesh cache: size + mtime, then the content hash.
+struct TextureCacheHeader {
+	char magic[4];
+	uint32_t version;
+	uint64_t sourceSize;
+	int64_t sourceTime;
+	uint64_t sourceHash;
+	uint32_t width;
+	uint32_t height;
+	uint32_t channels;
+	uint32_t format;
+	uint32_t mipCount;
+	uint64_t mipOffset[maxTextureMips];
+	uint64_t mipSize[maxTextureMips];
+};
+
+static const char textureCacheMagic[4] = { 'T', 'E', 'X', 'C' };
+static const uint32_t textureCacheVersion = 2;
+// Largest side a cache may claim: its full mip chain is maxTextureMips levels
+static const uint32_t maxTextureCacheSide = 1u << (maxTextureMips - 1);
+
+static inline uint64_t alignOffset(uint64_t offset) {
+	return (offset + 15) & ~(uint64_t)15;
+}
+
+static inline int mipDimension(int size, unsigned int level) {
+	size >>= level;
+	return size > 0 ? size : 1;
+}
+
+// Levels from width x height down to 1 x 1, no more than maxTextureMips
+static unsigned int getMipChainLength(int width, int height) {
+	unsigned int count = 1;
+	while (count < maxTextureMips && (mipDimension(width, count - 1) > 1 || mipDimension(height, count - 1) > 1))
+		count++;
+	return count;
+}
+
+static void initImage(Image& image) {
+	image.width = image.height = image.channels = 0;
+	image.format = TEXTURE_UNCOMPRESSED;
+	image.mipCount = 0;
+	memset(image.mips, 0, sizeof(image.mips));
+	image.file.data = NULL;
+	image.file.size = 0;
+	image.file.fileHandle = NULL;
+	image.file.mappingHandle = NULL;
+	std::vector<unsigned char>().swap(image.mipStorage);
+}
+
+// 2x2 box filter, the same average glGenerateMipmap takes. An odd last row or column is
+// averaged with itself.
+static void downsample(const unsigned char* source, int sourceWidth, int sourceHeight, unsigned char* target, int width, int height, int channels) {
+	for (int y = 0; y < height; y++) {
+		const unsigned char* row0 = source + (size_t)(2 * y < sourceHeight ? 2 * y : sourceHeight - 1) * sourceWidth * channels;
+		const unsigned char* row1 = source + (size_t)(2 * y + 1 < sourceHeight ? 2 * y + 1 : sourceHeight - 1) * sourceWidth * channels;
+		for (int x = 0; x < width; x++) {
+			int x0 = (2 * x < sourceWidth ? 2 * x : sourceWidth - 1) * channels;
+			int x1 = (2 * x + 1 < sourceWidth ? 2 * x + 1 : sourceWidth - 1) * channels;
+			for (int c = 0; c < channels; c++)
+				*target++ = (unsigned char)((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) >> 2);
+		}
+	}
+}
+
+// Resizes the decoded pixels in place, e.g. to the layer size of a texture array. Shrinking by
+// half or more goes through the box filter first so every texel still counts; the rest is
+// bilinear.
+static void resizePixels(std::vector<unsigned char>& pixels, int& width, int& height, int channels, int targetWidth, int targetHeight) {
+	std::vector<unsigned char> resized;
+	while (width >= 2 * targetWidth && height >= 2 * targetHeight) {
+		int halfWidth = (width + 1) / 2, halfHeight = (height + 1) / 2;
+		resized.resize((size_t)halfWidth * halfHeight * channels);
+		downsample(pixels.data(), width, height, resized.data(), halfWidth, halfHeight, channels);
+		pixels.swap(resized);
+		width = halfWidth;
+		height = halfHeight;
+	}
+	if (width == targetWidth && height == targetHeight)
+		return;
+
+	resized.resize((size_t)targetWidth * targetHeight * channels);
+	unsigned char* target = resized.data();
+	for (int y = 0; y < targetHeight; y++) {
+		float sy = (y + 0.5f) * height / targetHeight - 0.5f;
+		sy = sy < 0.0f ? 0.0f : (sy > height - 1 ? (float)(height - 1) : sy);
+		int y0 = (int)sy, y1 = y0 + 1 < height ? y0 + 1 : y0;
+		float fy = sy - y0;
+		for (int x = 0; x < targetWidth; x++) {
+			float sx = (x + 0.5f) * width / targetWidth - 0.5f;
+			sx = sx < 0.0f ? 0.0f : (sx > width - 1 ? (float)(width - 1) : sx);
+			int x0 = (int)sx, x1 = x0 + 1 < width ? x0 + 1 : x0;
+			float fx = sx - x0;
+			const unsigned char* p00 = pixels.data() + ((size_t)y0 * width + x0) * channels;
+			const unsigned char* p01 = pixels.data() + ((size_t)y0 * width + x1) * channels;
+			const unsigned char* p10 = pixels.data() + ((size_t)y1 * width + x0) * channels;
+			const unsigned char* p11 = pixels.data() + ((size_t)y1 * width + x1) * channels;
+			for (int c = 0; c < channels; c++) {
+				float top = p00[c] + (p01[c] - p00[c]) * fx;
+				float bottom = p10[c] + (p11[c] - p10[c]) * fx;
+				*target++ = (unsigned char)(top + (bottom - top) * fy + 0.5f);
+			}
+		}
+	}
+	pixels.swap(resized);
+	width = targetWidth;
+	height = targetHeight;
+}
+
+// Lays out the full mip chain of the decoded pixels in mipStorage, each level 16-byte aligned.
+static void buildMipChain(const unsigned char* pixels, Image& image, uint64_t* offsets, uint64_t* sizes) {
+	image.mipCount = getMipChainLength(image.width, image.height);
+
+	uint64_t total = 0;
+	for (unsigned int level = 0; level < image.mipCount; level++) {
+		offsets[level] = total;
+		sizes[level] = (uint64_t)mipDimension(image.width, level) * mipDimension(image.height, level) * image.channels;
+		total = alignOffset(total + sizes[level]);
+	}
+	image.mipStorage.resize((size_t)total);
+
+	memcpy(image.mipStorage.data(), pixels, (size_t)sizes[0]);
+	for (unsigned int level = 1; level < image.mipCount; level++) {
+		downsample(image.mipStorage.data() + offsets[level - 1], mipDimension(image.width, level - 1), mipDimension(image.height, level - 1),
+			image.mipStorage.data() + offsets[level], mipDimension(image.width, level), mipDimension(image.height, level), image.channels);
+	}
+	for (unsigned int level = 0; level < image.mipCount; level++)
+		image.mips[level] = image.mipStorage.data() + offsets[level];
+}
+
+// Replaces the levels in mipStorage with their compressed blocks and reports how fast and how
+// close the encoder was.
+static void compressMipChain(const char* path, Image& image, TextureFormat format, uint64_t* offsets, uint64_t* sizes) {
+	std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+	std::vector<unsigned char> blocks;
+	uint64_t compressedOffsets[maxTextureMips];
+	uint64_t total = 0;
+	for (unsigned int level = 0; level < image.mipCount; level++) {
+		compressedOffsets[level] = total;
+		total = alignOffset(total + getLevelSize(format, mipDimension(image.width, level), mipDimension(image.height, level), image.channels));
+	}
+	blocks.resize((size_t)total);
+
+	double pixelCount = 0.0;
+	for (unsigned int level = 0; level < image.mipCount; level++) {
+		int width = mipDimension(image.width, level), height = mipDimension(image.height, level);
+		compressLevel(format, image.mips[level], width, height, image.channels, blocks.data() + compressedOffsets[level]);
+		pixelCount += (double)width * height;
+	}
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+
+	// The largest level is what gets looked at, so that is the one measured
+	std::vector<unsigned char> decoded((size_t)image.width * image.height * 4);
+	decompressLevel(format, blocks.data(), image.width, image.height, decoded.data());
+	// BC1 keeps no alpha (it decodes to 255), so only the colour is compared
+	double psnr = computePSNR(image.mips[0], image.channels, decoded.data(), image.width, image.height, format != TEXTURE_BC1);
+	printf("Compressed %s to %s: %.2f MPix in %.1f ms (%.1f MPix/s), PSNR %.2f dB\n", path, format == TEXTURE_BC1 ? "BC1" : "BC7",
+		pixelCount / 1e6, ms, ms > 0.0 ? pixelCount / 1e3 / ms : 0.0, psnr);
+
+	image.mipStorage.swap(blocks);
+	image.format = format;
+	for (unsigned int level = 0; level < image.mipCount; level++) {
+		offsets[level] = compressedOffsets[level];
+		sizes[level] = getLevelSize(format, mipDimension(image.width, level), mipDimension(image.height, level), image.channels);
+		image.mips[level] = image.mipStorage.data() + offsets[level];
+	}
+}
+
+static bool writeTextureCache(const char* cachePath, TextureCacheHeader header, const Image& image) {
+	// The levels are already laid out in storage; the file only shifts them past the header
+	uint64_t base = alignOffset(sizeof(TextureCacheHeader));
+	for (unsigned int level = 0; level < image.mipCount; level++)
+		header.mipOffset[level] += base;
+
+	std::string tempPath = std::string(cachePath) + ".tmp";
+	FILE* file = fopen(tempPath.c_str(), "wb");
+	if (file == NULL)
+		return false;
+
+	static const char padding[16] = { 0 };
+	size_t paddingSize = (size_t)(base - sizeof(header));
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+		&& fwrite(padding, 1, paddingSize, file) == paddingSize
+		&& fwrite(image.mipStorage.data(), 1, image.mipStorage.size(), file) == image.mipStorage.size();
+	ok = fclose(file) == 0 && ok;
+
+	remove(cachePath);
+	if (!ok || rename(tempPath.c_str(), cachePath) != 0) {
+		remove(tempPath.c_str());
+		return false;
+	}
+	return true;
+}
+
+// Maps a cache and points the image at its levels after checking they are all inside the file.
+// Sizes are checked before they reach mipDimension as ints, offsets before the lengths after them.
+static bool openTextureCache(const char* cachePath, Image& image) {
+	if (!openMappedFile(cachePath, image.file))
+		return false;
+
+	const TextureCacheHeader* header = (const TextureCacheHeader*)image.file.data;
+	bool valid = image.file.size >= sizeof(TextureCacheHeader)
+		&& memcmp(header->magic, textureCacheMagic, 4) == 0
+		&& header->version == textureCacheVersion
+		&& header->channels >= 1 && header->channels <= 4
+		&& header->format <= TEXTURE_BC7
+		&& header->width >= 1 && header->width <= maxTextureCacheSide
+		&& header->height >= 1 && header->height <= maxTextureCacheSide
+		&& header->mipCount >= 1 && header->mipCount <= getMipChainLength(header->width, header->height);
+	for (uint32_t level = 0; valid && level < header->mipCount; level++) {
+		uint64_t size = getLevelSize((TextureFormat)header->format, mipDimension(header->width, level), mipDimension(header->height, level), header->channels);
+		valid = header->mipSize[level] == size && header->mipOffset[level] <= image.file.size && size <= image.file.size - header->mipOffset[level];
+	}
+	if (!valid) {
+		closeMappedFile(image.file);
+		return false;
+	}
+
+	image.width = header->width;
+	image.height = header->height;
+	image.channels = header->channels;
+	image.format = (TextureFormat)header->format;
+	image.mipCount = header->mipCount;
+	for (uint32_t level = 0; level < header->mipCount; level++)
+		image.mips[level] = (const unsigned char*)image.file.data + header->mipOffset[level];
+	return true;
+}
+
+// Records a new source mtime in an existing cache, so the content hash is not redone every run.
+static void touchTextureCache(const char* cachePath, long long sourceTime) {
+	FILE* file = fopen(cachePath, "r+b");
+	if (file == NULL)
+		return;
+	int64_t time = sourceTime;
+	if (fseek(file, offsetof(TextureCacheHeader, sourceTime), SEEK_SET) == 0)
+		fwrite(&time, sizeof(time), 1, file);
+	fclose(file);
+}
+
+bool loadImage(const char* path, Image& image, TextureFormat format, int width, int height) {
+	std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+	initImage(image);
+
+	std::string cachePath = std::string(path) + ".texcache";
+	unsigned long long sourceSize = 0;
+	long long sourceTime = 0;
+	bool haveSource = statFile(path, sourceSize, sourceTime);
+
+	if (openTextureCache(cachePath.c_str(), image)) {
+		const TextureCacheHeader* header = (const TextureCacheHeader*)image.file.data;
+
+		// A cache without its source is fine: ship the cache, not the JPEG, in whatever layout it has
+		bool sameLayout = header->format == (uint32_t)format
+			&& (width <= 0 || height <= 0 || (header->width == (uint32_t)width && header->height == (uint32_t)height));
+		bool fresh = !haveSource || (sameLayout && header->sourceSize == sourceSize && header->sourceTime == sourceTime);
+		if (!fresh && sameLayout && header->sourceSize == sourceSize) {
+			unsigned long long sourceHash;
+			if (hashFile(path, sourceHash) && sourceHash == header->sourceHash) {
+				closeMappedFile(image.file);
+				touchTextureCache(cachePath.c_str(), sourceTime);
+				fresh = openTextureCache(cachePath.c_str(), image);
+			}
+		}
+		if (fresh) {
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+			printf("Loaded %s from its cache: %dx%d, %u mip levels in %.2f ms\n", path, image.width, image.height, image.mipCount, ms);
+			return true;
+		}
+		closeMappedFile(image.file);
+		initImage(image);
+	}
+
+	// The pixels come back in this thread's decode arena, and go back to it with stbi_image_free
+	DecodeArenaStats arenaBefore = getDecodeArenaStats();
+	std::chrono::steady_clock::time_point decodeStart = std::chrono::steady_clock::now();
+	unsigned char* pixels = stbi_load(path, &image.width, &image.height, &image.channels, 0);
+	if (pixels == NULL) {
+		printf("Failed to load texture %s: %s\n", path, stbi_failure_reason());
+		initImage(image);
+		return false;
+	}
+	double decodeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - decodeStart).count();
+	DecodeArenaStats arenaAfter = getDecodeArenaStats();
+	printf("Decoded %s in %.1f ms: %llu allocations, %llu from the heap, arena peak %.1f MB\n", path, decodeMs,
+		arenaAfter.allocations - arenaBefore.allocations, arenaAfter.heapAllocations - arenaBefore.heapAllocations, arenaAfter.peakBytes / (1024.0 * 1024.0));
+
+	TextureCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	if (width > 0 && height > 0 && (width != image.width || height != image.height)) {
+		std::vector<unsigned char> resized(pixels, pixels + (size_t)image.width * image.height * image.channels);
+		stbi_image_free(pixels);
+		resizePixels(resized, image.width, image.height, image.channels, width, height);
+		buildMipChain(resized.data(), image, header.mipOffset, header.mipSize);
+	}
+	else {
+		buildMipChain(pixels, image, header.mipOffset, header.mipSize);
+		stbi_image_free(pixels);
+	}
+	if (format != TEXTURE_UNCOMPRESSED)
+		compressMipChain(path, image, format, header.mipOffset, header.mipSize);
+
+	memcpy(header.magic, textureCacheMagic, 4);
+	header.version = textureCacheVersion;
+	header.sourceSize = sourceSize;
+	header.sourceTime = sourceTime;
+	unsigned long long sourceHash = 0;
+	hashFile(path, sourceHash);
+	header.sourceHash = sourceHash;
+	header.width = image.width;
+	header.height = image.height;
+	header.channels = image.channels;
+	header.format = image.format;
+	header.mipCount = image.mipCount;
+
+	// Serve even the first load from the mapping, so both paths upload the same way
+	Image cached;
+	initImage(cached);
+	if (writeTextureCache(cachePath.c_str(), header, image) && openTextureCache(cachePath.c_str(), cached)) {
+		image.file = cached.file;
+		memcpy(image.mips, cached.mips, sizeof(image.mips));
+		std::vector<unsigned char>().swap(image.mipStorage);
+	}
+	else {
+		printf("Could not write %s, keeping the texture in memory\n", cachePath.c_str());
+	}
+
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+	printf("Cooked %s: %dx%d, %u mip levels in %.2f ms\n", path, image.width, image.height, image.mipCount, ms);
+	return true;
+}
+
+void freeImage(Image& image) {
+	closeMappedFile(image.file);
+	initImage(image);
+}
+
+void moveImage(Image& from, Image& to) {
+	freeImage(to);
+	// The storage keeps its buffer when swapped, so levels pointing into it stay valid
+	to.width = from.width;
+	to.height = from.height;
+	to.channels = from.channels;
+	to.format = from.format;
+	to.mipCount = from.mipCount;
+	memcpy(to.mips, from.mips, sizeof(to.mips));
+	to.file = from.file;
+	to.mipStorage.swap(from.mipStorage);
+	initImage(from);
+}
+
+size_t getImageBytes(const Image& image) {
+	return image.file.data != NULL ? image.file.size : image.mipStorage.size();
+}
+
+GLenum getPixelFormat(int channels) {
+	return channels == 4 ? GL_RGBA : (channels == 2 ? GL_RG : (channels == 1 ? GL_RED : GL_RGB));
+}
+
+GLenum getCompressedFormat(TextureFormat format) {
+	return format == TEXTURE_BC1 ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_BPTC_UNORM;
+}
+
+bool isCompressionSupported(TextureFormat format) {
+	return format == TEXTURE_BC1 ? GLEW_EXT_texture_compression_s3tc != 0 : GLEW_ARB_texture_compression_bptc != 0;
+}
+
+GLuint uploadTexture(const Image& image) {
+	if (image.mipCount == 0)
+		return 0;
+
+	GLenum format = getPixelFormat(image.channels);
+	GLenum compressedFormat = getCompressedFormat(image.format);
+	bool compressed = image.format != TEXTURE_UNCOMPRESSED;
+	bool compressionSupported = isCompressionSupported(image.format);
+
+	GLuint textureID;
+	glGenTextures(1, &textureID);
+
+	// "Bind" the newly created texture : all future texture functions will modify this texture
+	glBindTexture(GL_TEXTURE_2D, textureID);
+
+	// Give every level to OpenGL as it is stored, instead of having it generate the mipmaps;
+	// the rows are tightly packed
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	std::vector<unsigned char> decoded;
+	for (unsigned int level = 0; level < image.mipCount; level++) {
+		int width = mipDimension(image.width, level), height = mipDimension(image.height, level);
+		if (!compressed) {
+			glTexImage2D(GL_TEXTURE_2D, level, format, width, height, 0, format, GL_UNSIGNED_BYTE, image.mips[level]);
+		}
+		else if (compressionSupported) {
+			GLsizei size = (GLsizei)getLevelSize(image.format, width, height, image.channels);
+			glCompressedTexImage2D(GL_TEXTURE_2D, level, compressedFormat, width, height, 0, size, image.mips[level]);
+		}
+		else {
+			decoded.resize((size_t)width * height * 4);
+			decompressLevel(image.format, image.mips[level], width, height, decoded.data());
+			glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, decoded.data());
+		}
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, image.mipCount - 1);
+	return textureID;
+}
+
+// Checks that the layers match, then allocates every level from firstLevel down for all of them,
+// each level in the format it will be filled with. Leaves the texture bound.
+static GLuint createTextureArray(const Image* images, unsigned int count, unsigned int firstLevel) {
+	if (count == 0 || firstLevel >= images[0].mipCount)
+		return 0;
+
+	// Layers share one size, one mip chain and one internal format
+	const Image& first = images[0];
+	for (unsigned int layer = 0; layer < count; layer++) {
+		const Image& image = images[layer];
+		if (image.mipCount == 0 || image.width != first.width || image.height != first.height || image.mipCount != first.mipCount || image.format != first.format) {
+			printf("Texture layer %u (%dx%d, %u levels, format %d) does not match layer 0 (%dx%d, %u levels, format %d)\n",
+				layer, image.width, image.height, image.mipCount, image.format, first.width, first.height, first.mipCount, first.format);
+			return 0;
+		}
+	}
+
+	bool compressed = first.format != TEXTURE_UNCOMPRESSED;
+	bool compressionSupported = isCompressionSupported(first.format);
+	GLenum compressedFormat = getCompressedFormat(first.format);
+
+	GLuint textureID;
+	glGenTextures(1, &textureID);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, textureID);
+	for (unsigned int level = firstLevel; level < first.mipCount; level++) {
+		int width = mipDimension(first.width, level), height = mipDimension(first.height, level);
+		if (compressed && compressionSupported) {
+			GLsizei layerSize = (GLsizei)getLevelSize(first.format, width, height, first.channels);
+			glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level - firstLevel, compressedFormat, width, height, count, 0, layerSize * count, NULL);
+		}
+		else {
+			// Uncompressed layers may have different channel counts; GL widens them all to RGBA8
+			glTexImage3D(GL_TEXTURE_2D_ARRAY, level - firstLevel, GL_RGBA8, width, height, count, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		}
+	}
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, first.mipCount - 1 - firstLevel);
+	return textureID;
+}
+
+size_t getTextureArrayBytes(const Image* images, unsigned int count, unsigned int firstLevel) {
+	if (count == 0)
+		return 0;
+	const Image& first = images[0];
+	bool compressed = first.format != TEXTURE_UNCOMPRESSED && isCompressionSupported(first.format);
+	size_t bytes = 0;
+	for (unsigned int level = firstLevel; level < first.mipCount; level++) {
+		int width = mipDimension(first.width, level), height = mipDimension(first.height, level);
+		bytes += compressed ? getLevelSize(first.format, width, height, first.channels) : (size_t)width * height * 4;
+	}
+	return bytes * count;
+}
+
+GLuint uploadTextureArray(const Image* images, unsigned int count) {
+	GLuint textureID = createTextureArray(images, count, 0);
+	if (textureID == 0)
+		return 0;
+
+	const Image& first = images[0];
+	bool compressed = first.format != TEXTURE_UNCOMPRESSED;
+	bool compressionSupported = isCompressionSupported(first.format);
+	GLenum compressedFormat = getCompressedFormat(first.format);
+
+	// Every level is allocated for all layers at once, then filled a layer at a time
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	std::vector<unsigned char> decoded;
+	for (unsigned int level = 0; level < first.mipCount; level++) {
+		int width = mipDimension(first.width, level), height = mipDimension(first.height, level);
+		for (unsigned int layer = 0; layer < count; layer++) {
+			if (compressed && compressionSupported) {
+				GLsizei layerSize = (GLsizei)getLevelSize(first.format, width, height, first.channels);
+				glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, width, height, 1, compressedFormat, layerSize, images[layer].mips[level]);
+			}
+			else if (compressed) {
+				decoded.resize((size_t)width * height * 4);
+				decompressLevel(first.format, images[layer].mips[level], width, height, decoded.data());
+				glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, decoded.data());
+			}
+			else {
+				glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, width, height, 1, getPixelFormat(images[layer].channels), GL_UNSIGNED_BYTE, images[layer].mips[level]);
+			}
+		}
+	}
+	return textureID;
+}
+
+GLuint queueTextureArray(const Image* images, unsigned int count, TextureUploadQueue& queue, unsigned int firstLevel) {
+	GLuint textureID = createTextureArray(images, count, firstLevel);
+	if (textureID == 0)
+		return 0;
+
+	// Until the coarsest level is in, the texture samples that level's undefined texels
+	const Image& first = images[0];
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, first.mipCount - 1 - firstLevel);
+
+	bool decode = first.format != TEXTURE_UNCOMPRESSED && !isCompressionSupported(first.format);
+	for (int level = (int)first.mipCount - 1; level >= (int)firstLevel; level--) {
+		for (unsigned int layer = 0; layer < count; layer++) {
+			TextureUpload upload;
+			upload.target = GL_TEXTURE_2D_ARRAY;
+			upload.texture = textureID;
+			upload.level = level - (int)firstLevel;
+			upload.layer = (int)layer;
+			upload.width = mipDimension(first.width, level);
+			upload.height = mipDimension(first.height, level);
+			upload.channels = images[layer].channels;
+			upload.format = first.format;
+			upload.decode = decode;
+			upload.setBaseLevel = layer + 1 == count;
+			upload.pixels = images[layer].mips[level];
+			queueTextureUpload(queue, upload);
+		}
+	}
+	return textureID;
+}
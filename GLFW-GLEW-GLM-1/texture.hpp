@@ -0,0 +1,71 @@
+#ifndef TEXTURE_HPP
+#define TEXTURE_HPP
+
+#include <vector>
+#include <GL/glew.h>
+
+#include "mappedfile.hpp"
+#include "texcompress.hpp"
+#include "textureupload.hpp"
+
+// Mip levels a texture can have, enough for 32768 x 32768.
+const unsigned int maxTextureMips = 16;
+
+// A decoded image with its whole mip chain, largest level first, each level tightly packed
+// 8-bit rows or, once compressed, rows of blocks. The levels point into the mapped texture cache
+// of the source file, or into mipStorage when the cache could not be written.
+struct Image {
+	int width;
+	int height;
+	int channels; // of the source; BC1 drops alpha, BC7 keeps it
+	TextureFormat format;
+	unsigned int mipCount;
+	const unsigned char* mips[maxTextureMips];
+
+	MappedFile file;
+	std::vector<unsigned char> mipStorage;
+};
+
+// Reads an image through its texture cache (path + ".texcache"). The first load decodes it with
+// stb_image, resizes it to width x height when those are given, builds the mip chain, compresses
+// every level to `format` and writes the cache; later loads only map it, as long as the source,
+// size and format are unchanged. Touches no GL state, so it can run on a worker thread.
+bool loadImage(const char* path, Image& image, TextureFormat format = TEXTURE_UNCOMPRESSED, int width = 0, int height = 0);
+void freeImage(Image& image);
+
+// Hands the levels of an image, mapped or in storage, over to another, leaving `from` empty.
+void moveImage(Image& from, Image& to);
+
+// Bytes the levels of an image take on the CPU: its mapping, or its storage.
+size_t getImageBytes(const Image& image);
+
+// GL internal format of a compressed format, and whether the driver takes it.
+GLenum getCompressedFormat(TextureFormat format);
+bool isCompressionSupported(TextureFormat format);
+
+// GL format of tightly packed rows with 1 to 4 channels.
+GLenum getPixelFormat(int channels);
+
+// Creates a mipmapped 2D texture from the image, one glTexImage2D per level, or
+// glCompressedTexImage2D for compressed levels. Without the extension for the format the blocks
+// are decoded back to RGBA on the CPU first. Needs the GL context, so main thread only.
+// Returns 0 for an image that failed to load.
+GLuint uploadTexture(const Image& image);
+
+// Creates a mipmapped 2D texture array with one image per layer, so draws that sample different
+// images share one bind and only pick a layer. The images must have the same size, mip count and
+// format; load them with the same width, height and format. Returns 0 when they do not match.
+GLuint uploadTextureArray(const Image* images, unsigned int count);
+
+// Same texture array, with the levels going through the upload queue instead: coarsest level
+// first, each one becoming the base level once all its layers are in, so the texture is usable
+// from the first frame and sharpens as the finer levels arrive. The first firstLevel levels of the
+// images are left out, halving the texture each. The images must stay loaded until the queue has
+// no uploads left for the texture. Returns 0 when they do not match.
+GLuint queueTextureArray(const Image* images, unsigned int count, TextureUploadQueue& queue, unsigned int firstLevel = 0);
+
+// GPU bytes of a texture array of the images without its first firstLevel levels: every level
+// left, all layers, in the internal format it is uploaded in.
+size_t getTextureArrayBytes(const Image* images, unsigned int count, unsigned int firstLevel = 0);
+
+#endif
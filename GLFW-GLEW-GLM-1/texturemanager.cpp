@@ -0,0 +1,120 @@
+// Include standard headers
+#include <stdio.h>
+#include <vector>
+#include <string>
+
+// Include GLEW
+#include <GL/glew.h>
+
+#include "texture.hpp"
+#include "textureupload.hpp"
+#include "texturemanager.hpp"
+
+static inline double toMB(size_t bytes) {
+	return bytes / (1024.0 * 1024.0);
+}
+
+void createTextureManager(TextureManager& manager, size_t gpuBudget, TextureUploadQueue& queue) {
+	manager.gpuBudget = gpuBudget;
+	manager.queue = &queue;
+	manager.textures.clear();
+}
+
+unsigned int addTextureArray(TextureManager& manager, const char* name, Image* images, unsigned int count) {
+	manager.textures.push_back(ManagedTexture());
+	ManagedTexture& texture = manager.textures.back();
+	texture.name = name;
+	texture.target = GL_TEXTURE_2D_ARRAY;
+	texture.owned = true;
+	texture.droppedLevels = 0;
+	texture.images.resize(count);
+	for (unsigned int layer = 0; layer < count; layer++)
+		moveImage(images[layer], texture.images[layer]);
+
+	// Decided at load time, before anything is allocated: drop the largest level until the rest
+	// fits next to what is already there, keeping at least the 1 x 1 level
+	size_t used = getTextureFootprint(manager).gpuBytes;
+	size_t fullBytes = getTextureArrayBytes(texture.images.data(), count);
+	unsigned int mipCount = count > 0 ? texture.images[0].mipCount : 0;
+	while (texture.droppedLevels + 1 < mipCount && used + getTextureArrayBytes(texture.images.data(), count, texture.droppedLevels) > manager.gpuBudget)
+		texture.droppedLevels++;
+	texture.gpuBytes = getTextureArrayBytes(texture.images.data(), count, texture.droppedLevels);
+
+	texture.texture = queueTextureArray(texture.images.data(), count, *manager.queue, texture.droppedLevels);
+	if (texture.texture == 0)
+		texture.gpuBytes = 0;
+	if (texture.droppedLevels > 0) {
+		printf("Texture %s: dropped %u top levels to stay within %.1f MB, %.1f MB instead of %.1f MB\n", name, texture.droppedLevels,
+			toMB(manager.gpuBudget), toMB(texture.gpuBytes), toMB(fullBytes));
+	}
+	if (used + texture.gpuBytes > manager.gpuBudget)
+		printf("Texture %s: %.1f MB takes textures over the %.1f MB budget even at 1 x 1\n", name, toMB(texture.gpuBytes), toMB(manager.gpuBudget));
+	return (unsigned int)manager.textures.size() - 1;
+}
+
+unsigned int addExternalTexture(TextureManager& manager, const char* name, GLuint texture, GLenum target, size_t gpuBytes) {
+	manager.textures.push_back(ManagedTexture());
+	ManagedTexture& managed = manager.textures.back();
+	managed.name = name;
+	managed.texture = texture;
+	managed.target = target;
+	managed.owned = false;
+	managed.gpuBytes = gpuBytes;
+	managed.droppedLevels = 0;
+	return (unsigned int)manager.textures.size() - 1;
+}
+
+GLuint getManagedTexture(const TextureManager& manager, unsigned int handle) {
+	return handle < manager.textures.size() ? manager.textures[handle].texture : 0;
+}
+
+void updateTextureManager(TextureManager& manager) {
+	for (size_t i = 0; i < manager.textures.size(); i++) {
+		ManagedTexture& texture = manager.textures[i];
+		if (texture.images.empty() || textureUploadsPending(*manager.queue, texture.texture))
+			continue;
+		for (size_t layer = 0; layer < texture.images.size(); layer++)
+			freeImage(texture.images[layer]);
+		std::vector<Image>().swap(texture.images);
+	}
+}
+
+TextureFootprint getTextureFootprint(const TextureManager& manager) {
+	TextureFootprint footprint;
+	footprint.cpuBytes = footprint.gpuBytes = 0;
+	footprint.gpuBudget = manager.gpuBudget;
+	footprint.textureCount = (unsigned int)manager.textures.size();
+	footprint.droppedLevels = 0;
+	for (size_t i = 0; i < manager.textures.size(); i++) {
+		const ManagedTexture& texture = manager.textures[i];
+		footprint.gpuBytes += texture.gpuBytes;
+		footprint.droppedLevels += texture.droppedLevels;
+		for (size_t layer = 0; layer < texture.images.size(); layer++)
+			footprint.cpuBytes += getImageBytes(texture.images[layer]);
+	}
+	return footprint;
+}
+
+void printTextureFootprint(const TextureManager& manager) {
+	for (size_t i = 0; i < manager.textures.size(); i++) {
+		const ManagedTexture& texture = manager.textures[i];
+		size_t cpuBytes = 0;
+		for (size_t layer = 0; layer < texture.images.size(); layer++)
+			cpuBytes += getImageBytes(texture.images[layer]);
+		printf("  %-20s GPU %7.2f MB, CPU %7.2f MB%s\n", texture.name.c_str(), toMB(texture.gpuBytes), toMB(cpuBytes), texture.owned ? "" : " (external)");
+	}
+	TextureFootprint footprint = getTextureFootprint(manager);
+	printf("Textures: %u, GPU %.2f MB of %.1f MB, CPU %.2f MB, %u levels dropped\n", footprint.textureCount, toMB(footprint.gpuBytes),
+		toMB(footprint.gpuBudget), toMB(footprint.cpuBytes), footprint.droppedLevels);
+}
+
+void deleteTextureManager(TextureManager& manager) {
+	for (size_t i = 0; i < manager.textures.size(); i++) {
+		ManagedTexture& texture = manager.textures[i];
+		if (texture.owned && texture.texture != 0)
+			glDeleteTextures(1, &texture.texture);
+		for (size_t layer = 0; layer < texture.images.size(); layer++)
+			freeImage(texture.images[layer]);
+	}
+	manager.textures.clear();
+}
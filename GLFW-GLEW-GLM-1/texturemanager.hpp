@@ -0,0 +1,65 @@
+#ifndef TEXTUREMANAGER_HPP
+#define TEXTUREMANAGER_HPP
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+
+#include "texture.hpp"
+#include "textureupload.hpp"
+
+// A texture the manager knows about. Textures it made from images are its own: it keeps their
+// decoded layers until the upload queue is done with them and deletes the GL texture at the end.
+// Textures made elsewhere (e.g. virtual textures) are only counted.
+struct ManagedTexture {
+	std::string name;
+	GLuint texture;
+	GLenum target;
+	bool owned;
+	size_t gpuBytes; // every level GL holds, all layers
+	unsigned int droppedLevels; // top levels left out to stay within the budget
+	std::vector<Image> images; // decoded layers, until their upload is done
+};
+
+// Owns the scene's textures and accounts for the memory they take. A texture that would take the
+// GPU total over the budget loses its largest levels, a quarter of its size each, until it fits.
+struct TextureManager {
+	size_t gpuBudget;
+	TextureUploadQueue* queue;
+	std::vector<ManagedTexture> textures;
+};
+
+// What the textures take right now.
+struct TextureFootprint {
+	size_t cpuBytes; // decoded layers still held, mapped or in memory
+	size_t gpuBytes;
+	size_t gpuBudget;
+	unsigned int textureCount;
+	unsigned int droppedLevels; // over all textures
+};
+
+void createTextureManager(TextureManager& manager, size_t gpuBudget, TextureUploadQueue& queue);
+
+// Takes over the decoded layers (the images are left empty) and queues them as a texture array,
+// without as many top levels as the budget calls for. Returns the texture's handle.
+unsigned int addTextureArray(TextureManager& manager, const char* name, Image* images, unsigned int count);
+
+// Counts a texture made elsewhere against the budget; it stays the caller's to delete.
+unsigned int addExternalTexture(TextureManager& manager, const char* name, GLuint texture, GLenum target, size_t gpuBytes);
+
+GLuint getManagedTexture(const TextureManager& manager, unsigned int handle);
+
+// Frees the decoded layers of every texture the upload queue is done with. Call once per frame,
+// after processTextureUploads.
+void updateTextureManager(TextureManager& manager);
+
+TextureFootprint getTextureFootprint(const TextureManager& manager);
+
+// One line per texture and the totals.
+void printTextureFootprint(const TextureManager& manager);
+
+// Deletes the textures the manager owns and frees whatever layers it still holds.
+void deleteTextureManager(TextureManager& manager);
+
+#endif
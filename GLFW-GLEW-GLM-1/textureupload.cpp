@@ -0,0 +1,234 @@
+// Include standard headers
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+// Include GLEW
+#include <GL/glew.h>
+
+#include "texcompress.hpp"
+#include "texture.hpp"
+#include "textureupload.hpp"
+
+// Every copy starts 16-byte aligned, which keeps memcpy on its fast path
+static inline size_t alignStaging(size_t bytes) {
+	return (bytes + 15) & ~(size_t)15;
+}
+
+// The in-flight region runs from the tail up to head, wrapping around the end of the buffer.
+static inline size_t stagingTail(const TextureUploadQueue& queue) {
+	return (queue.head + queue.size - queue.used) % queue.size;
+}
+
+// Largest copy that fits without touching a region the GPU may still read: either from head to
+// the end of the buffer, or from the start up to the tail.
+static size_t stagingRoom(const TextureUploadQueue& queue) {
+	if (queue.used == 0)
+		return queue.size;
+	if (queue.used == queue.size)
+		return 0;
+	size_t tail = stagingTail(queue);
+	if (queue.head >= tail)
+		return queue.size - queue.head > tail ? queue.size - queue.head : tail;
+	return tail - queue.head;
+}
+
+// Takes bytes (no more than stagingRoom) from the ring; skipping the end of the buffer to wrap
+// around counts as used until the same fence passes.
+static size_t reserveStaging(TextureUploadQueue& queue, size_t bytes) {
+	if (queue.used == 0)
+		queue.head = 0;
+	if (queue.used > 0 && queue.head >= stagingTail(queue) && queue.size - queue.head < bytes) {
+		queue.used += queue.size - queue.head;
+		queue.pending += queue.size - queue.head;
+		queue.head = 0;
+	}
+	size_t offset = queue.head;
+	queue.head = (queue.head + bytes) % queue.size;
+	queue.used += bytes;
+	queue.pending += bytes;
+	return offset;
+}
+
+// Regions whose fence has passed are free again. Never waits: a fence still pending stops it.
+static void retireFences(TextureUploadQueue& queue) {
+	while (!queue.fences.empty()) {
+		GLenum status = glClientWaitSync(queue.fences.front().sync, 0, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+			break;
+		glDeleteSync(queue.fences.front().sync);
+		queue.used -= queue.fences.front().bytes;
+		queue.fences.pop_front();
+	}
+}
+
+bool createTextureUploadQueue(TextureUploadQueue& queue, size_t stagingBytes) {
+	queue.size = alignStaging(stagingBytes);
+	queue.head = queue.used = queue.pending = 0;
+	queue.mapped = NULL;
+	queue.bytesUploaded = 0;
+	queue.uploadFrames = queue.bandsUploaded = 0;
+	queue.largestFrameBytes = 0;
+	queue.longestFrameMs = 0.0;
+
+	glGenBuffers(1, &queue.buffer);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, queue.buffer);
+	if (GLEW_ARB_buffer_storage) {
+		// Mapped once for good; coherent, so the copies need no flush before the uploads read them
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_PIXEL_UNPACK_BUFFER, queue.size, NULL, flags);
+		queue.mapped = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, queue.size, flags);
+	}
+	if (queue.mapped == NULL) {
+		// Without buffer storage the buffer is mapped for each copy; the fences already keep the
+		// copies off what the GPU reads, so the mapping need not synchronize
+		if (GLEW_ARB_buffer_storage) {
+			glDeleteBuffers(1, &queue.buffer);
+			glGenBuffers(1, &queue.buffer);
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, queue.buffer);
+		}
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, queue.size, NULL, GL_STREAM_DRAW);
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	printf("Texture upload queue: %.1f MB of staging, %s\n", queue.size / (1024.0 * 1024.0),
+		queue.mapped != NULL ? "persistently mapped" : "mapped per copy");
+	return glGetError() == GL_NO_ERROR;
+}
+
+void queueTextureUpload(TextureUploadQueue& queue, const TextureUpload& upload) {
+	queue.uploads.push_back(upload);
+	queue.uploads.back().nextRow = 0;
+}
+
+void processTextureUploads(TextureUploadQueue& queue, size_t frameBudget) {
+	retireFences(queue);
+	if (queue.uploads.empty())
+		return;
+
+	std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, queue.buffer);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	size_t frameBytes = 0;
+	while (!queue.uploads.empty()) {
+		TextureUpload& upload = queue.uploads.front();
+		bool compressed = upload.format != TEXTURE_UNCOMPRESSED;
+
+		// A band is a row of pixels, or a row of blocks; staged, decoded blocks take RGBA8 rows
+		int bandRows = compressed ? 4 : 1;
+		size_t sourceBandBytes = getLevelSize(upload.format, upload.width, bandRows, upload.channels);
+		size_t bandBytes = upload.decode ? (size_t)upload.width * bandRows * 4 : sourceBandBytes;
+		if (bandBytes > queue.size) {
+			printf("Level %d of texture %u has rows too wide for the staging buffer, skipped\n", upload.level, upload.texture);
+			queue.uploads.pop_front();
+			continue;
+		}
+
+		// As many bands as are left, the budget allows and fit in one piece; the first band of a
+		// frame goes in even over budget so that a wide level still gets somewhere
+		size_t bands = (size_t)(upload.height - upload.nextRow + bandRows - 1) / bandRows;
+		size_t budgetBands = (frameBudget > frameBytes ? frameBudget - frameBytes : 0) / bandBytes;
+		if (budgetBands == 0 && frameBytes == 0)
+			budgetBands = 1;
+		size_t roomBands = stagingRoom(queue) / bandBytes;
+		bands = bands < budgetBands ? bands : budgetBands;
+		bands = bands < roomBands ? bands : roomBands;
+		if (bands == 0)
+			break;
+
+		int rows = (int)bands * bandRows;
+		if (rows > upload.height - upload.nextRow)
+			rows = upload.height - upload.nextRow;
+		size_t bytes = upload.decode ? (size_t)upload.width * rows * 4 : bands * sourceBandBytes;
+		size_t offset = reserveStaging(queue, alignStaging(bytes));
+
+		// Into the staging buffer, decoding on the way when the driver cannot take the blocks
+		const unsigned char* source = upload.pixels + (size_t)(upload.nextRow / bandRows) * sourceBandBytes;
+		unsigned char* staging = queue.mapped != NULL ? queue.mapped + offset
+			: (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, offset, alignStaging(bytes), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		if (staging == NULL)
+			break;
+		if (upload.decode)
+			decompressLevel(upload.format, source, upload.width, rows, staging);
+		else
+			memcpy(staging, source, bytes);
+		if (queue.mapped == NULL)
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+		// The pixel pointer is an offset into the bound unpack buffer, so the call returns at once
+		glBindTexture(upload.target, upload.texture);
+		const void* pixels = (const void*)offset;
+		GLenum compressedFormat = getCompressedFormat(upload.format);
+		GLenum pixelFormat = upload.decode ? GL_RGBA : getPixelFormat(upload.channels);
+		if (upload.target == GL_TEXTURE_2D_ARRAY) {
+			if (compressed && !upload.decode)
+				glCompressedTexSubImage3D(upload.target, upload.level, 0, upload.nextRow, upload.layer, upload.width, rows, 1, compressedFormat, (GLsizei)bytes, pixels);
+			else
+				glTexSubImage3D(upload.target, upload.level, 0, upload.nextRow, upload.layer, upload.width, rows, 1, pixelFormat, GL_UNSIGNED_BYTE, pixels);
+		}
+		else {
+			if (compressed && !upload.decode)
+				glCompressedTexSubImage2D(upload.target, upload.level, 0, upload.nextRow, upload.width, rows, compressedFormat, (GLsizei)bytes, pixels);
+			else
+				glTexSubImage2D(upload.target, upload.level, 0, upload.nextRow, upload.width, rows, pixelFormat, GL_UNSIGNED_BYTE, pixels);
+		}
+		frameBytes += bytes;
+		queue.bandsUploaded++;
+
+		upload.nextRow += rows;
+		if (upload.nextRow >= upload.height) {
+			// GL runs commands in order, so draws after this see the whole level
+			if (upload.setBaseLevel)
+				glTexParameteri(upload.target, GL_TEXTURE_BASE_LEVEL, upload.level);
+			queue.uploads.pop_front();
+		}
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+	// One fence covers everything staged this frame
+	if (queue.pending > 0) {
+		StagingFence fence;
+		fence.sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		fence.bytes = queue.pending;
+		queue.fences.push_back(fence);
+		queue.pending = 0;
+	}
+
+	if (frameBytes > 0) {
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+		queue.bytesUploaded += frameBytes;
+		queue.uploadFrames++;
+		if (frameBytes > queue.largestFrameBytes)
+			queue.largestFrameBytes = frameBytes;
+		if (ms > queue.longestFrameMs)
+			queue.longestFrameMs = ms;
+	}
+}
+
+bool textureUploadsIdle(const TextureUploadQueue& queue) {
+	return queue.uploads.empty();
+}
+
+bool textureUploadsPending(const TextureUploadQueue& queue, GLuint texture) {
+	for (size_t i = 0; i < queue.uploads.size(); i++) {
+		if (queue.uploads[i].texture == texture)
+			return true;
+	}
+	return false;
+}
+
+void deleteTextureUploadQueue(TextureUploadQueue& queue) {
+	for (size_t i = 0; i < queue.fences.size(); i++)
+		glDeleteSync(queue.fences[i].sync);
+	queue.fences.clear();
+	queue.uploads.clear();
+	if (queue.mapped != NULL) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, queue.buffer);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		queue.mapped = NULL;
+	}
+	glDeleteBuffers(1, &queue.buffer);
+	queue.buffer = 0;
+}
@@ -0,0 +1,71 @@
+#ifndef TEXTUREUPLOAD_HPP
+#define TEXTUREUPLOAD_HPP
+
+#include <stddef.h>
+#include <deque>
+#include <GL/glew.h>
+
+#include "texcompress.hpp"
+
+// One level (or one layer of a level) of a texture whose storage already exists. The pixels are
+// read when the upload gets its turn, so they must stay valid until the queue is idle.
+struct TextureUpload {
+	GLenum target; // GL_TEXTURE_2D or GL_TEXTURE_2D_ARRAY
+	GLuint texture;
+	int level, layer;
+	int width, height;
+	int channels;
+	TextureFormat format;
+	bool decode; // compressed blocks the driver does not take, decoded to RGBA8 into the staging buffer
+	bool setBaseLevel; // make `level` the texture's base level once it is in
+	const unsigned char* pixels;
+	int nextRow; // rows already staged; a multiple of 4 for blocks
+};
+
+// Regions of the staging buffer the GPU may still be reading, released once their fence passes.
+struct StagingFence {
+	GLsync sync;
+	size_t bytes;
+};
+
+// Uploads go through one pixel unpack buffer used as a ring: pixels are copied into it, the
+// glTexSubImage calls read from offsets inside it, and each frame's region is recycled when the
+// fence after it has passed, so neither the copy nor the upload ever waits for the GPU. The
+// buffer is persistently mapped with ARB_buffer_storage, and mapped unsynchronized per copy
+// without it. At most a byte budget goes in per frame: levels bigger than that are split into
+// bands of rows over several frames.
+struct TextureUploadQueue {
+	GLuint buffer;
+	unsigned char* mapped; // NULL when the buffer is mapped per copy
+	size_t size;
+	size_t head; // where the next copy goes
+	size_t used; // bytes from the oldest fenced region up to head, wasted ends included
+	size_t pending; // staged this frame, fenced by processTextureUploads
+	std::deque<StagingFence> fences;
+	std::deque<TextureUpload> uploads;
+
+	unsigned long long bytesUploaded;
+	unsigned int uploadFrames, bandsUploaded;
+	size_t largestFrameBytes;
+	double longestFrameMs;
+};
+
+bool createTextureUploadQueue(TextureUploadQueue& queue, size_t stagingBytes);
+
+// Adds a level to the queue. Uploads go in the order they are queued.
+void queueTextureUpload(TextureUploadQueue& queue, const TextureUpload& upload);
+
+// Stages and uploads up to about frameBudget bytes of the queued levels, at least one band of
+// rows when there is room, then fences what was staged. Call once per frame on the main thread;
+// leaves texture unit 0's binding of the targets it touched changed and no unpack buffer bound.
+void processTextureUploads(TextureUploadQueue& queue, size_t frameBudget);
+
+// Nothing queued any more, so the pixels of every queued level can go.
+bool textureUploadsIdle(const TextureUploadQueue& queue);
+
+// Whether any level of the texture is still queued, so its pixels are still needed.
+bool textureUploadsPending(const TextureUploadQueue& queue, GLuint texture);
+
+void deleteTextureUploadQueue(TextureUploadQueue& queue);
+
+#endif
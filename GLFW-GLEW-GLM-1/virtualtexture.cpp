@@ -0,0 +1,724 @@
+// Include standard headers
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <algorithm>
+
+// Include GLEW
+#include <GL/glew.h>
+
+#include "stb_image.h"
+#include "mappedfile.hpp"
+#include "texcompress.hpp"
+#include "texture.hpp"
+#include "streammesh.hpp"
+#include "virtualtexture.hpp"
+
+// Virtual texture cache, written next to the source as <path>.vtcache.
+// Layout (native endianness, the tiles page-aligned):
+//   VirtualCacheHeader | level 0 tiles, row by row | level 1 tiles | ... | coarsest tile
+// Every tile is virtualTileSize x virtualTileSize RGBA8 texels, or the blocks of them in `format`.
+// Like the stream cache it is keyed to the source by size and mtime only: hashing a source of
+// several GB costs about as much as tiling it again.
+struct VirtualCacheHeader {
+	char magic[4];
+	uint32_t version;
+	uint64_t sourceSize;
+	int64_t sourceTime;
+	uint32_t width;
+	uint32_t height;
+	uint32_t format;
+	uint32_t levelCount;
+	uint32_t tilesWide;
+	uint32_t tilesHigh;
+	uint32_t levelTilesWide[maxVirtualLevels];
+	uint32_t levelTilesHigh[maxVirtualLevels];
+	uint64_t levelFirstTile[maxVirtualLevels];
+	uint64_t tileBytes;
+	uint64_t dataOffset;
+};
+
+static const char virtualCacheMagic[4] = { 'V', 'T', 'E', 'X' };
+static const uint32_t virtualCacheVersion = 1;
+
+// The feedback pass writes 12 bits of tile x and y, so no level can be more tiles across
+static const unsigned int maxVirtualTiles = 4096;
+
+// A slot that never gets evicted
+static const unsigned int pinnedSlot = 0xFFFFFFFFu;
+
+static inline uint64_t alignPage(uint64_t offset) {
+	return (offset + 4095) & ~(uint64_t)4095;
+}
+
+static inline unsigned int levelGridSize(unsigned int tiles, unsigned int level) {
+	tiles >>= level;
+	return tiles > 0 ? tiles : 1;
+}
+
+// Rows of the level being tiled: the source, mapped or decoded, or a coarser level mapped back
+// from its temporary file.
+struct Raster {
+	const unsigned char* pixels;
+	int width, height, channels;
+	MappedFile file; // file.data is NULL when the pixels are in memory
+	size_t fileOffset; // of the first row, in the mapping
+};
+
+static inline const unsigned char* rasterRow(const Raster& raster, int y) {
+	return raster.pixels + (size_t)y * raster.width * raster.channels;
+}
+
+// Drops mapped rows that are done with; memory rows stay until the raster goes.
+static void releaseRows(const Raster& raster, int firstRow, int rowCount) {
+	if (raster.file.data == NULL || rowCount <= 0)
+		return;
+	size_t rowBytes = (size_t)raster.width * raster.channels;
+	releaseMappedRange(raster.file, raster.fileOffset + firstRow * rowBytes, rowCount * rowBytes);
+}
+
+static inline void readTexel(const unsigned char* p, int channels, unsigned char* rgba) {
+	rgba[0] = p[0];
+	rgba[1] = p[1];
+	rgba[2] = p[2];
+	rgba[3] = channels == 4 ? p[3] : 255;
+}
+
+// Maps a binary PPM (P6, 8 bits per channel): its rows sit in the file as they are, which is what
+// lets a source of any size be tiled a band at a time.
+static bool openPPM(const char* path, Raster& raster) {
+	if (!openMappedFile(path, raster.file))
+		return false;
+
+	const char* p = raster.file.data;
+	const char* end = p + raster.file.size;
+	bool valid = raster.file.size > 2 && p[0] == 'P' && p[1] == '6';
+	p += 2;
+
+	// Width, height and maximum value, separated by whitespace and # comments
+	long values[3] = { 0, 0, 0 };
+	for (int i = 0; valid && i < 3; i++) {
+		while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n' || *p == '#')) {
+			if (*p == '#') {
+				while (p < end && *p != '\n')
+					p++;
+			}
+			else {
+				p++;
+			}
+		}
+		valid = p < end && *p >= '0' && *p <= '9';
+		while (valid && p < end && *p >= '0' && *p <= '9') {
+			values[i] = values[i] * 10 + (*p++ - '0');
+			valid = values[i] <= (1L << 24);
+		}
+	}
+	// A single whitespace character ends the header
+	valid = valid && p < end && values[0] > 0 && values[1] > 0 && values[2] == 255;
+	if (valid) {
+		raster.width = (int)values[0];
+		raster.height = (int)values[1];
+		raster.channels = 3;
+		raster.fileOffset = (size_t)(p + 1 - raster.file.data);
+		raster.pixels = (const unsigned char*)raster.file.data + raster.fileOffset;
+		valid = raster.fileOffset + (uint64_t)raster.width * raster.height * 3 <= raster.file.size;
+	}
+	if (!valid) {
+		closeMappedFile(raster.file);
+		return false;
+	}
+	return true;
+}
+
+// Cuts one level into tiles a row of tiles at a time, borders included, and appends them to the
+// cache. Meanwhile every pair of rows the tiles are done with is averaged into the next level,
+// which goes to `half` when there is one, so each level is read once.
+static bool tileLevel(const Raster& raster, unsigned int tilesWide, unsigned int tilesHigh, TextureFormat format, FILE* cache, FILE* half) {
+	size_t tileTexels = (size_t)virtualTileSize * virtualTileSize;
+	std::vector<unsigned char> strip(tilesWide * tileTexels * 4);
+	std::vector<unsigned char> blocks;
+	int halfWidth = (raster.width + 1) / 2, halfHeight = (raster.height + 1) / 2;
+	std::vector<unsigned char> halfRow((size_t)halfWidth * 4);
+	int nextHalfRow = 0, releasedRows = 0;
+
+	for (unsigned int ty = 0; ty < tilesHigh; ty++) {
+		// The tiles go into the strip one under the other, a column of tiles, so that the blocks
+		// of each one come out of the encoder contiguous
+		for (int y = 0; y < virtualTileSize; y++) {
+			int sy = (int)ty * virtualTilePayload - virtualTileBorder + y;
+			sy = sy < 0 ? 0 : (sy >= raster.height ? raster.height - 1 : sy);
+			const unsigned char* row = rasterRow(raster, sy);
+			for (unsigned int tx = 0; tx < tilesWide; tx++) {
+				unsigned char* out = strip.data() + ((size_t)tx * virtualTileSize + y) * virtualTileSize * 4;
+				for (int x = 0; x < virtualTileSize; x++) {
+					int sx = (int)tx * virtualTilePayload - virtualTileBorder + x;
+					sx = sx < 0 ? 0 : (sx >= raster.width ? raster.width - 1 : sx);
+					readTexel(row + (size_t)sx * raster.channels, raster.channels, out + x * 4);
+				}
+			}
+		}
+		bool ok;
+		if (format == TEXTURE_UNCOMPRESSED) {
+			ok = fwrite(strip.data(), 1, strip.size(), cache) == strip.size();
+		}
+		else {
+			int stripHeight = virtualTileSize * (int)tilesWide;
+			blocks.resize(getLevelSize(format, virtualTileSize, stripHeight, 4));
+			compressLevel(format, strip.data(), virtualTileSize, stripHeight, 4, blocks.data());
+			ok = fwrite(blocks.data(), 1, blocks.size(), cache) == blocks.size();
+		}
+		if (!ok)
+			return false;
+
+		// Next level rows whose two source rows have both been read
+		int lastRow = ((int)ty + 1) * virtualTilePayload + virtualTileBorder - 1;
+		if (lastRow >= raster.height || ty + 1 == tilesHigh)
+			lastRow = raster.height - 1;
+		while (half != NULL && nextHalfRow < halfHeight) {
+			int y1 = 2 * nextHalfRow + 1 < raster.height ? 2 * nextHalfRow + 1 : raster.height - 1;
+			if (y1 > lastRow)
+				break;
+			const unsigned char* row0 = rasterRow(raster, 2 * nextHalfRow);
+			const unsigned char* row1 = rasterRow(raster, y1);
+			for (int x = 0; x < halfWidth; x++) {
+				int x0 = 2 * x * raster.channels;
+				int x1 = (2 * x + 1 < raster.width ? 2 * x + 1 : raster.width - 1) * raster.channels;
+				unsigned char texels[4][4];
+				readTexel(row0 + x0, raster.channels, texels[0]);
+				readTexel(row0 + x1, raster.channels, texels[1]);
+				readTexel(row1 + x0, raster.channels, texels[2]);
+				readTexel(row1 + x1, raster.channels, texels[3]);
+				for (int c = 0; c < 4; c++)
+					halfRow[x * 4 + c] = (unsigned char)((texels[0][c] + texels[1][c] + texels[2][c] + texels[3][c] + 2) >> 2);
+			}
+			if (fwrite(halfRow.data(), 1, halfRow.size(), half) != halfRow.size())
+				return false;
+			nextHalfRow++;
+		}
+
+		// Rows above both the next tile row's border and the next pair to average are done with
+		int doneRows = ((int)ty + 1) * virtualTilePayload - virtualTileBorder;
+		if (half != NULL && 2 * nextHalfRow < doneRows)
+			doneRows = 2 * nextHalfRow;
+		if (doneRows > raster.height)
+			doneRows = raster.height;
+		releaseRows(raster, releasedRows, doneRows - releasedRows);
+		if (doneRows > releasedRows)
+			releasedRows = doneRows;
+	}
+	return true;
+}
+
+static bool cookVirtualTexture(const char* path, const std::string& cachePath, TextureFormat format, VirtualCacheHeader& header) {
+	Raster raster;
+	memset(&raster, 0, sizeof(raster));
+	unsigned char* decoded = NULL;
+	if (!openPPM(path, raster)) {
+		decoded = stbi_load(path, &raster.width, &raster.height, &raster.channels, 4);
+		if (decoded == NULL) {
+			printf("Failed to load virtual texture %s: %s\n", path, stbi_failure_reason());
+			return false;
+		}
+		raster.pixels = decoded;
+		raster.channels = 4;
+	}
+
+	// A power-of-two grid of tiles over level 0, halving every level down to a single tile
+	header.width = raster.width;
+	header.height = raster.height;
+	header.format = format;
+	header.tilesWide = header.tilesHigh = 1;
+	while (header.tilesWide * virtualTilePayload < (uint32_t)raster.width)
+		header.tilesWide *= 2;
+	while (header.tilesHigh * virtualTilePayload < (uint32_t)raster.height)
+		header.tilesHigh *= 2;
+	header.levelCount = 1;
+	while (levelGridSize(header.tilesWide, header.levelCount - 1) > 1 || levelGridSize(header.tilesHigh, header.levelCount - 1) > 1)
+		header.levelCount++;
+	if (header.levelCount > maxVirtualLevels || header.tilesWide > maxVirtualTiles || header.tilesHigh > maxVirtualTiles) {
+		printf("%s is too big for a virtual texture: %dx%d\n", path, raster.width, raster.height);
+		closeMappedFile(raster.file);
+		stbi_image_free(decoded);
+		return false;
+	}
+	uint64_t tileCount = 0;
+	int levelWidth = raster.width, levelHeight = raster.height;
+	for (uint32_t level = 0; level < header.levelCount; level++) {
+		header.levelTilesWide[level] = (levelWidth + virtualTilePayload - 1) / virtualTilePayload;
+		header.levelTilesHigh[level] = (levelHeight + virtualTilePayload - 1) / virtualTilePayload;
+		header.levelFirstTile[level] = tileCount;
+		tileCount += (uint64_t)header.levelTilesWide[level] * header.levelTilesHigh[level];
+		levelWidth = (levelWidth + 1) / 2;
+		levelHeight = (levelHeight + 1) / 2;
+	}
+	header.tileBytes = getLevelSize(format, virtualTileSize, virtualTileSize, 4);
+	header.dataOffset = alignPage(sizeof(VirtualCacheHeader));
+
+	std::string tempPath = cachePath + ".tmp";
+	std::string levelPaths[2] = { cachePath + ".level0.tmp", cachePath + ".level1.tmp" };
+	FILE* cache = fopen(tempPath.c_str(), "wb");
+	bool ok = cache != NULL;
+	if (ok) {
+		// The header goes in last, once the file is complete
+		std::vector<char> padding((size_t)header.dataOffset, 0);
+		ok = fwrite(padding.data(), 1, padding.size(), cache) == padding.size();
+	}
+
+	for (uint32_t level = 0; ok && level < header.levelCount; level++) {
+		const std::string& halfPath = levelPaths[level & 1];
+		FILE* half = NULL;
+		if (level + 1 < header.levelCount) {
+			half = fopen(halfPath.c_str(), "wb");
+			ok = half != NULL;
+		}
+		ok = ok && tileLevel(raster, header.levelTilesWide[level], header.levelTilesHigh[level], format, cache, half);
+		if (half != NULL)
+			ok = fclose(half) == 0 && ok;
+
+		// The level just tiled is done with; the one written meanwhile is next
+		bool temporary = level > 0;
+		closeMappedFile(raster.file);
+		if (temporary)
+			remove(levelPaths[(level + 1) & 1].c_str());
+		if (ok && level + 1 < header.levelCount) {
+			int width = (raster.width + 1) / 2, height = (raster.height + 1) / 2;
+			memset(&raster, 0, sizeof(raster));
+			ok = openMappedFile(halfPath.c_str(), raster.file) && raster.file.size == (size_t)width * height * 4;
+			raster.pixels = (const unsigned char*)raster.file.data;
+			raster.width = width;
+			raster.height = height;
+			raster.channels = 4;
+		}
+		if (decoded != NULL) {
+			stbi_image_free(decoded);
+			decoded = NULL;
+		}
+		printf("Tiled level %u of %s: %ux%u tiles\n", level, path, header.levelTilesWide[level], header.levelTilesHigh[level]);
+	}
+	closeMappedFile(raster.file);
+	stbi_image_free(decoded);
+	remove(levelPaths[0].c_str());
+	remove(levelPaths[1].c_str());
+
+	if (cache != NULL) {
+		ok = ok && fseek(cache, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, cache) == 1;
+		ok = fclose(cache) == 0 && ok;
+	}
+
+	// Same as the other caches: never leave a half-written cache behind
+	remove(cachePath.c_str());
+	if (!ok || rename(tempPath.c_str(), cachePath.c_str()) != 0) {
+		remove(tempPath.c_str());
+		return false;
+	}
+	return true;
+}
+
+// Maps a cache and checks that its levels add up and every tile is inside the file.
+static bool openVirtualCache(const char* cachePath, VirtualTexture& texture) {
+	if (!openMappedFile(cachePath, texture.file))
+		return false;
+
+	const VirtualCacheHeader* header = (const VirtualCacheHeader*)texture.file.data;
+	bool valid = texture.file.size >= sizeof(VirtualCacheHeader)
+		&& memcmp(header->magic, virtualCacheMagic, 4) == 0
+		&& header->version == virtualCacheVersion
+		&& header->format <= TEXTURE_BC7
+		&& header->levelCount >= 1 && header->levelCount <= maxVirtualLevels
+		&& header->tilesWide <= maxVirtualTiles && header->tilesHigh <= maxVirtualTiles
+		&& header->tileBytes == getLevelSize((TextureFormat)header->format, virtualTileSize, virtualTileSize, 4);
+	uint64_t tileCount = 0;
+	for (uint32_t level = 0; valid && level < header->levelCount; level++) {
+		valid = header->levelFirstTile[level] == tileCount
+			&& header->levelTilesWide[level] <= levelGridSize(header->tilesWide, level)
+			&& header->levelTilesHigh[level] <= levelGridSize(header->tilesHigh, level);
+		tileCount += (uint64_t)header->levelTilesWide[level] * header->levelTilesHigh[level];
+	}
+	// The tiles start after the header, and the offset is checked before the length after it, so a
+	// corrupt one cannot wrap the sum and let uploadTile read outside the mapping
+	valid = valid && header->dataOffset >= sizeof(VirtualCacheHeader) && header->dataOffset <= texture.file.size
+		&& tileCount * header->tileBytes <= texture.file.size - header->dataOffset;
+	if (!valid) {
+		closeMappedFile(texture.file);
+		return false;
+	}
+
+	texture.width = header->width;
+	texture.height = header->height;
+	texture.format = (TextureFormat)header->format;
+	texture.levelCount = header->levelCount;
+	texture.tilesWide = header->tilesWide;
+	texture.tilesHigh = header->tilesHigh;
+	for (uint32_t level = 0; level < header->levelCount; level++) {
+		texture.levelTilesWide[level] = header->levelTilesWide[level];
+		texture.levelTilesHigh[level] = header->levelTilesHigh[level];
+		texture.levelFirstTile[level] = header->levelFirstTile[level];
+	}
+	texture.tileBytes = (size_t)header->tileBytes;
+	texture.dataOffset = header->dataOffset;
+	texture.tileSlot.assign((size_t)tileCount, -1);
+	return true;
+}
+
+static void initVirtualTexture(VirtualTexture& texture) {
+	texture.width = texture.height = 0;
+	texture.levelCount = 0;
+	texture.file.data = NULL;
+	texture.file.size = 0;
+	texture.file.fileHandle = NULL;
+	texture.file.mappingHandle = NULL;
+	texture.physicalTexture = texture.indirectionTexture = 0;
+	texture.slotsPerSide = 0;
+	texture.slotTile.clear();
+	texture.slotLastUsed.clear();
+	texture.tileSlot.clear();
+	texture.pendingTiles.clear();
+	texture.indirection.clear();
+	texture.indirectionDirty = false;
+	texture.frame = 0;
+	texture.tilesUploaded = texture.tilesEvicted = 0;
+}
+
+bool openVirtualTexture(const char* path, VirtualTexture& texture, TextureFormat format) {
+	std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+	initVirtualTexture(texture);
+
+	std::string cachePath = std::string(path) + ".vtcache";
+	unsigned long long sourceSize = 0;
+	long long sourceTime = 0;
+	bool haveSource = statFile(path, sourceSize, sourceTime);
+
+	if (openVirtualCache(cachePath.c_str(), texture)) {
+		const VirtualCacheHeader* header = (const VirtualCacheHeader*)texture.file.data;
+		bool fresh = !haveSource || (header->sourceSize == sourceSize && header->sourceTime == sourceTime && texture.format == format);
+		if (fresh) {
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+			printf("Mapped virtual texture %s from its cache: %dx%d in %u levels in %.2f ms\n", path, texture.width, texture.height, texture.levelCount, ms);
+			return true;
+		}
+		closeMappedFile(texture.file);
+		initVirtualTexture(texture);
+	}
+	if (!haveSource) {
+		printf("Impossible to open %s\n", path);
+		return false;
+	}
+
+	VirtualCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, virtualCacheMagic, 4);
+	header.version = virtualCacheVersion;
+	header.sourceSize = sourceSize;
+	header.sourceTime = sourceTime;
+	if (!cookVirtualTexture(path, cachePath, format, header) || !openVirtualCache(cachePath.c_str(), texture)) {
+		printf("Could not tile %s into %s\n", path, cachePath.c_str());
+		initVirtualTexture(texture);
+		return false;
+	}
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+	printf("Tiled %s: %dx%d into %llu tiles in %u levels in %.1f s, peak RSS %.1f MB\n", path, texture.width, texture.height,
+		(unsigned long long)texture.tileSlot.size(), texture.levelCount, seconds, getPeakMemoryUsage() / (1024.0 * 1024.0));
+	return true;
+}
+
+// Copies a tile from the mapping into its slot of the physical texture and drops its pages.
+static void uploadTile(VirtualTexture& texture, unsigned int tile, unsigned int slot, std::vector<unsigned char>& decoded) {
+	size_t offset = (size_t)(texture.dataOffset + (uint64_t)tile * texture.tileBytes);
+	const unsigned char* data = (const unsigned char*)texture.file.data + offset;
+	int x = (int)(slot % texture.slotsPerSide) * virtualTileSize;
+	int y = (int)(slot / texture.slotsPerSide) * virtualTileSize;
+
+	glBindTexture(GL_TEXTURE_2D, texture.physicalTexture);
+	if (texture.format == TEXTURE_UNCOMPRESSED) {
+		glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, virtualTileSize, virtualTileSize, GL_RGBA, GL_UNSIGNED_BYTE, data);
+	}
+	else if (texture.decodeTiles) {
+		decoded.resize((size_t)virtualTileSize * virtualTileSize * 4);
+		decompressLevel(texture.format, data, virtualTileSize, virtualTileSize, decoded.data());
+		glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, virtualTileSize, virtualTileSize, GL_RGBA, GL_UNSIGNED_BYTE, decoded.data());
+	}
+	else {
+		glCompressedTexSubImage2D(GL_TEXTURE_2D, 0, x, y, virtualTileSize, virtualTileSize, getCompressedFormat(texture.format), (GLsizei)texture.tileBytes, data);
+	}
+	releaseMappedRange(texture.file, offset, texture.tileBytes);
+}
+
+// Points every indirection texel at the slot of its tile or, while that is not resident, at
+// whatever its parent texel points at. Goes coarsest level first so parents are always done.
+static void updateIndirection(VirtualTexture& texture) {
+	size_t levelOffset[maxVirtualLevels];
+	size_t total = 0;
+	for (unsigned int level = 0; level < texture.levelCount; level++) {
+		levelOffset[level] = total;
+		total += (size_t)levelGridSize(texture.tilesWide, level) * levelGridSize(texture.tilesHigh, level) * 4;
+	}
+	texture.indirection.resize(total);
+
+	glBindTexture(GL_TEXTURE_2D, texture.indirectionTexture);
+	for (int level = (int)texture.levelCount - 1; level >= 0; level--) {
+		unsigned int width = levelGridSize(texture.tilesWide, level), height = levelGridSize(texture.tilesHigh, level);
+		unsigned char* texels = texture.indirection.data() + levelOffset[level];
+		const unsigned char* parents = level + 1 < (int)texture.levelCount ? texture.indirection.data() + levelOffset[level + 1] : NULL;
+		unsigned int parentWidth = levelGridSize(texture.tilesWide, level + 1);
+		for (unsigned int y = 0; y < height; y++) {
+			for (unsigned int x = 0; x < width; x++) {
+				unsigned char* texel = texels + ((size_t)y * width + x) * 4;
+				int slot = -1;
+				if (x < texture.levelTilesWide[level] && y < texture.levelTilesHigh[level])
+					slot = texture.tileSlot[(size_t)(texture.levelFirstTile[level] + (uint64_t)y * texture.levelTilesWide[level] + x)];
+				if (slot >= 0) {
+					texel[0] = (unsigned char)(slot % texture.slotsPerSide);
+					texel[1] = (unsigned char)(slot / texture.slotsPerSide);
+					texel[2] = (unsigned char)level;
+					texel[3] = 255;
+				}
+				else if (parents != NULL) {
+					memcpy(texel, parents + ((size_t)(y / 2) * parentWidth + x / 2) * 4, 4);
+				}
+				else {
+					memset(texel, 0, 4);
+				}
+			}
+		}
+		glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, width, height, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, texels);
+	}
+	texture.indirectionDirty = false;
+}
+
+// GPU memory of the indirection texture: 4 bytes per tile of the grid, every level
+static size_t getIndirectionBytes(const VirtualTexture& texture) {
+	size_t bytes = 0;
+	for (unsigned int level = 0; level < texture.levelCount; level++)
+		bytes += (size_t)levelGridSize(texture.tilesWide, level) * levelGridSize(texture.tilesHigh, level) * 4;
+	return bytes;
+}
+
+bool createVirtualTextureCache(VirtualTexture& texture, size_t memoryBudget) {
+	bool compressed = texture.format != TEXTURE_UNCOMPRESSED;
+	texture.decodeTiles = compressed && !isCompressionSupported(texture.format);
+	size_t slotBytes = compressed && !texture.decodeTiles ? texture.tileBytes : (size_t)virtualTileSize * virtualTileSize * 4;
+
+	// A square of slots, no wider than GL allows or the indirection texels can address. The
+	// indirection texture comes out of the budget too, so the two together stay within it
+	GLint maxTextureSize = 0;
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+	size_t indirectionBytes = getIndirectionBytes(texture);
+	size_t slotBudget = memoryBudget > indirectionBytes ? memoryBudget - indirectionBytes : 0;
+	unsigned int slotsPerSide = (unsigned int)sqrt((double)(slotBudget / slotBytes));
+	if (slotsPerSide > (unsigned int)maxTextureSize / virtualTileSize)
+		slotsPerSide = (unsigned int)maxTextureSize / virtualTileSize;
+	if (slotsPerSide > 256)
+		slotsPerSide = 256;
+	if (slotsPerSide < 2)
+		slotsPerSide = 2;
+	texture.slotsPerSide = slotsPerSide;
+	unsigned int slotCount = slotsPerSide * slotsPerSide;
+	texture.slotTile.assign(slotCount, -1);
+	texture.slotLastUsed.assign(slotCount, 0);
+	texture.frame = 1;
+
+	int physicalSize = (int)slotsPerSide * virtualTileSize;
+	glGenTextures(1, &texture.physicalTexture);
+	glBindTexture(GL_TEXTURE_2D, texture.physicalTexture);
+	if (compressed && !texture.decodeTiles)
+		glCompressedTexImage2D(GL_TEXTURE_2D, 0, getCompressedFormat(texture.format), physicalSize, physicalSize, 0, (GLsizei)getLevelSize(texture.format, physicalSize, physicalSize, 4), NULL);
+	else
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, physicalSize, physicalSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	// One level: the borders take care of filtering, and the shader picks the tile's level itself
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+
+	// One texel per tile, one level per level; integer textures only take nearest filtering
+	glGenTextures(1, &texture.indirectionTexture);
+	glBindTexture(GL_TEXTURE_2D, texture.indirectionTexture);
+	for (unsigned int level = 0; level < texture.levelCount; level++)
+		glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8UI, levelGridSize(texture.tilesWide, level), levelGridSize(texture.tilesHigh, level), 0, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, texture.levelCount - 1);
+
+	// Everything falls back to the coarsest tile, so it comes first and stays
+	std::vector<unsigned char> decoded;
+	unsigned int root = (unsigned int)texture.tileSlot.size() - 1;
+	uploadTile(texture, root, 0, decoded);
+	texture.slotTile[0] = (int)root;
+	texture.slotLastUsed[0] = pinnedSlot;
+	texture.tileSlot[root] = 0;
+	texture.tilesUploaded = 1;
+	updateIndirection(texture);
+
+	printf("Virtual texture cache: %ux%u slots of %dx%d texels (%.1f MB) for %llu tiles in %u levels\n", slotsPerSide, slotsPerSide,
+		virtualTileSize, virtualTileSize, slotCount * slotBytes / (1024.0 * 1024.0), (unsigned long long)texture.tileSlot.size(), texture.levelCount);
+	return true;
+}
+
+void requestVirtualTile(VirtualTexture& texture, unsigned int level, unsigned int x, unsigned int y) {
+	// The tile and every coarser one over it: those are what shows until it is in
+	for (; level < texture.levelCount; level++, x /= 2, y /= 2) {
+		if (x >= texture.levelTilesWide[level] || y >= texture.levelTilesHigh[level])
+			continue;
+		unsigned int tile = (unsigned int)(texture.levelFirstTile[level] + (uint64_t)y * texture.levelTilesWide[level] + x);
+		int slot = texture.tileSlot[tile];
+		if (slot < 0)
+			texture.pendingTiles.push_back(tile);
+		else if (texture.slotLastUsed[slot] != pinnedSlot)
+			texture.slotLastUsed[slot] = texture.frame;
+	}
+}
+
+void updateVirtualTexture(VirtualTexture& texture, unsigned int maxUploads) {
+	// Coarser levels are stored after finer ones, so the highest tile numbers go first
+	std::sort(texture.pendingTiles.begin(), texture.pendingTiles.end(), std::greater<uint32_t>());
+	texture.pendingTiles.erase(std::unique(texture.pendingTiles.begin(), texture.pendingTiles.end()), texture.pendingTiles.end());
+
+	std::vector<unsigned char> decoded;
+	unsigned int uploads = 0;
+	for (size_t i = 0; i < texture.pendingTiles.size() && uploads < maxUploads; i++) {
+		unsigned int tile = texture.pendingTiles[i];
+		if (texture.tileSlot[tile] >= 0)
+			continue;
+
+		// Never take the slot of a tile asked for this frame; what is left waits for the next
+		unsigned int oldest = 0;
+		for (unsigned int slot = 1; slot < texture.slotTile.size(); slot++) {
+			if (texture.slotLastUsed[slot] < texture.slotLastUsed[oldest])
+				oldest = slot;
+		}
+		if (texture.slotLastUsed[oldest] >= texture.frame)
+			break;
+		if (texture.slotTile[oldest] >= 0) {
+			texture.tileSlot[texture.slotTile[oldest]] = -1;
+			texture.tilesEvicted++;
+		}
+
+		uploadTile(texture, tile, oldest, decoded);
+		texture.slotTile[oldest] = (int)tile;
+		texture.slotLastUsed[oldest] = texture.frame;
+		texture.tileSlot[tile] = (int)oldest;
+		texture.tilesUploaded++;
+		texture.indirectionDirty = true;
+		uploads++;
+	}
+	// Anything still missing is asked for again by the next feedback
+	texture.pendingTiles.clear();
+
+	if (texture.indirectionDirty)
+		updateIndirection(texture);
+	texture.frame++;
+}
+
+void closeVirtualTexture(VirtualTexture& texture) {
+	if (texture.physicalTexture != 0)
+		glDeleteTextures(1, &texture.physicalTexture);
+	if (texture.indirectionTexture != 0)
+		glDeleteTextures(1, &texture.indirectionTexture);
+	closeMappedFile(texture.file);
+	initVirtualTexture(texture);
+}
+
+size_t getVirtualTextureBytes(const VirtualTexture& texture) {
+	if (texture.physicalTexture == 0)
+		return 0;
+	bool compressed = texture.format != TEXTURE_UNCOMPRESSED && !texture.decodeTiles;
+	int physicalSize = (int)texture.slotsPerSide * virtualTileSize;
+	size_t bytes = compressed ? getLevelSize(texture.format, physicalSize, physicalSize, 4) : (size_t)physicalSize * physicalSize * 4;
+	return bytes + getIndirectionBytes(texture);
+}
+
+bool createVirtualFeedback(VirtualFeedback& feedback, int width, int height) {
+	feedback.width = width;
+	feedback.height = height;
+	feedback.frame = 0;
+
+	glGenFramebuffers(1, &feedback.framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, feedback.framebuffer);
+	glGenRenderbuffers(1, &feedback.colourBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, feedback.colourBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, feedback.colourBuffer);
+	// Depth too, so a body only asks for the tiles of the parts in front
+	glGenRenderbuffers(1, &feedback.depthBuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, feedback.depthBuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, feedback.depthBuffer);
+	bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	glGenBuffers(2, feedback.pixelBuffers);
+	for (int i = 0; i < 2; i++) {
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, feedback.pixelBuffers[i]);
+		glBufferData(GL_PIXEL_PACK_BUFFER, (size_t)width * height * 4, NULL, GL_STREAM_READ);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	if (!complete) {
+		printf("The virtual texture feedback framebuffer is incomplete\n");
+		deleteVirtualFeedback(feedback);
+		return false;
+	}
+	return true;
+}
+
+void beginVirtualFeedback(VirtualFeedback& feedback) {
+	glGetIntegerv(GL_VIEWPORT, feedback.viewport);
+	glBindFramebuffer(GL_FRAMEBUFFER, feedback.framebuffer);
+	glViewport(0, 0, feedback.width, feedback.height);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+void endVirtualFeedback(VirtualFeedback& feedback, VirtualTexture* const* textures, unsigned int textureCount) {
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, feedback.pixelBuffers[feedback.frame & 1]);
+	glReadPixels(0, 0, feedback.width, feedback.height, GL_RGBA, GL_UNSIGNED_BYTE, (void*)0);
+
+	// The previous frame's pixels have had a whole frame to arrive
+	if (feedback.frame > 0) {
+		size_t pixelCount = (size_t)feedback.width * feedback.height;
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, feedback.pixelBuffers[(feedback.frame + 1) & 1]);
+		const unsigned char* pixels = (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, pixelCount * 4, GL_MAP_READ_BIT);
+		if (pixels != NULL) {
+			// A pixel: tile x and y (low 8 bits in r and g, high 4 bits each in b), and in a the
+			// texture index (bits 4-6) and level (bits 0-3) with bit 7 set. Neighbouring pixels
+			// mostly ask for the same tile, so the requests are made unique first
+			feedback.requests.clear();
+			for (size_t i = 0; i < pixelCount; i++) {
+				const unsigned char* p = pixels + i * 4;
+				if (p[3] & 0x80)
+					feedback.requests.push_back((uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24));
+			}
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+
+			std::sort(feedback.requests.begin(), feedback.requests.end());
+			feedback.requests.erase(std::unique(feedback.requests.begin(), feedback.requests.end()), feedback.requests.end());
+			for (size_t i = 0; i < feedback.requests.size(); i++) {
+				uint32_t request = feedback.requests[i];
+				unsigned int high = (request >> 16) & 0xFF, flags = request >> 24;
+				unsigned int x = (request & 0xFF) | ((high & 0x0F) << 8);
+				unsigned int y = ((request >> 8) & 0xFF) | ((high >> 4) << 8);
+				unsigned int index = (flags >> 4) & 7, level = flags & 0x0F;
+				if (index < textureCount && textures[index] != NULL)
+					requestVirtualTile(*textures[index], level, x, y);
+			}
+		}
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(feedback.viewport[0], feedback.viewport[1], feedback.viewport[2], feedback.viewport[3]);
+	feedback.frame++;
+}
+
+void deleteVirtualFeedback(VirtualFeedback& feedback) {
+	glDeleteBuffers(2, feedback.pixelBuffers);
+	glDeleteRenderbuffers(1, &feedback.colourBuffer);
+	glDeleteRenderbuffers(1, &feedback.depthBuffer);
+	glDeleteFramebuffers(1, &feedback.framebuffer);
+	feedback.framebuffer = feedback.colourBuffer = feedback.depthBuffer = 0;
+}
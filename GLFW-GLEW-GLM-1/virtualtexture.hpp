@@ -0,0 +1,99 @@
+#ifndef VIRTUALTEXTURE_HPP
+#define VIRTUALTEXTURE_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include <GL/glew.h>
+
+#include "mappedfile.hpp"
+#include "texcompress.hpp"
+
+// Surface maps too big for memory are cut offline into square tiles, for every mip level. A tile
+// holds virtualTilePayload texels of the level plus a border of its neighbours' texels on every
+// side, so bilinear filtering inside the tile never needs another one. At run time only the tiles
+// the view asks for live in the physical texture, and the indirection texture tells the shader
+// which slot holds each tile, or the closest coarser tile when it is not in yet.
+const int virtualTileSize = 128;
+const int virtualTileBorder = 4;
+const int virtualTilePayload = virtualTileSize - 2 * virtualTileBorder;
+const unsigned int maxVirtualLevels = 16;
+
+// A tiled image mapped from its cache (path + ".vtcache"), and the GL side once created.
+struct VirtualTexture {
+	int width, height; // of the source, in texels
+	TextureFormat format;
+	unsigned int levelCount;
+	// The indirection covers a power-of-two grid of tiles, halving every level down to 1 x 1;
+	// only the tiles that hold some of the image are stored
+	unsigned int tilesWide, tilesHigh;
+	unsigned int levelTilesWide[maxVirtualLevels], levelTilesHigh[maxVirtualLevels];
+	uint64_t levelFirstTile[maxVirtualLevels];
+	size_t tileBytes;
+	uint64_t dataOffset;
+	MappedFile file;
+
+	// Residency: slotsPerSide x slotsPerSide tiles in the physical texture, the one used longest
+	// ago making room. The coarsest tile is loaded first and never leaves
+	GLuint physicalTexture;
+	GLuint indirectionTexture;
+	unsigned int slotsPerSide;
+	bool decodeTiles; // no driver support for the format, so tiles are decoded to RGBA8 first
+	// Tiles are numbered in the order they are stored: level 0 row by row, then level 1, ...
+	std::vector<int> slotTile; // tile held by each slot, -1 while empty
+	std::vector<unsigned int> slotLastUsed; // frame each slot was last asked for
+	std::vector<int> tileSlot; // slot of each tile, -1 while it is not resident
+	std::vector<uint32_t> pendingTiles; // asked for and not resident, loaded by updateVirtualTexture
+	std::vector<unsigned char> indirection; // RGBA8UI texels of every level: slot x, slot y, level
+	bool indirectionDirty;
+	unsigned int frame;
+	unsigned long long tilesUploaded, tilesEvicted;
+};
+
+// Maps the cache of an image, cutting it into tiles first when the cache is missing, stale or in
+// another format. A binary PPM (P6) source is read through a mapping a band of rows at a time and
+// every coarser level goes through a temporary file, so the source can be far bigger than memory;
+// anything else is decoded whole with stb_image. Touches no GL state, so it can run on a worker.
+bool openVirtualTexture(const char* path, VirtualTexture& texture, TextureFormat format);
+
+// Creates the indirection texture and the physical texture, with as many slots as fit in what the
+// indirection leaves of memoryBudget bytes of GPU memory, and loads the coarsest tile. Main thread only.
+bool createVirtualTextureCache(VirtualTexture& texture, size_t memoryBudget);
+
+// Asks for a tile of a level for this frame: a resident tile is kept, a missing one queued.
+void requestVirtualTile(VirtualTexture& texture, unsigned int level, unsigned int x, unsigned int y);
+
+// Loads up to maxUploads of the queued tiles, coarsest first, releases their pages from the
+// mapping, and refreshes the indirection texture if anything moved. Then starts the next frame.
+void updateVirtualTexture(VirtualTexture& texture, unsigned int maxUploads);
+
+void closeVirtualTexture(VirtualTexture& texture);
+
+// GPU memory of the physical and indirection textures, once created.
+size_t getVirtualTextureBytes(const VirtualTexture& texture);
+
+// The feedback pass: the virtual textured meshes are drawn into a small framebuffer with a shader
+// that writes the tile every pixel needs. The pixels are read back into a buffer object and only
+// looked at a frame later, so reading them never waits for the GPU.
+struct VirtualFeedback {
+	GLuint framebuffer;
+	GLuint colourBuffer, depthBuffer;
+	GLuint pixelBuffers[2];
+	int width, height;
+	unsigned int frame;
+	GLint viewport[4]; // of the caller, put back by endVirtualFeedback
+	std::vector<uint32_t> requests;
+};
+
+bool createVirtualFeedback(VirtualFeedback& feedback, int width, int height);
+
+// Binds and clears the feedback framebuffer; draw the virtual textured meshes after this.
+void beginVirtualFeedback(VirtualFeedback& feedback);
+
+// Starts reading this frame's pixels back, turns the previous frame's into requestVirtualTile
+// calls on textures[index] and rebinds the window's framebuffer. Null textures are skipped.
+void endVirtualFeedback(VirtualFeedback& feedback, VirtualTexture* const* textures, unsigned int textureCount);
+
+void deleteVirtualFeedback(VirtualFeedback& feedback);
+
+#endif